@@ -0,0 +1,149 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+// Micro-benchmark of the mapping of values to palette colors. It times the
+// per-vertex path, MySetColor(val, min, max, rgba), which evaluates the
+// palette for each value, against the table lookups of MySetColors(), and
+// checks that the RGBA8 colors of the two differ by at most 1 in every
+// channel. No window or GL context is needed.
+//
+// Usage: glvis-palette-bench [number of values] [repetitions]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "mfem.hpp"
+#include "lib/palettes.hpp"
+#include "lib/visual.hpp"
+
+using namespace std;
+using namespace mfem;
+
+extern int RepeatPaletteTimes;
+
+// Defined in glvis.cpp, which is not linked here
+string plot_caption;
+string extra_caption;
+GeometryRefiner GLVisGeometryRefiner;
+
+GridFunction *ProjectVectorFEGridFunction(GridFunction *gf)
+{
+   return gf;
+}
+
+void Extrude1DMeshAndSolution(Mesh **, GridFunction **, Vector *) { }
+
+static double Milliseconds(chrono::steady_clock::time_point start)
+{
+   return chrono::duration<double, milli>(
+             chrono::steady_clock::now() - start).count();
+}
+
+// Time both paths on 'vals' and return the largest channel difference
+static int Compare(const vector<double> &vals, int reps, double min,
+                   double max)
+{
+   const int n = (int) vals.size();
+   vector<array<uint8_t, 4>> ref(n);
+   vector<MappedColor> colors(n);
+
+   double t_ref = 1e30, t_lut = 1e30;
+   for (int r = 0; r < reps; r++)
+   {
+      auto start = chrono::steady_clock::now();
+      for (int i = 0; i < n; i++)
+      {
+         float rgba[4];
+         MySetColor(vals[i], min, max, rgba);
+         ref[i] = gl3::ColorU8(rgba);
+      }
+      t_ref = std::min(t_ref, Milliseconds(start));
+
+      start = chrono::steady_clock::now();
+      MySetColors(vals.data(), n, min, max, colors.data());
+      t_lut = std::min(t_lut, Milliseconds(start));
+   }
+
+   int diff = 0;
+   for (int i = 0; i < n; i++)
+   {
+      for (int c = 0; c < 4; c++)
+      {
+         diff = std::max(diff, abs(ref[i][c] - colors[i].rgba[c]));
+      }
+   }
+   cout << "   MySetColor: " << t_ref << " ms, MySetColors: " << t_lut
+        << " ms (" << t_ref/t_lut << "x), max channel difference: " << diff
+        << endl;
+   return diff;
+}
+
+int main(int argc, char *argv[])
+{
+   const int n = (argc > 1) ? atoi(argv[1]) : (1 << 22);
+   const int reps = (argc > 2) ? atoi(argv[2]) : 5;
+   if (n <= 0 || reps <= 0)
+   {
+      cout << "Usage: " << argv[0] << " [number of values] [repetitions]"
+           << endl;
+      return 1;
+   }
+
+   // values in [min,max] with some outside of it
+   const double min = -1.0, max = 2.0;
+   vector<double> vals(n);
+   for (int i = 0; i < n; i++)
+   {
+      vals[i] = min - 0.1 + (max - min + 0.2)*(0.5 + 0.5*sin(0.001*i));
+   }
+   vector<double> pos(vals);
+   for (int i = 0; i < n; i++)
+   {
+      pos[i] = 1.0 + fabs(pos[i]);
+   }
+
+   palettePrepare();
+   cout << "Mapping " << n << " values to colors, best of " << reps
+        << " runs:" << endl;
+
+   struct { int palette, repeat; float alpha; bool log; } cases[] =
+   {
+      { 2, 1, 1.0f, false }, { 2, 1, 0.5f, false }, { 2, -3, 1.0f, false },
+      { 2, 8, 1.0f, false }, { 5, 1, 1.0f, false }, { 2, 1, 1.0f, true }
+   };
+   int worst = 0;
+   for (size_t k = 0; k < sizeof(cases)/sizeof(cases[0]); k++)
+   {
+      paletteSet(cases[k].palette);
+      RepeatPaletteTimes = cases[k].repeat;
+      MatAlpha = cases[k].alpha;
+      MySetColorLogscale = cases[k].log;
+      cout << "palette " << cases[k].palette << ", repeat "
+           << cases[k].repeat << ", alpha " << cases[k].alpha
+           << (cases[k].log ? ", log scale" : "") << ':' << endl;
+      const int diff = cases[k].log ? Compare(pos, reps, 1.0, 1.0 + max) :
+                       Compare(vals, reps, min, max);
+      worst = std::max(worst, diff);
+   }
+
+   if (worst > 1)
+   {
+      cout << "FAILED: the colors differ by more than 1." << endl;
+      return 2;
+   }
+   cout << "PASSED" << endl;
+   return 0;
+}
@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+# the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+# reserved. See file COPYRIGHT for details.
+#
+# This file is part of the GLVis visualization tool and library. For more
+# information and source code availability see http://glvis.org.
+#
+# GLVis is free software; you can redistribute it and/or modify it under the
+# terms of the GNU Lesser General Public License (as published by the Free
+# Software Foundation) version 2.1 dated February 1999.
+
+# Render the screenshots of a GLVis script with N concurrent GLVis processes,
+# each started with '-run <script> --shard i/N', and check that every
+# screenshot of the script was written exactly once. With -c, the script is
+# then run again by a single process with '--shard 0/1', which loads all the
+# data commands, and its screenshots are compared with the ones of the shards.
+
+GLVIS="${GLVIS:-glvis}"
+NUM_SHARDS=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo 1)
+LOG_DIR=""
+COMPARE=0
+
+function usage()
+{
+   printf "Usage: $0 [-n <shards>] [-g <glvis>] [-l <log-dir>]"
+   printf " <script> [glvis options]\n\n"
+   printf "   -n <shards>   number of GLVis processes (default: ${NUM_SHARDS})\n"
+   printf "   -g <glvis>    GLVis executable (default: ${GLVIS})\n"
+   printf "   -l <log-dir>  directory for the output of the shards\n"
+   printf "                 (default: a temporary directory)\n"
+   printf "   -c            compare the screenshots with a sequential run\n\n"
+}
+
+while getopts "n:g:l:ch" opt; do
+   case $opt in
+      n) NUM_SHARDS="$OPTARG" ;;
+      g) GLVIS="$OPTARG" ;;
+      l) LOG_DIR="$OPTARG" ;;
+      c) COMPARE=1 ;;
+      *) usage; exit 1 ;;
+   esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 1 ] || ! [ "${NUM_SHARDS}" -ge 1 ] 2> /dev/null; then
+   usage
+   exit 1
+fi
+SCRIPT="$1"
+shift
+if [ ! -r "${SCRIPT}" ]; then
+   printf "Can not read the script: ${SCRIPT}. Stop.\n\n"
+   exit 1
+fi
+if [ -z "${LOG_DIR}" ]; then
+   LOG_DIR=$(mktemp -d "${TMPDIR:-/tmp}/glvis-shard.XXXXXX") || exit 1
+else
+   mkdir -p "${LOG_DIR}" || exit 1
+fi
+
+printf "Rendering ${SCRIPT} with ${NUM_SHARDS} shards, logs in ${LOG_DIR}\n"
+pids=()
+for ((i = 0; i < NUM_SHARDS; i++)); do
+   "${GLVIS}" -run "${SCRIPT}" --shard "$i/${NUM_SHARDS}" "$@" \
+      > "${LOG_DIR}/shard-$i.log" 2>&1 &
+   pids+=($!)
+done
+failed=0
+for ((i = 0; i < NUM_SHARDS; i++)); do
+   if ! wait ${pids[$i]}; then
+      printf "Shard $i/${NUM_SHARDS} failed, see ${LOG_DIR}/shard-$i.log\n"
+      failed=1
+   fi
+done
+
+# Every shard lists all screenshots of the script: "-> <file>" for the ones it
+# took, "skipped <file>" for the others, and "Screenshot(<file>) failed."
+PREFIX="^Script: screenshot: "
+sed -n -e "s/${PREFIX}-> //p" -e "s/${PREFIX}skipped //p" \
+   -e "s/${PREFIX}Screenshot(\(.*\)) failed\.\$/\1/p" \
+   "${LOG_DIR}/shard-0.log" > "${LOG_DIR}/expected"
+sed -n -e "s/${PREFIX}-> //p" "${LOG_DIR}"/shard-*.log > "${LOG_DIR}/taken"
+
+num_expected=$(wc -l < "${LOG_DIR}/expected")
+missing=0
+while read -r shot; do
+   count=$(grep -c -x -F -e "${shot}" "${LOG_DIR}/taken")
+   if [ "${count}" -ne 1 ] || [ ! -f "${shot}" ]; then
+      printf "Screenshot ${shot}: taken ${count} times"
+      [ -f "${shot}" ] || printf ", file not found"
+      printf "\n"
+      missing=$((missing + 1))
+   fi
+done < "${LOG_DIR}/expected"
+
+if [ ${failed} -ne 0 ] || [ ${missing} -ne 0 ]; then
+   printf "\n${missing} of ${num_expected} screenshots are missing. Stop.\n\n"
+   exit 1
+fi
+printf "All ${num_expected} screenshots were rendered.\n"
+[ ${COMPARE} -eq 0 ] && exit 0
+
+# Keep the screenshots of the shards, render them again with one process, and
+# compare the two: the shards must produce the same images.
+mkdir -p "${LOG_DIR}/sharded" || exit 1
+n=0
+while read -r shot; do
+   cp "${shot}" "${LOG_DIR}/sharded/${n}" || exit 1
+   n=$((n + 1))
+done < "${LOG_DIR}/expected"
+
+printf "Rendering ${SCRIPT} sequentially\n"
+if ! "${GLVIS}" -run "${SCRIPT}" --shard 0/1 "$@" \
+   > "${LOG_DIR}/sequential.log" 2>&1; then
+   printf "The sequential run failed, see ${LOG_DIR}/sequential.log\n"
+   exit 1
+fi
+n=0
+different=0
+while read -r shot; do
+   if ! cmp -s "${shot}" "${LOG_DIR}/sharded/${n}"; then
+      printf "Screenshot ${shot} differs from the sequential run\n"
+      different=$((different + 1))
+   fi
+   n=$((n + 1))
+done < "${LOG_DIR}/expected"
+
+if [ ${different} -ne 0 ]; then
+   printf "\n${different} of ${num_expected} screenshots differ. Stop.\n\n"
+   exit 1
+fi
+printf "All ${num_expected} screenshots match the sequential run.\n"
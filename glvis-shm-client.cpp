@@ -0,0 +1,199 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+// Test client for the local transport of the GLVis server, started with
+//
+//    glvis -us <socket>
+//
+// It connects to the Unix domain socket of the server and sends a sequence
+// of solutions on a square mesh of n x n quadrilaterals. Each solution is
+// written to a POSIX shared memory object named "/glvis-...", and only the
+// command "shm <name> <size>" goes through the socket. The object contains
+// the usual "solution" command, with the values of the GridFunction stored
+// as native doubles after "binary_values <size>". The server removes the
+// object once it has mapped it.
+//
+// Usage: glvis-shm-client <socket> [n] [steps] [delay in ms]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// The mesh in the MFEM format, with the vertices in lexicographic order
+string SquareMesh(int n)
+{
+   ostringstream mesh;
+   mesh.precision(17);
+   mesh << "MFEM mesh v1.0\n\ndimension\n2\n\nelements\n" << n*n << '\n';
+   for (int j = 0; j < n; j++)
+   {
+      for (int i = 0; i < n; i++)
+      {
+         const int v = j*(n+1) + i;
+         mesh << "1 3 " << v << ' ' << v+1 << ' ' << v+n+2 << ' ' << v+n+1
+              << '\n';
+      }
+   }
+   mesh << "\nboundary\n0\n\nvertices\n" << (n+1)*(n+1) << "\n2\n";
+   for (int j = 0; j <= n; j++)
+   {
+      for (int i = 0; i <= n; i++)
+      {
+         mesh << double(i)/n << ' ' << double(j)/n << '\n';
+      }
+   }
+   return mesh.str();
+}
+
+// Write the solution of the given step to a new shared memory object and
+// return its size, or 0 on errors
+size_t WriteSolution(const char *name, const string &mesh, int n, int step,
+                     int steps)
+{
+   const int num_values = (n+1)*(n+1);
+   string header = "solution\n" + mesh +
+                   "\nFiniteElementSpace\nFiniteElementCollection: H1_2D_P1"
+                   "\nVDim: 1\nOrdering: 0\n\n";
+   // align the values, so that they are written in place
+   ostringstream values;
+   values << "binary_values " << num_values << '\n';
+   const size_t pad = (sizeof(double) -
+                       (header.size() + values.str().size()) %
+                       sizeof(double)) % sizeof(double);
+   header += string(pad, ' ') + values.str();
+   const size_t size = header.size() + num_values*sizeof(double);
+
+   int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd < 0)
+   {
+      perror("shm_open");
+      return 0;
+   }
+   void *p = MAP_FAILED;
+   if (ftruncate(fd, size) == 0)
+   {
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (p == MAP_FAILED)
+   {
+      perror("mmap");
+      shm_unlink(name);
+      return 0;
+   }
+   char *data = (char *) p;
+   memcpy(data, header.data(), header.size());
+   double *u = (double *) (data + header.size());
+   const double t = 2*M_PI*step/steps;
+   for (int j = 0; j <= n; j++)
+   {
+      for (int i = 0; i <= n; i++)
+      {
+         const double x = double(i)/n, y = double(j)/n;
+         u[j*(n+1) + i] = sin(2*M_PI*x + t)*cos(2*M_PI*y);
+      }
+   }
+   munmap(p, size);
+   return size;
+}
+
+int main(int argc, char *argv[])
+{
+   if (argc < 2)
+   {
+      cout << "Usage: " << argv[0] << " <socket> [n] [steps] [delay in ms]\n"
+           "   <socket>  the Unix domain socket of the server (glvis -us)\n"
+           "   n         number of elements per side (default: 100)\n"
+           "   steps     number of solutions to send (default: 100)\n"
+           "   delay     pause between the solutions (default: 20)" << endl;
+      return 1;
+   }
+   const char *path = argv[1];
+   const int n = (argc > 2) ? atoi(argv[2]) : 100;
+   const int steps = (argc > 3) ? atoi(argv[3]) : 100;
+   const int delay = (argc > 4) ? atoi(argv[4]) : 20;
+   if (n <= 0 || steps <= 0)
+   {
+      cout << "Invalid number of elements or steps." << endl;
+      return 1;
+   }
+
+   sockaddr_un sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(sa.sun_path))
+   {
+      cout << "The socket path is too long: " << path << endl;
+      return 1;
+   }
+   strcpy(sa.sun_path, path);
+   int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock < 0 || connect(sock, (sockaddr *) &sa, sizeof(sa)) < 0)
+   {
+      perror(path);
+      return 2;
+   }
+
+   const string mesh = SquareMesh(n);
+   double total_ms = 0.0;
+   size_t total_size = 0;
+   int sent = 0;
+   for (int step = 0; step < steps; step++)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "/glvis-%d-%d", (int) getpid(), step);
+      auto start = chrono::steady_clock::now();
+      const size_t size = WriteSolution(name, mesh, n, step, steps);
+      if (size == 0)
+      {
+         break;
+      }
+      ostringstream cmd;
+      cmd << "shm " << name << ' ' << size << '\n';
+      const string msg = cmd.str();
+      if (send(sock, msg.data(), msg.size(), MSG_NOSIGNAL) !=
+          (ssize_t) msg.size())
+      {
+         // the server did not get the object: remove it
+         perror("send");
+         shm_unlink(name);
+         break;
+      }
+      total_ms += chrono::duration<double, milli>(
+                     chrono::steady_clock::now() - start).count();
+      total_size += size;
+      sent++;
+      this_thread::sleep_for(chrono::milliseconds(delay));
+   }
+   close(sock);
+
+   cout << "Sent " << sent << " solutions, " << total_size/1048576.0
+        << " MB, in " << total_ms << " ms (without the delays)." << endl;
+   return 0;
+}
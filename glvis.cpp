@@ -17,16 +17,25 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <vector>
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
 #include <ctime>
 #include <csignal>
 
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "mfem.hpp"
+#include "lib/acceptor.hpp"
 #include "lib/palettes.hpp"
+#include "lib/shmstream.hpp"
 #include "lib/visual.hpp"
+#include "lib/workers.hpp"
 
 using namespace std;
 using namespace mfem;
@@ -46,6 +55,7 @@ int         gf_component    = -1;
 bool        fix_elem_orient = false;
 bool        save_coloring   = false;
 bool        keep_attr       = false;
+int         scr_prefetch    = 2;
 int         window_x        = 0; // not a command line option
 int         window_y        = 0; // not a command line option
 int         window_w        = 800;
@@ -63,6 +73,7 @@ GridFunction *grid_f = NULL;
 int is_gf = 0;
 string keys;
 VisualizationSceneScalarData *vs = NULL;
+long long triangle_budget = 0; // 0: AutoRefine() uses the element count
 
 GeometryRefiner GLVisGeometryRefiner;
 
@@ -74,8 +85,16 @@ int scr_running = 0;
 int scr_level = 0;
 Vector *init_nodes = NULL;
 double scr_min_val, scr_max_val;
+// batch mode (--shard i/N): render only the screenshots k with k % N == i
+int scr_shard = 0, scr_shards = 0;
+// in batch mode, which data commands have to be loaded by this shard
+vector<bool> scr_data_needed;
+size_t scr_data_count = 0, scr_shot_count = 0;
 
 Array<istream *> input_streams;
+// whether the clients of input_streams may send their data in shared memory:
+// they are connected to the Unix domain socket and run as the same user
+bool input_shm = false;
 
 extern char **environ;
 
@@ -83,6 +102,9 @@ void paletteSet(int); // defined in palettes.hpp
 
 void PrintSampleUsage(ostream &out);
 
+// parse a triangle count with an optional K, M or G suffix, e.g. "20M"
+long long ParseTriangleCount(const char *str);
+
 // read the mesh and the solution from a file
 void ReadSerial();
 
@@ -97,7 +119,8 @@ void ReadParallel();
 
 int ReadParMeshAndGridFunction(int np, const char *mesh_prefix,
                                const char *sol_prefix, Mesh **mesh_p,
-                               GridFunction **sol_p, int keep_attr);
+                               GridFunction **sol_p, int keep_attr,
+                               bool verbose = true);
 
 int ReadInputStreams();
 
@@ -108,12 +131,34 @@ GridFunction *ProjectVectorFEGridFunction(GridFunction*);
 void Extrude1DMeshAndSolution(Mesh **mesh_p, GridFunction **grid_f_p,
                               Vector *sol);
 
-// Read the content of an input stream (e.g. from socket/file)
-int ReadStream(istream &is, const string &data_type)
+// delete a mesh, unless it is still used by the data of a script
+void ReleaseMesh(Mesh *m);
+
+// Read the content of an input stream (e.g. from socket/file). The data may
+// be sent in shared memory only if 'allow_shm' is set, see ReadCommand().
+int ReadStream(istream &is, const string &data_type, bool allow_shm)
 {
    // 0 - scalar data, 1 - vector data, 2 - mesh only, (-1) - unknown
    int field_type = 0;
 
+   if (data_type == "shm")
+   {
+      if (!allow_shm)
+      {
+         cout << "Stream: shared memory is only accepted from local clients,"
+              " and not within shared memory." << endl;
+         return -1;
+      }
+      // the data is in a shared memory object, see OpenSharedPayload()
+      shmstream shm;
+      string shm_type;
+      if (!OpenSharedPayload(is, shm) || !(shm >> shm_type))
+      {
+         return -1;
+      }
+      return ReadStream(shm, shm_type, false);
+   }
+
    delete mesh; mesh = NULL;
    delete grid_f; grid_f = NULL;
    keys.clear();
@@ -191,7 +236,7 @@ int ReadStream(istream &is, const string &data_type)
    else if (data_type == "solution")
    {
       mesh = new Mesh(is, 1, 0, fix_elem_orient);
-      grid_f = new GridFunction(mesh, is);
+      grid_f = LoadGridFunction(mesh, is);
       field_type = (grid_f->VectorDim() == 1) ? 0 : 1;
    }
    else if (data_type == "mesh")
@@ -367,7 +412,7 @@ void StartVisualization(int field_type)
       GetAppWindow()->setOnKeyDown(SDLK_SPACE, ThreadsPauseFunc);
       glvis_command = new GLVisCommand(&vs, &mesh, &grid_f, &sol, &keep_attr,
                                        &fix_elem_orient);
-      comm_thread = new communication_thread(input_streams);
+      comm_thread = new communication_thread(input_streams, input_shm);
    }
 
    double mesh_range = -1.0;
@@ -469,6 +514,7 @@ void StartVisualization(int field_type)
    if (vs)
    {
       // increase the refinement factors if visualizing a GridFunction
+      vs->SetAutoRefineTriangleBudget(triangle_budget);
       if (grid_f)
       {
          vs->AutoRefine();
@@ -499,65 +545,704 @@ void StartVisualization(int field_type)
       glvis_command = NULL;
    }
    delete grid_f; grid_f = NULL;
-   delete mesh; mesh = NULL;
+   ReleaseMesh(mesh); mesh = NULL;
    cout << "GLVis window closed." << endl;
 }
 
-int ScriptReadSolution(istream &scr, Mesh **mp, GridFunction **sp)
+// Arguments of a data loading script command: 'solution', 'psolution' or
+// 'mesh'
+struct ScriptData
 {
-   string mword,sword;
+   string cmd;
+   int np, keep_attr;
+   string mesh, sol;
 
-   cout << "Script: solution: " << flush;
-   // read the mesh
-   scr >> ws >> mword; // mesh filename (can't contain spaces)
-   cout << "mesh: " << mword << "; " << flush;
-   named_ifgzstream imesh(mword.c_str());
+   ScriptData(const string &c = "") : cmd(c), np(0), keep_attr(0) { }
+
+   bool operator==(const ScriptData &d) const
+   {
+      return (cmd == d.cmd && np == d.np && keep_attr == d.keep_attr &&
+              mesh == d.mesh && sol == d.sol);
+   }
+};
+
+// Number of references to the meshes shared by script data: consecutive
+// 'solution' commands with the same mesh file share one Mesh, which is used by
+// the displayed data, the prefetched data and the script mesh cache.
+map<Mesh *, int> script_mesh_refs;
+pthread_mutex_t script_mesh_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The mesh of the last 'solution' command, identified by the path, size and
+// modification time of the mesh file
+struct ScriptMeshCache
+{
+   string path;
+   off_t size;
+   time_t mtime;
+   Mesh *mesh;
+   int lookups, hits;
+} script_mesh_cache = { "", 0, 0, NULL, 0, 0 };
+
+// Delete a mesh, unless it is still referenced by other script data
+void ReleaseMesh(Mesh *m)
+{
+   pthread_mutex_lock(&script_mesh_mutex);
+   map<Mesh *, int>::iterator it = script_mesh_refs.find(m);
+   bool last = true;
+   if (it != script_mesh_refs.end())
+   {
+      last = (--it->second == 0);
+      if (last)
+      {
+         script_mesh_refs.erase(it);
+      }
+   }
+   pthread_mutex_unlock(&script_mesh_mutex);
+   if (last)
+   {
+      delete m;
+   }
+}
+
+static void ScriptMeshRef(Mesh *m)
+{
+   pthread_mutex_lock(&script_mesh_mutex);
+   script_mesh_refs[m]++;
+   pthread_mutex_unlock(&script_mesh_mutex);
+}
+
+// Return a new reference to the cached mesh if it was loaded from the same
+// file, or NULL
+static Mesh *ScriptMeshCacheFind(const string &path, const struct stat &st)
+{
+   Mesh *m = NULL;
+   pthread_mutex_lock(&script_mesh_mutex);
+   ScriptMeshCache &c = script_mesh_cache;
+   c.lookups++;
+   if (c.mesh && c.path == path && c.size == st.st_size &&
+       c.mtime == st.st_mtime)
+   {
+      c.hits++;
+      m = c.mesh;
+      script_mesh_refs[m]++;
+   }
+   pthread_mutex_unlock(&script_mesh_mutex);
+   return m;
+}
+
+// Replace the cached mesh with 'm' (NULL to clear the cache)
+static void ScriptMeshCacheStore(const string &path, const struct stat *st,
+                                 Mesh *m)
+{
+   ScriptMeshCache &c = script_mesh_cache;
+   pthread_mutex_lock(&script_mesh_mutex);
+   Mesh *old = c.mesh;
+   c.path = path;
+   c.size = st ? st->st_size : 0;
+   c.mtime = st ? st->st_mtime : 0;
+   c.mesh = m;
+   if (m)
+   {
+      script_mesh_refs[m]++;
+   }
+   pthread_mutex_unlock(&script_mesh_mutex);
+   if (old)
+   {
+      ReleaseMesh(old);
+   }
+}
+
+// Print the hit rate of the script mesh cache
+static void ScriptMeshCacheStats()
+{
+   pthread_mutex_lock(&script_mesh_mutex);
+   const ScriptMeshCache &c = script_mesh_cache;
+   if (c.lookups > 0)
+   {
+      cout << "Script: mesh cache hits: " << c.hits << " / " << c.lookups
+           << " (" << (100*c.hits)/c.lookups << "%)" << endl;
+   }
+   pthread_mutex_unlock(&script_mesh_mutex);
+}
+
+// The header and the values of a GridFunction file, read without building
+// its FE space on the mesh
+struct ScriptValues
+{
+   string fec_name;
+   int vdim, ordering;
+   vector<double> values;
+
+   ScriptValues() : vdim(0), ordering(0) { }
+};
+
+// Read a GridFunction in the format of GridFunction::Save into 'v'. Returns
+// false if the format is not the simple one with a single FE collection.
+static bool ReadScriptValues(istream &is, ScriptValues &v)
+{
+   string ident;
+   is >> ws;
+   getline(is, ident);
+   if (ident != "FiniteElementSpace")
+   {
+      return false;
+   }
+   is >> ident >> v.fec_name;
+   if (!is || ident != "FiniteElementCollection:")
+   {
+      return false;
+   }
+   is >> ident >> v.vdim;
+   if (!is || ident != "VDim:")
+   {
+      return false;
+   }
+   is >> ident >> v.ordering;
+   if (!is || ident != "Ordering:")
+   {
+      return false;
+   }
+   v.values.clear();
+   double x;
+   while (is >> x)
+   {
+      v.values.push_back(x);
+   }
+   return is.eof();
+}
+
+// Build the GridFunction of the values 'v' on the mesh 'm', or return NULL if
+// they do not match its FE space
+static GridFunction *MakeScriptGridFunction(Mesh *m, const ScriptValues &v)
+{
+   FiniteElementCollection *fec =
+      FiniteElementCollection::New(v.fec_name.c_str());
+   FiniteElementSpace *fes =
+      new FiniteElementSpace(m, fec, v.vdim, v.ordering);
+   GridFunction *g = new GridFunction(fes);
+   g->MakeOwner(fec);
+   if ((size_t) g->Size() != v.values.size())
+   {
+      delete g;
+      return NULL;
+   }
+   if (g->Size() > 0)
+   {
+      memcpy(g->GetData(), &v.values[0], g->Size()*sizeof(double));
+   }
+   return g;
+}
+
+// Load the mesh and the solution of a data command. For 'mesh' commands only
+// the mesh is loaded. Unless 'verbose', no error messages are printed.
+// 'solution' commands with separate mesh and solution files reuse the mesh of
+// the previous such command if the mesh file did not change. Such a mesh may
+// be shown by the visualization thread: if 'vals' is given, only the values
+// of the solution are read into it, *sp is set to NULL, and the GridFunction
+// is built later with MakeScriptGridFunction() by the visualization thread.
+// The returned mesh has to be freed with ReleaseMesh().
+int LoadScriptData(const ScriptData &d, Mesh **mp, GridFunction **sp,
+                   bool verbose, ScriptValues *vals = NULL)
+{
+   *mp = NULL;
+   *sp = NULL;
+   if (d.cmd == "psolution")
+   {
+      int err = ReadParMeshAndGridFunction(d.np, d.mesh.c_str(),
+                                           d.sol.c_str(), mp, sp,
+                                           d.keep_attr, verbose);
+      if (!err)
+      {
+         Extrude1DMeshAndSolution(mp, sp, NULL);
+         ScriptMeshRef(*mp);
+      }
+      return err;
+   }
+
+   struct stat st;
+   const bool cache_mesh = (d.cmd == "solution" && d.sol != d.mesh &&
+                            stat(d.mesh.c_str(), &st) == 0);
+   if (cache_mesh)
+   {
+      Mesh *m = ScriptMeshCacheFind(d.mesh, st);
+      if (m)
+      {
+         ifgzstream isol(d.sol.c_str());
+         if (!isol)
+         {
+            if (verbose)
+            {
+               cout << "Can not open solution file: " << d.sol << endl;
+            }
+            ReleaseMesh(m);
+            return 2;
+         }
+         if (vals)
+         {
+            if (!ReadScriptValues(isol, *vals))
+            {
+               ReleaseMesh(m);
+               return 3;
+            }
+            *mp = m;
+            return 0;
+         }
+         *mp = m;
+         *sp = new GridFunction(m, isol);
+         return 0;
+      }
+   }
+
+   named_ifgzstream imesh(d.mesh.c_str());
    if (!imesh)
    {
-      cout << "Can not open mesh file: " << mword << endl;
+      if (verbose)
+      {
+         cout << "Can not open mesh file: " << d.mesh << endl;
+      }
       return 1;
    }
    *mp = new Mesh(imesh, 1, 0, fix_elem_orient);
+   if (d.cmd == "solution")
+   {
+      if (d.sol == d.mesh) // mesh and solution in the same file
+      {
+         *sp = new GridFunction(*mp, imesh);
+      }
+      else
+      {
+         ifgzstream isol(d.sol.c_str());
+         if (!isol)
+         {
+            if (verbose)
+            {
+               cout << "Can not open solution file: " << d.sol << endl;
+            }
+            delete *mp; *mp = NULL;
+            return 2;
+         }
+         *sp = new GridFunction(*mp, isol);
+      }
+   }
+   // extruded 1D meshes are modified together with the solution, and
+   // nonconforming and NURBS meshes have state updated by the FE spaces
+   const bool extruded = ((*mp)->Dimension() == 1 &&
+                          (*mp)->SpaceDimension() == 1);
+   Extrude1DMeshAndSolution(mp, sp, NULL);
+   ScriptMeshRef(*mp);
+   if (cache_mesh && !extruded && !(*mp)->ncmesh && !(*mp)->NURBSext)
+   {
+      ScriptMeshCacheStore(d.mesh, &st, *mp);
+   }
+   return 0;
+}
+
+// Whether the data command number 'n' of the script (after the initial
+// commands) has to be loaded
+static bool ScriptDataNeeded(size_t n)
+{
+   return (n >= scr_data_needed.size() || scr_data_needed[n]);
+}
+
+// Whether the screenshot number 'n' of the script is taken by this shard
+static bool ScriptShotNeeded(size_t n)
+{
+   return (scr_shards == 0 || (int)(n % scr_shards) == scr_shard);
+}
+
+// Loads the data of the next data commands of a script in a worker thread,
+// while the visualization thread executes the commands before them.
+class ScriptPrefetch
+{
+private:
+   struct Entry
+   {
+      ScriptData data;
+      Mesh *m;
+      GridFunction *g; // NULL for the solutions on a cached mesh, see 'vals'
+      ScriptValues vals;
+      bool ready;
+      int err;
+   };
+
+   istringstream scr; // the rest of the script, read by the worker thread
+   size_t data_count; // number of data commands read from 'scr'
+   size_t depth;
+   std::deque<Entry> queue;
+   bool stop, done;
+
+   pthread_t tid;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+
+   bool ScanNext(ScriptData &d);
+   static void *Execute(void *p);
+
+public:
+   /// Start loading the data of up to 'depth' commands of 'rest' ahead.
+   ScriptPrefetch(const string &rest, int depth);
+
+   /** If 'd' is the next data command found in the script, wait until its
+       data is loaded and return it in 'mp' and 'sp'. Return false if the
+       data could not be loaded, or if the commands do not match, in which
+       case the prefetching stops. */
+   bool Take(const ScriptData &d, Mesh **mp, GridFunction **sp);
+
+   /// Stop the worker thread and delete the data that was not taken.
+   ~ScriptPrefetch();
+};
+
+ScriptPrefetch *script_prefetch = NULL;
+
+// Number of arguments of the script commands that are not data commands
+static int ScriptArgCount(const string &word)
+{
+   static const struct { const char *cmd; int nargs; } cmds[] =
+   {
+      { "window", 4 }, { "screenshot", 1 }, { "viewcenter", 2 },
+      { "perspective", 1 }, { "light", 1 }, { "view", 2 }, { "zoom", 1 },
+      { "shading", 1 }, { "subdivisions", 2 }, { "valuerange", 2 },
+      { "autoscale", 1 }, { "keys", 1 }, { "palette", 1 }, { "rotmat", 16 },
+      { "camera", 9 }, { "scale", 1 }, { "translate", 3 }
+   };
+   for (size_t i = 0; i < sizeof(cmds)/sizeof(cmds[0]); i++)
+   {
+      if (word == cmds[i].cmd)
+      {
+         return cmds[i].nargs;
+      }
+   }
+   return 0;
+}
 
-   // read the solution (GridFunction)
-   scr >> ws >> sword;
-   if (sword == mword) // mesh and solution in the same file
+// Read the next command of a script, following the parsing of
+// ExecuteScriptCommand(), and skip its arguments. The arguments of data
+// commands are returned in 'd', the last argument of the other commands in
+// 'arg'.
+static bool ScriptScan(istream &scr, string &word, ScriptData &d,
+                       string &arg)
+{
+   while (1)
    {
-      cout << "solution: " << mword << endl;
-      *sp = new GridFunction(*mp, imesh);
+      scr >> ws;
+      if (!scr.good())
+      {
+         return false;
+      }
+      if (scr.peek() == '#')
+      {
+         getline(scr, word);
+         continue;
+      }
+      scr >> word;
+      if (word == "solution")
+      {
+         d = ScriptData(word);
+         scr >> ws >> d.mesh >> ws >> d.sol;
+      }
+      else if (word == "psolution")
+      {
+         d = ScriptData(word);
+         scr >> d.np >> ws >> d.mesh >> ws >> d.keep_attr >> ws >> d.sol;
+      }
+      else if (word == "mesh")
+      {
+         d = ScriptData(word);
+         scr >> ws >> d.mesh;
+      }
+      else if (word == "toggle_attributes")
+      {
+         string args;
+         getline(scr, args, ';');
+      }
+      else if (word == "plot_caption")
+      {
+         char delim;
+         string caption;
+         scr >> ws >> delim;
+         getline(scr, caption, delim);
+      }
+      else
+      {
+         arg.clear();
+         for (int i = ScriptArgCount(word); i > 0; i--)
+         {
+            scr >> arg;
+         }
+      }
+      return true;
    }
-   else
+}
+
+static bool IsScriptDataCommand(const string &word)
+{
+   return (word == "solution" || word == "psolution" || word == "mesh");
+}
+
+// Commands that only change the view, whose result does not depend on the data
+// shown when they are executed
+static bool IsScriptViewCommand(const string &word)
+{
+   static const char *cmds[] =
+   {
+      "window", "viewcenter", "perspective", "light", "view", "zoom",
+      "palette", "rotmat", "camera", "scale", "translate", "plot_caption",
+      "{", "}"
+   };
+   for (size_t i = 0; i < sizeof(cmds)/sizeof(cmds[0]); i++)
    {
-      cout << "solution: " << sword << endl;
-      ifgzstream isol(sword.c_str());
-      if (!isol)
+      if (word == cmds[i])
       {
-         cout << "Can not open solution file: " << sword << endl;
-         delete *mp; *mp = NULL;
-         return 2;
+         return true;
       }
-      *sp = new GridFunction(*mp, isol);
    }
+   return false;
+}
 
-   Extrude1DMeshAndSolution(mp, sp, NULL);
+// In batch mode, find the data commands in 'rest' that this shard has to
+// load: the last one before each of its screenshots, and before each command
+// that may depend on the data, e.g. 'keys', 'valuerange' or 'autoscale'. The
+// other data commands are replaced by later ones before their data is used,
+// except for the ones that leave state for the later commands: the first
+// 'mesh' command sets the initial nodes of the displacements, and once the
+// subdivision factors are set by 'subdivisions' or by the keys 'o'/'O', each
+// data command may reset them, depending on the number of elements of the
+// mesh shown before it. A single shard (--shard 0/1) loads all data commands,
+// like an interactive run of the script.
+static void ScriptPlanShard(const string &rest)
+{
+   istringstream scr(rest);
+   string word, arg;
+   ScriptData d;
+   size_t num_shots = 0, num_loads = 0;
+   bool pending = false, first_mesh = true, fixed_refine = false;
+   const bool load_all = (scr_shards == 1);
+
+   scr_data_needed.clear();
+   while (ScriptScan(scr, word, d, arg))
+   {
+      if (IsScriptDataCommand(word))
+      {
+         const bool needed = (load_all || fixed_refine ||
+                              (first_mesh && word == "mesh"));
+         first_mesh = first_mesh && word != "mesh";
+         scr_data_needed.push_back(needed);
+         pending = !needed;
+         num_loads += needed;
+         continue;
+      }
+      const bool uses_data = (word == "screenshot") ?
+                             ScriptShotNeeded(num_shots++) :
+                             !IsScriptViewCommand(word);
+      if (pending && uses_data)
+      {
+         scr_data_needed.back() = true;
+         pending = false;
+         num_loads++;
+      }
+      if (word == "subdivisions" ||
+          (word == "keys" && arg.find_first_of("oO") != string::npos))
+      {
+         fixed_refine = true;
+      }
+   }
+   scr_data_count = scr_shot_count = 0;
 
-   return 0;
+   cout << "Script: shard " << scr_shard << '/' << scr_shards << ": "
+        << (num_shots + scr_shards - 1 - scr_shard) / scr_shards << " of "
+        << num_shots << " screenshots, " << num_loads << " of "
+        << scr_data_needed.size() << " data commands." << endl;
+}
+
+// Skip to the next data command that is needed by this shard
+bool ScriptPrefetch::ScanNext(ScriptData &d)
+{
+   string word, arg;
+   while (ScriptScan(scr, word, d, arg))
+   {
+      if (IsScriptDataCommand(word) && ScriptDataNeeded(data_count++))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+void *ScriptPrefetch::Execute(void *p)
+{
+   ScriptPrefetch *_this = (ScriptPrefetch *) p;
+
+   while (1)
+   {
+      pthread_mutex_lock(&_this->mutex);
+      while (!_this->stop && _this->queue.size() >= _this->depth)
+      {
+         pthread_cond_wait(&_this->cond, &_this->mutex);
+      }
+      if (_this->stop)
+      {
+         pthread_mutex_unlock(&_this->mutex);
+         break;
+      }
+      pthread_mutex_unlock(&_this->mutex);
+
+      Entry e;
+      if (!_this->ScanNext(e.data))
+      {
+         break;
+      }
+      e.m = NULL;
+      e.g = NULL;
+      e.ready = false;
+      e.err = 0;
+      // queue the command before loading, so that Take() can match it
+      pthread_mutex_lock(&_this->mutex);
+      _this->queue.push_back(e);
+      pthread_mutex_unlock(&_this->mutex);
+
+      Mesh *m;
+      GridFunction *g;
+      int err = LoadScriptData(e.data, &m, &g, false, &e.vals);
+
+      // the entry is still the last one: Take() does not remove it before
+      // it is ready
+      pthread_mutex_lock(&_this->mutex);
+      Entry &last = _this->queue.back();
+      last.m = m;
+      last.g = g;
+      swap(last.vals, e.vals);
+      last.err = err;
+      last.ready = true;
+      pthread_cond_broadcast(&_this->cond);
+      pthread_mutex_unlock(&_this->mutex);
+   }
+
+   pthread_mutex_lock(&_this->mutex);
+   _this->done = true;
+   pthread_cond_broadcast(&_this->cond);
+   pthread_mutex_unlock(&_this->mutex);
+   return p;
+}
+
+ScriptPrefetch::ScriptPrefetch(const string &rest, int depth_)
+   : scr(rest), data_count(0), depth(depth_), stop(false), done(false)
+{
+   pthread_mutex_init(&mutex, NULL);
+   pthread_cond_init(&cond, NULL);
+   pthread_create(&tid, NULL, ScriptPrefetch::Execute, this);
+}
+
+bool ScriptPrefetch::Take(const ScriptData &d, Mesh **mp, GridFunction **sp)
+{
+   pthread_mutex_lock(&mutex);
+   while (!stop && !done && queue.empty())
+   {
+      pthread_cond_wait(&cond, &mutex);
+   }
+   if (stop || queue.empty())
+   {
+      pthread_mutex_unlock(&mutex);
+      return false;
+   }
+   if (!(queue.front().data == d))
+   {
+      cout << "Script: prefetching stopped, the data commands do not match."
+           << endl;
+      stop = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&mutex);
+      return false;
+   }
+   while (!queue.front().ready)
+   {
+      pthread_cond_wait(&cond, &mutex);
+   }
+   Entry e;
+   swap(e, queue.front());
+   queue.pop_front();
+   pthread_cond_broadcast(&cond);
+   pthread_mutex_unlock(&mutex);
+
+   if (e.err)
+   {
+      // load again in this thread to report the error
+      return false;
+   }
+   if (e.data.cmd == "solution" && !e.g)
+   {
+      // the mesh came from the cache and may be shown: its FE space is built
+      // here, in the visualization thread
+      e.g = MakeScriptGridFunction(e.m, e.vals);
+      if (!e.g)
+      {
+         ReleaseMesh(e.m);
+         return false;
+      }
+   }
+   *mp = e.m;
+   *sp = e.g;
+   return true;
+}
+
+ScriptPrefetch::~ScriptPrefetch()
+{
+   pthread_mutex_lock(&mutex);
+   stop = true;
+   pthread_cond_broadcast(&cond);
+   pthread_mutex_unlock(&mutex);
+   pthread_join(tid, NULL);
+
+   for (size_t i = 0; i < queue.size(); i++)
+   {
+      delete queue[i].g;
+      ReleaseMesh(queue[i].m);
+   }
+   pthread_cond_destroy(&cond);
+   pthread_mutex_destroy(&mutex);
+}
+
+// Load the data of a data command, using the prefetched data if available
+int ScriptLoadData(const ScriptData &d, Mesh **mp, GridFunction **sp)
+{
+   if (!ScriptDataNeeded(scr_data_count++))
+   {
+      cout << "Script: not needed by shard " << scr_shard << '/'
+           << scr_shards << ", skipped." << endl;
+      return -1;
+   }
+   if (script_prefetch && script_prefetch->Take(d, mp, sp))
+   {
+      return 0;
+   }
+   return LoadScriptData(d, mp, sp, true);
+}
+
+int ScriptReadSolution(istream &scr, Mesh **mp, GridFunction **sp)
+{
+   ScriptData d("solution");
+
+   cout << "Script: solution: " << flush;
+   scr >> ws >> d.mesh; // mesh filename (can't contain spaces)
+   cout << "mesh: " << d.mesh << "; " << flush;
+   scr >> ws >> d.sol;
+   cout << "solution: " << d.sol << endl;
+
+   return ScriptLoadData(d, mp, sp);
 }
 
 int ScriptReadParSolution(istream &scr, Mesh **mp, GridFunction **sp)
 {
-   int np, keep_attr, err;
-   string mesh_prefix, sol_prefix;
+   ScriptData d("psolution");
 
    cout << "Script: psolution: " << flush;
    // read number of processors
-   scr >> np;
-   cout << "# processors: " << np << "; " << flush;
+   scr >> d.np;
+   cout << "# processors: " << d.np << "; " << flush;
    // read the mesh prefix
-   scr >> ws >> mesh_prefix; // mesh prefix (can't contain spaces)
-   cout << "mesh prefix: " << mesh_prefix << "; " << flush;
-   scr >> ws >> keep_attr;
-   if (keep_attr)
+   scr >> ws >> d.mesh; // mesh prefix (can't contain spaces)
+   cout << "mesh prefix: " << d.mesh << "; " << flush;
+   scr >> ws >> d.keep_attr;
+   if (d.keep_attr)
    {
       cout << "(real attributes); " << flush;
    }
@@ -566,41 +1251,30 @@ int ScriptReadParSolution(istream &scr, Mesh **mp, GridFunction **sp)
       cout << "(processor attributes); " << flush;
    }
    // read the solution prefix
-   scr >> ws >> sol_prefix;
-   cout << "solution prefix: " << sol_prefix << endl;
+   scr >> ws >> d.sol;
+   cout << "solution prefix: " << d.sol << endl;
 
-   err = ReadParMeshAndGridFunction(np, mesh_prefix.c_str(),
-                                    sol_prefix.c_str(), mp, sp, keep_attr);
-   if (!err)
-   {
-      Extrude1DMeshAndSolution(mp, sp, NULL);
-   }
-   return err;
+   return ScriptLoadData(d, mp, sp);
 }
 
 int ScriptReadDisplMesh(istream &scr, Mesh **mp, GridFunction **sp)
 {
    Mesh *m;
-   string word;
+   GridFunction *no_g;
+   ScriptData d("mesh");
 
    cout << "Script: mesh: " << flush;
-   scr >> ws >> word;
+   scr >> ws >> d.mesh;
+   cout << d.mesh << endl;
+   if (ScriptLoadData(d, &m, &no_g))
    {
-      named_ifgzstream imesh(word.c_str());
-      if (!imesh)
-      {
-         cout << "Can not open mesh file: " << word << endl;
-         return 1;
-      }
-      cout << word << endl;
-      m = new Mesh(imesh, 1, 0, fix_elem_orient);
+      return 1;
    }
-   Extrude1DMeshAndSolution(&m, NULL, NULL);
    if (init_nodes == NULL)
    {
       init_nodes = new Vector;
       m->GetNodes(*init_nodes);
-      delete m;
+      ReleaseMesh(m);
       *mp = NULL;
       *sp = NULL;
    }
@@ -638,12 +1312,14 @@ int ScriptReadDisplMesh(istream &scr, Mesh **mp, GridFunction **sp)
    return 0;
 }
 
-void ExecuteScriptCommand()
+// Execute the next command of the script, or the next block of commands.
+// Return false at the end of the script.
+bool ExecuteScriptCommand()
 {
    if (!script)
    {
       cout << "No script stream defined! (Bug?)" << endl;
-      return;
+      return false;
    }
 
    istream &scr = *script;
@@ -655,8 +1331,9 @@ void ExecuteScriptCommand()
       if (!scr.good())
       {
          cout << "End of script." << endl;
+         ScriptMeshCacheStats();
          scr_level = 0;
-         return;
+         return false;
       }
       if (scr.peek() == '#')
       {
@@ -748,8 +1425,9 @@ void ExecuteScriptCommand()
                   vss->NewMeshAndSolution(new_m, new_g);
                }
             }
+            // new_m is the shown mesh if it was reused from the cache
             delete grid_f; grid_f = new_g;
-            delete mesh; mesh = new_m;
+            ReleaseMesh(mesh); mesh = new_m;
 
             vs->Draw();
          }
@@ -757,7 +1435,7 @@ void ExecuteScriptCommand()
          {
             cout << "Different type of mesh / solution." << endl;
             delete new_g;
-            delete new_m;
+            ReleaseMesh(new_m);
          }
       }
       else if (word == "screenshot")
@@ -766,6 +1444,12 @@ void ExecuteScriptCommand()
 
          cout << "Script: screenshot: " << flush;
 
+         if (!ScriptShotNeeded(scr_shot_count++))
+         {
+            cout << "skipped " << word << endl;
+            done_one_command = 1;
+            continue;
+         }
          if (Screenshot(word.c_str(), true))
          {
             cout << "Screenshot(" << word << ") failed." << endl;
@@ -1025,13 +1709,23 @@ void ExecuteScriptCommand()
 
       done_one_command = 1;
    }
+   return true;
 }
 
 void ScriptControl();
 
 void ScriptIdleFunc()
 {
-   ExecuteScriptCommand();
+   const bool more = ExecuteScriptCommand();
+   if (scr_shards > 0)
+   {
+      // batch mode: run the whole script, then close the window
+      if (!more)
+      {
+         KeyQPressed();
+      }
+      return;
+   }
    if (scr_level == 0)
    {
       ScriptControl();
@@ -1120,8 +1814,31 @@ void PlayScript(istream &scr)
    script = &scr;
    keys.clear();
 
+   if (scr_prefetch > 0 || scr_shards > 0)
+   {
+      // copy the rest of the script for the worker thread and the shard plan
+      streampos pos = scr.tellg();
+      ostringstream rest;
+      rest << scr.rdbuf();
+      scr.clear();
+      scr.seekg(pos);
+      if (scr_shards > 0)
+      {
+         ScriptPlanShard(rest.str());
+         // run the script as soon as the window is shown
+         scr_running = 1;
+         SetStartupIdleFunc(ScriptIdleFunc);
+      }
+      if (scr_prefetch > 0)
+      {
+         script_prefetch = new ScriptPrefetch(rest.str(), scr_prefetch);
+      }
+   }
+
    StartVisualization((grid_f->VectorDim() == 1) ? 0 : 1);
 
+   delete script_prefetch; script_prefetch = NULL;
+   ScriptMeshCacheStore("", NULL, NULL);
    delete init_nodes; init_nodes = NULL;
 
    cout << "Script: min_val = " << scr_min_val
@@ -1131,20 +1848,178 @@ void PlayScript(istream &scr)
 }
 
 
+// Read the header of a connection to the server: the data type and, for
+// parallel data, the number of processors and the rank. The white space after
+// it is not skipped: that would wait for the data, which the client may send
+// later, and block the server. The session skips it before reading the data.
+bool ReadHeader(istream &is, string &data_type, int &nproc, int &proc)
+{
+   is >> data_type;
+   if (data_type == "parallel")
+   {
+      is >> nproc >> proc;
+   }
+   return !is.fail();
+}
+
+
+/* Event-driven server: wait for the next session, i.e. a serial connection,
+   returned in 'isock', or all connections of a parallel run, moved to
+   input_streams. The connections of a parallel run are collected in
+   'par_group' while other sessions start, and 'par_local' tells if all of
+   them are local, see ConnectionAcceptor::Next(). When 'isock' is used up, it
+   is set to NULL. Returns false if no session is ready; otherwise sets
+   input_shm for the session. With 'peek', the headers are left in the
+   sockets, see ReadHeader(). */
+bool NextEventSession(ConnectionAcceptor &acceptor, socketstream *&isock,
+                      string &data_type, Array<socketstream *> &par_group,
+                      bool &par_local, bool peek)
+{
+   bool local = false;
+   const int fd = acceptor.Next(&local);
+   if (fd < 0)
+   {
+      return false;
+   }
+   isock->rdbuf()->attach(fd);
+   isock->clear();
+   int nproc = 0, proc = -1;
+   if (peek ? !ConnectionAcceptor::PeekHeader(fd, data_type, nproc, proc) :
+       !ReadHeader(*isock, data_type, nproc, proc))
+   {
+      cout << "Can not read the header of a new connection." << endl;
+      delete isock; isock = NULL;
+      return false;
+   }
+   if (data_type != "parallel")
+   {
+      input_shm = local;
+      return true;
+   }
+#ifdef GLVIS_DEBUG
+   cout << "new connection: parallel " << nproc << ' ' << proc << endl;
+#endif
+
+   bool ok = false;
+   if (nproc <= 0)
+   {
+      cout << "Invalid number of processors: " << nproc << endl;
+   }
+   else if (par_group.Size() && nproc != par_group.Size())
+   {
+      cout << "Unexpected number of processors: " << nproc
+           << ", expected: " << par_group.Size() << endl;
+   }
+   else if (0 > proc || proc >= nproc)
+   {
+      cout << "Invalid processor rank: " << proc
+           << ", number of processors: " << nproc << endl;
+   }
+   else if (par_group.Size() && par_group[proc])
+   {
+      cout << "Second connection attempt from processor rank: " << proc
+           << endl;
+   }
+   else
+   {
+      ok = true;
+   }
+   if (!ok)
+   {
+      cout << "Closing the connection." << endl;
+      delete isock; isock = NULL;
+      return false;
+   }
+
+   if (par_group.Size() == 0)
+   {
+      par_group.SetSize(nproc);
+      par_group = NULL;
+      par_local = true;
+   }
+   par_group[proc] = isock;
+   par_local = par_local && local;
+   isock = NULL;
+   for (int i = 0; i < nproc; i++)
+   {
+      if (!par_group[i])
+      {
+         return false;
+      }
+   }
+   input_streams.SetSize(nproc);
+   for (int i = 0; i < nproc; i++)
+   {
+      input_streams[i] = par_group[i];
+   }
+   par_group.SetSize(0);
+   input_shm = par_local;
+   return true;
+}
+
+
+/* Serve a session in a warm worker of the server: 'fds' are the sockets of a
+   serial connection or of the ranks of a parallel run, with their headers not
+   read yet, 'start' is the time when the session was accepted, and
+   'allow_shm' is the input_shm of the session. */
+void ServeWarmSession(vector<int> &fds, double start, bool allow_shm)
+{
+   input_shm = allow_shm;
+   string data_type;
+   for (size_t i = 0; i < fds.size(); i++)
+   {
+      socketstream *sock = new socketstream(fds[i], false);
+      int nproc = 0, proc = 0;
+      if (!ReadHeader(*sock, data_type, nproc, proc))
+      {
+         cout << "Can not read the header of a session." << endl;
+         exit(1);
+      }
+      if (data_type == "parallel")
+      {
+         if (i == 0)
+         {
+            input_streams.SetSize(nproc);
+            input_streams = NULL;
+         }
+         input_streams[proc] = sock;
+      }
+      else
+      {
+         input_streams.Append(sock);
+      }
+   }
+   const int ft = (data_type == "parallel") ? ReadInputStreams() :
+                  ReadStream(*input_streams[0] >> ws, data_type, input_shm);
+   SetFirstFrameTimer(start, "warm worker");
+   StartVisualization(ft);
+   CloseInputStreams(false);
+   exit(0);
+}
+
+
 int main (int argc, char *argv[])
 {
    // variables for command line arguments
    bool        multi_session = true;   // not added as option
    bool        mac           = false;
+   int         warm_workers  = 0;
    const char *stream_file   = string_none;
    const char *script_file   = string_none;
    const char *font_name     = string_default;
    int         portnum       = 19916;
+   const char *unix_socket   = string_none;
    bool        secure        = socketstream::secure_default;
    int         multisample   = GetMultisample();
    double      line_width    = Get_LineWidth();
    double      ms_line_width = Get_MS_LineWidth();
    int         geom_ref_type = Quadrature1D::ClosedUniform;
+   const char *cache_dir     = string_none;
+   const char *tri_budget    = string_none;
+   const char *palette_file  = string_none;
+   const char *shard         = string_none;
+   double      history_mb    = 0.0;
+   int         history_bits  = 32;
 
    OptionsParser args(argc, argv);
 
@@ -1165,6 +2040,14 @@ int main (int argc, char *argv[])
                   "Number of digits used for processor ranks in file names.");
    args.AddOption(&script_file, "-run", "--run-script",
                   "Run a GLVis script file.");
+   args.AddOption(&scr_prefetch, "-sp", "--script-prefetch",
+                  "Number of data loading commands ('solution', 'psolution',"
+                  " 'mesh') of the script to load ahead in a worker thread;"
+                  " 0 loads them when they are executed.");
+   args.AddOption(&shard, "-shard", "--shard",
+                  "Run the script given with -run in batch mode as shard i/N:"
+                  " take only the screenshots k with k % N == i, load only"
+                  " the data they need, and exit at the end of the script.");
    args.AddOption(&arg_keys, "-k", "--keys",
                   "Execute key shortcut commands in the GLVis window.");
    args.AddOption(&fix_elem_orient, "-fo", "--fix-orientations",
@@ -1182,9 +2065,19 @@ int main (int argc, char *argv[])
                   "Save the mesh coloring generated when opening only a mesh.");
    args.AddOption(&portnum, "-p", "--listen-port",
                   "Specify the port number on which to accept connections.");
+   args.AddOption(&unix_socket, "-us", "--unix-socket",
+                  "In server mode, also accept connections on this Unix"
+                  " domain socket, for clients on the same node, which can"
+                  " send their data in shared memory if they run as the same"
+                  " user (Linux only).");
    args.AddOption(&secure, "-sec", "--secure-sockets",
                   "-no-sec", "--standard-sockets",
                   "Enable or disable GnuTLS secure sockets.");
+   args.AddOption(&warm_workers, "-wp", "--warm-pool",
+                  "In server mode, keep this number of pre-forked workers with"
+                  " their window, shaders, palettes and font ready, and hand"
+                  " new sessions to them (Linux only; not with -sec or"
+                  " -mac).");
    args.AddOption(&mac, "-mac", "--save-stream",
                   "-no-mac", "--dont-save-stream",
                   "In server mode, save incoming data to a file before"
@@ -1207,6 +2100,23 @@ int main (int argc, char *argv[])
                   "Set the line width (multisampling off).");
    args.AddOption(&ms_line_width, "-mslw", "--multisample-line-width",
                   "Set the line width (multisampling on).");
+   args.AddOption(&cache_dir, "-cache", "--cache-dir",
+                  "Store the prepared surfaces and mesh lines in this"
+                  " directory and reuse them when the same data is opened"
+                  " again.");
+   args.AddOption(&tri_budget, "-tb", "--triangle-budget",
+                  "Choose the subdivision factor of GridFunctions so that the"
+                  " estimated number of triangles (surfaces, level surfaces"
+                  " and cutting planes) stays below this budget, e.g. 20M.");
+   args.AddOption(&history_mb, "-hm", "--history-memory",
+                  "Memory limit in MB for the recent solutions of a stream"
+                  " (stepped through with PageUp/PageDown); 0 disables the"
+                  " history, e.g. 256 enables it.");
+   args.AddOption(&history_bits, "-hp", "--history-precision",
+                  "Bits per value of the stored solutions: 64, 32 or 16.");
+   args.AddOption(&palette_file, "-pal", "--palette-file",
+                  "Load additional color palettes from this file; they are"
+                  " numbered after the built-in palettes.");
 
    cout << endl
         << "       _/_/_/  _/      _/      _/  _/"          << endl
@@ -1276,6 +2186,44 @@ int main (int argc, char *argv[])
    {
       plot_caption = c_plot_caption;
    }
+   if (cache_dir != string_none)
+   {
+      SetTessCacheDir(cache_dir);
+   }
+   if (tri_budget != string_none)
+   {
+      triangle_budget = ParseTriangleCount(tri_budget);
+      if (triangle_budget <= 0)
+      {
+         cout << "Invalid triangle budget: " << tri_budget << endl;
+         return 1;
+      }
+   }
+
+   if (palette_file != string_none)
+   {
+      if (!paletteLoad(palette_file))
+      {
+         return 1;
+      }
+   }
+   if (history_bits != 64 && history_bits != 32 && history_bits != 16)
+   {
+      cout << "Invalid history precision: " << history_bits << endl;
+      return 1;
+   }
+   SetSolutionHistoryOptions(history_mb > 0.0 ? (size_t)(history_mb*(1 << 20))
+                             : 0, history_bits);
+   if (shard != string_none)
+   {
+      if (sscanf(shard, "%d/%d", &scr_shard, &scr_shards) != 2 ||
+          scr_shard < 0 || scr_shard >= scr_shards)
+      {
+         cout << "Invalid shard: " << shard << ", expected i/N with"
+              " 0 <= i < N." << endl;
+         return 1;
+      }
+   }
 
    GLVisGeometryRefiner.SetType(geom_ref_type);
 
@@ -1291,7 +2239,7 @@ int main (int argc, char *argv[])
          return 1;
       }
       ifs >> data_type >> ws;
-      int ft = ReadStream(ifs, data_type);
+      int ft = ReadStream(ifs, data_type, false);
       input_streams.Append(&ifs);
       StartVisualization(ft);
       return 0;
@@ -1334,6 +2282,20 @@ int main (int argc, char *argv[])
    // server mode, read the mesh and the solution from a socket
    if (input == 1)
    {
+      if (warm_workers > 0)
+      {
+         if (secure || mac)
+         {
+            cout << "Warm workers need standard sockets (-no-sec) and can not"
+                 " save the streams (-mac)." << endl;
+            return 1;
+         }
+      }
+      // the warm workers and the Unix socket need the connections accepted
+      // with epoll, see ConnectionAcceptor
+      const bool event_server = (warm_workers > 0 ||
+                                 unix_socket != string_none);
+
       // get rid of zombies
       if (multi_session)
       {
@@ -1376,21 +2338,85 @@ int main (int argc, char *argv[])
       }
 #endif
 
+      // Prepared once here, and shared by the forked sessions
+      ResolveFont();
+      palettePrepare();
+
       const int backlog = 128;
-      socketserver server(portnum, backlog);
-      if (server.good())
+      socketserver *server = NULL;
+      ConnectionAcceptor *acceptor = NULL;
+      if (event_server)
+      {
+         acceptor = new ConnectionAcceptor(!secure);
+      }
+      else
+      {
+         server = new socketserver(portnum, backlog);
+      }
+      bool listening = (event_server ? acceptor->ListenTCP(portnum, backlog) :
+                        server->good());
+      if (listening)
       {
          cout << "Waiting for data on port " << portnum << " ..." << endl;
       }
       else
       {
          cout << "Server already running on port " << portnum << ".\n" << endl;
+      }
+      if (listening && unix_socket != string_none)
+      {
+         listening = acceptor->ListenUnix(unix_socket, backlog);
+         if (listening)
+         {
+            cout << "Waiting for data on " << unix_socket << " ..." << endl;
+         }
+         else
+         {
+            cout << "Can not listen on " << unix_socket
+                 << ", is a server already running there?\n" << endl;
+         }
+      }
+      if (!listening)
+      {
+         delete server; delete acceptor;
 #ifdef MFEM_USE_GNUTLS
          delete params; delete state;
 #endif
          return 2;
       }
 
+      Array<socketstream *> par_group;
+      bool par_local = false;
+      WorkerPool *pool = NULL;
+      // Close the sockets of the server in a forked session or worker
+      auto close_server = [&]()
+      {
+         if (server)
+         {
+            server->close();
+            return;
+         }
+         acceptor->Close();
+         for (int i = 0; i < par_group.Size(); i++)
+         {
+            if (par_group[i])
+            {
+               par_group[i]->rdbuf()->socketbuf::close();
+            }
+         }
+         if (pool)
+         {
+            pool->Close();
+         }
+      };
+      if (warm_workers > 0)
+      {
+         pool = new WorkerPool(warm_workers, []()
+         {
+            return WarmUpVisualization(window_w, window_h) == 0;
+         }, ServeWarmSession, close_server);
+      }
+
       socketstream *isock;
 #ifndef MFEM_USE_GNUTLS
       isock = new socketstream;
@@ -1399,92 +2425,158 @@ int main (int argc, char *argv[])
 #endif
       while (1)
       {
-         while (server.accept(*isock) < 0)
+         if (pool)
          {
-#ifdef GLVIS_DEBUG
-            cout << "GLVis: server.accept(...) failed." << endl;
-#endif
+            pool->Fill();
          }
-
-         *isock >> data_type >> ws;
-
-         if (mac)
+         int par_data = 0;
+         if (event_server)
          {
-            viscount++;
+            if (isock == NULL)
+            {
+#ifndef MFEM_USE_GNUTLS
+               isock = new socketstream;
+#else
+               isock = secure ? new socketstream(*params) :
+                       new socketstream(false);
+#endif
+            }
+            if (!NextEventSession(*acceptor, isock, data_type, par_group,
+                                  par_local, pool != NULL))
+            {
+               continue;
+            }
+            par_data = (data_type == "parallel");
          }
-
-         int par_data = 0;
-         if (data_type == "parallel")
+         else
          {
-            par_data = 1;
-            np = 0;
-            do
+            while (server->accept(*isock) < 0)
             {
-               *isock >> nproc >> proc;
 #ifdef GLVIS_DEBUG
-               cout << "new connection: parallel " << nproc << ' ' << proc
-                    << endl;
+               cout << "GLVis: server.accept(...) failed." << endl;
 #endif
-               if (np == 0)
+            }
+
+            *isock >> data_type >> ws;
+
+            if (data_type == "parallel")
+            {
+               par_data = 1;
+               np = 0;
+               do
                {
-                  if (nproc <= 0)
+                  *isock >> nproc >> proc;
+#ifdef GLVIS_DEBUG
+                  cout << "new connection: parallel " << nproc << ' ' << proc
+                       << endl;
+#endif
+                  if (np == 0)
                   {
-                     cout << "Invalid number of processors: " << nproc << endl;
+                     if (nproc <= 0)
+                     {
+                        cout << "Invalid number of processors: " << nproc
+                             << endl;
+                        mfem_error();
+                     }
+                     input_streams.SetSize(nproc);
+                     input_streams = NULL;
+                  }
+                  else
+                  {
+                     if (nproc != input_streams.Size())
+                     {
+                        cout << "Unexpected number of processors: " << nproc
+                             << ", expected: " << input_streams.Size() << endl;
+                        mfem_error();
+                     }
+                  }
+                  if (0 > proc || proc >= nproc)
+                  {
+                     cout << "Invalid processor rank: " << proc
+                          << ", number of processors: " << nproc << endl;
                      mfem_error();
                   }
-                  input_streams.SetSize(nproc);
-                  input_streams = NULL;
-               }
-               else
-               {
-                  if (nproc != input_streams.Size())
+                  if (input_streams[proc])
                   {
-                     cout << "Unexpected number of processors: " << nproc
-                          << ", expected: " << input_streams.Size() << endl;
+                     cout << "Second connection attempt from processor rank: "
+                          << proc << endl;
                      mfem_error();
                   }
-               }
-               if (0 > proc || proc >= nproc)
-               {
-                  cout << "Invalid processor rank: " << proc
-                       << ", number of processors: " << nproc << endl;
-                  mfem_error();
-               }
-               if (input_streams[proc])
-               {
-                  cout << "Second connection attempt from processor rank: "
-                       << proc << endl;
-                  mfem_error();
-               }
 
-               input_streams[proc] = isock;
+                  input_streams[proc] = isock;
 #ifndef MFEM_USE_GNUTLS
-               isock = new socketstream;
+                  isock = new socketstream;
 #else
-               isock = secure ? new socketstream(*params) :
-                       new socketstream(false);
+                  isock = secure ? new socketstream(*params) :
+                          new socketstream(false);
 #endif
-               np++;
-               if (np == nproc)
+                  np++;
+                  if (np == nproc)
+                  {
+                     break;
+                  }
+                  // read next available socket stream
+                  while (server->accept(*isock) < 0)
+                  {
+#ifdef GLVIS_DEBUG
+                     cout << "GLVis: server.accept(...) failed." << endl;
+#endif
+                  }
+                  *isock >> data_type >> ws; // "parallel"
+                  if (data_type != "parallel")
+                  {
+                     cout << "Expected keyword \"parallel\", got \""
+                          << data_type << '"' << endl;
+                     mfem_error();
+                  }
+               }
+               while (1);
+            }
+         }
+
+         const double session_start = GetSteadyTime();
+         if (pool)
+         {
+            Array<socketstream *> socks;
+            if (par_data)
+            {
+               for (int i = 0; i < input_streams.Size(); i++)
                {
-                  break;
+                  socks.Append(static_cast<socketstream *>(input_streams[i]));
                }
-               // read next available socket stream
-               while (server.accept(*isock) < 0)
+            }
+            else
+            {
+               socks.Append(isock);
+            }
+            vector<int> fds;
+            for (int i = 0; i < socks.Size(); i++)
+            {
+               fds.push_back(socks[i]->rdbuf()->getsocketdescriptor());
+            }
+            if (pool->Dispatch(fds, session_start, input_shm))
+            {
+               if (par_data)
                {
-#ifdef GLVIS_DEBUG
-                  cout << "GLVis: server.accept(...) failed." << endl;
-#endif
+                  CloseInputStreams(true);
                }
-               *isock >> data_type >> ws; // "parallel"
-               if (data_type != "parallel")
+               else
                {
-                  cout << "Expected keyword \"parallel\", got \"" << data_type
-                       << '"' << endl;
-                  mfem_error();
+                  isock->rdbuf()->socketbuf::close();
                }
+               continue;
+            }
+            // no warm worker is ready: read the headers, left in the sockets
+            // for the workers, and start the session in a new process
+            for (int i = 0; i < socks.Size(); i++)
+            {
+               ReadHeader(*socks[i], data_type, nproc, proc);
             }
-            while (1);
+         }
+
+         if (mac)
+         {
+            viscount++;
          }
 
          char tmp_file[50];
@@ -1528,7 +2620,7 @@ int main (int argc, char *argv[])
                exit(1);
 
             case 0:                       // This is the child process
-               server.close();
+               close_server();
                if (mac)
                {
                   // exec ourself
@@ -1545,7 +2637,7 @@ int main (int argc, char *argv[])
                   int ft;
                   if (!par_data)
                   {
-                     ft = ReadStream(*isock, data_type);
+                     ft = ReadStream(*isock >> ws, data_type, input_shm);
                      input_streams.Append(isock);
                   }
                   else
@@ -1553,6 +2645,7 @@ int main (int argc, char *argv[])
                      delete isock;
                      ft = ReadInputStreams();
                   }
+                  SetFirstFrameTimer(session_start, "cold start");
                   StartVisualization(ft);
                   CloseInputStreams(false);
                   exit(0);
@@ -1569,6 +2662,7 @@ int main (int argc, char *argv[])
                }
          }
       }
+      delete pool; delete server; delete acceptor;
 #ifdef MFEM_USE_GNUTLS
       delete params; delete state;
 #endif
@@ -1692,6 +2786,7 @@ int main (int argc, char *argv[])
       }
       if (!window_err)
       {
+         vs->SetAutoRefineTriangleBudget(triangle_budget);
          // increase the refinement factors if visualizing a GridFunction
          if (is_gf)
          {
@@ -1742,6 +2837,23 @@ void PrintSampleUsage(ostream &out)
        "All Options:\n";
 }
 
+long long ParseTriangleCount(const char *str)
+{
+   char *end;
+   double count = strtod(str, &end);
+   switch (*end)
+   {
+      case 'k': case 'K': count *= 1e3; end++; break;
+      case 'm': case 'M': count *= 1e6; end++; break;
+      case 'g': case 'G': count *= 1e9; end++; break;
+   }
+   if (end == str || *end != '\0' || !(count >= 1.0 && count < 1e18))
+   {
+      return -1;
+   }
+   return (long long) count;
+}
+
 
 void ReadSerial()
 {
@@ -1930,7 +3042,8 @@ void ReadParallel()
 
 int ReadParMeshAndGridFunction(int np, const char *mesh_prefix,
                                const char *sol_prefix, Mesh **mesh_p,
-                               GridFunction **sol_p, int keep_attr)
+                               GridFunction **sol_p, int keep_attr,
+                               bool verbose)
 {
    Array<Mesh *> mesh_array;
    Array<named_ifgzstream *> meshfiles;
@@ -1944,8 +3057,11 @@ int ReadParMeshAndGridFunction(int np, const char *mesh_prefix,
       meshfiles[p] = new named_ifgzstream(fname.str().c_str());
       if (!(*meshfiles[p]))
       {
-         cerr << "Can not open mesh file: " << fname.str().c_str()
-              << '!' << endl;
+         if (verbose)
+         {
+            cerr << "Can not open mesh file: " << fname.str().c_str()
+                 << '!' << endl;
+         }
          for (p--; p >= 0; p--)
          {
             delete mesh_array[p];
@@ -1982,8 +3098,11 @@ int ReadParMeshAndGridFunction(int np, const char *mesh_prefix,
             ifgzstream solfile(fname.str().c_str());
             if (!solfile)
             {
-               cerr << "Can not open solution file " << fname.str().c_str()
-                    << '!' << endl;
+               if (verbose)
+               {
+                  cerr << "Can not open solution file "
+                       << fname.str().c_str() << '!' << endl;
+               }
                for (p--; p >= 0; p--)
                {
                   delete gf_array[p];
@@ -2036,9 +3155,13 @@ int ReadInputStreams()
 #ifdef GLVIS_DEBUG
       cout << "connection[" << p << "]: reading initial data ... " << flush;
 #endif
-      istream &isock = *input_streams[p];
-      // assuming the "parallel nproc p" part of the stream has been read
-      isock >> ws >> data_type >> ws; // "*_data" / "mesh" / "solution"
+      // assuming the "parallel nproc p" part of the stream has been read;
+      // the data may be in shared memory
+      shmstream shm;
+      // "*_data" / "mesh" / "solution"
+      istream &isock = ReadCommand(*input_streams[p] >> ws, data_type, shm,
+                                   input_shm);
+      isock >> ws;
 #ifdef GLVIS_DEBUG
       cout << " type " << data_type << " ... " << flush;
 #endif
@@ -2058,7 +3181,7 @@ int ReadInputStreams()
       gf_array[p] = NULL;
       if (data_type != "mesh")
       {
-         gf_array[p] = new GridFunction(mesh_array[p], isock);
+         gf_array[p] = LoadGridFunction(mesh_array[p], isock);
          gf_count++;
       }
 #ifdef GLVIS_DEBUG
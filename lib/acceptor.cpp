@@ -0,0 +1,354 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "acceptor.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Longest header that is inspected; longer ones are handed out as they are
+static const int HEADER_PEEK_SIZE = 256;
+
+#ifdef __linux__
+// Whether the client of the Unix domain socket 'fd' runs as the same user as
+// the server
+static bool SameUserPeer(int fd)
+{
+   ucred cred;
+   socklen_t len = sizeof(cred);
+   return (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+           len == sizeof(cred) && cred.uid == getuid());
+}
+#endif
+
+ConnectionAcceptor::ConnectionAcceptor(bool _wait_for_header)
+   : wait_for_header(_wait_for_header), epoll_fd(-1)
+{
+#ifdef __linux__
+   epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (epoll_fd < 0)
+   {
+      cout << "GLVis: epoll_create1(...) failed." << endl;
+   }
+#else
+   cout << "GLVis: the event-driven server is only available on Linux."
+        << endl;
+#endif
+}
+
+bool ConnectionAcceptor::ListenTCP(int port, int backlog)
+{
+#ifdef __linux__
+   if (epoll_fd < 0)
+   {
+      return false;
+   }
+   int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (fd < 0)
+   {
+      return false;
+   }
+   int on = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+   sockaddr_in sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sin_family = AF_INET;
+   sa.sin_port = htons(port);
+   sa.sin_addr.s_addr = INADDR_ANY;
+   if (bind(fd, (sockaddr *) &sa, sizeof(sa)) < 0 ||
+       listen(fd, backlog) < 0 || !Watch(fd, false))
+   {
+      close(fd);
+      return false;
+   }
+   listeners.push_back(fd);
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool ConnectionAcceptor::ListenUnix(const char *path, int backlog)
+{
+#ifdef __linux__
+   sockaddr_un sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   if (epoll_fd < 0 || strlen(path) >= sizeof(sa.sun_path))
+   {
+      return false;
+   }
+   strcpy(sa.sun_path, path);
+   struct stat st;
+   if (lstat(path, &st) == 0)
+   {
+      if (!S_ISSOCK(st.st_mode))
+      {
+         return false;
+      }
+      // remove the socket only if no server accepts connections on it
+      int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      const bool in_use =
+         (probe >= 0 && connect(probe, (sockaddr *) &sa, sizeof(sa)) == 0);
+      if (probe >= 0)
+      {
+         close(probe);
+      }
+      if (in_use || unlink(path) < 0)
+      {
+         return false;
+      }
+   }
+   int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (fd < 0)
+   {
+      return false;
+   }
+   if (bind(fd, (sockaddr *) &sa, sizeof(sa)) < 0 ||
+       listen(fd, backlog) < 0 || !Watch(fd, false))
+   {
+      close(fd);
+      return false;
+   }
+   listeners.push_back(fd);
+   unix_listeners.push_back(fd);
+   return true;
+#else
+   return false;
+#endif
+}
+
+int ConnectionAcceptor::Next(bool *is_local)
+{
+#ifdef __linux__
+   const int max_events = 64;
+   epoll_event events[max_events];
+   while (ready.empty())
+   {
+      int n = epoll_wait(epoll_fd, events, max_events, -1);
+      if (n < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return -1;
+      }
+      // All events are handled before returning, since the connections are
+      // edge-triggered and would not be reported again.
+      for (int i = 0; i < n; i++)
+      {
+         const int fd = events[i].data.fd;
+         if (IsListener(fd))
+         {
+            int s = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+            if (s < 0)
+            {
+#ifdef GLVIS_DEBUG
+               cout << "GLVis: accept(...) failed." << endl;
+#endif
+               continue;
+            }
+            if (!Watch(s, true))
+            {
+               close(s);
+               continue;
+            }
+            pending.push_back(s);
+            if (std::find(unix_listeners.begin(), unix_listeners.end(), fd) !=
+                unix_listeners.end() && SameUserPeer(s))
+            {
+               local.push_back(s);
+            }
+            continue;
+         }
+         bool closed = false;
+         if (!HeaderArrived(fd, closed) && !closed)
+         {
+            continue;
+         }
+         Unwatch(fd);
+         pending.erase(std::find(pending.begin(), pending.end(), fd));
+         if (closed)
+         {
+            DropLocal(fd);
+            close(fd);
+         }
+         else
+         {
+            ready.push_back(fd);
+         }
+      }
+   }
+   const int fd = ready.front();
+   ready.pop_front();
+   const bool fd_local = DropLocal(fd);
+   if (is_local)
+   {
+      *is_local = fd_local;
+   }
+   return fd;
+#else
+   return -1;
+#endif
+}
+
+void ConnectionAcceptor::Close()
+{
+#ifdef __linux__
+   for (size_t i = 0; i < listeners.size(); i++)
+   {
+      close(listeners[i]);
+   }
+   for (size_t i = 0; i < pending.size(); i++)
+   {
+      close(pending[i]);
+   }
+   for (size_t i = 0; i < ready.size(); i++)
+   {
+      close(ready[i]);
+   }
+   if (epoll_fd >= 0)
+   {
+      close(epoll_fd);
+   }
+#endif
+   listeners.clear();
+   pending.clear();
+   ready.clear();
+   unix_listeners.clear();
+   local.clear();
+   epoll_fd = -1;
+}
+
+bool ConnectionAcceptor::DropLocal(int fd)
+{
+   std::vector<int>::iterator it = std::find(local.begin(), local.end(), fd);
+   if (it == local.end())
+   {
+      return false;
+   }
+   local.erase(it);
+   return true;
+}
+
+bool ConnectionAcceptor::Watch(int fd, bool edge_triggered)
+{
+#ifdef __linux__
+   epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | (edge_triggered ? EPOLLET | EPOLLRDHUP : 0);
+   ev.data.fd = fd;
+   return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+   return false;
+#endif
+}
+
+void ConnectionAcceptor::Unwatch(int fd)
+{
+#ifdef __linux__
+   epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+bool ConnectionAcceptor::IsListener(int fd) const
+{
+   return std::find(listeners.begin(), listeners.end(), fd) !=
+          listeners.end();
+}
+
+bool ConnectionAcceptor::HeaderArrived(int fd, bool &closed) const
+{
+   closed = false;
+#ifdef __linux__
+   char buf[HEADER_PEEK_SIZE];
+   ssize_t n = recv(fd, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+   if (n < 0)
+   {
+      closed = (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+      return false;
+   }
+   if (n == 0)
+   {
+      closed = true;
+      return false;
+   }
+   if (!wait_for_header || n == (ssize_t) sizeof(buf))
+   {
+      return true;
+   }
+   return HeaderLength(buf, n) > 0;
+#else
+   return false;
+#endif
+}
+
+int ConnectionAcceptor::HeaderLength(const char *buf, int n)
+{
+   // A word is complete when it is followed by white space. Parallel data
+   // starts with "parallel <nproc> <rank>".
+   int words = 0, needed = 1, i = 0;
+   while (words < needed)
+   {
+      while (i < n && isspace((unsigned char) buf[i])) { i++; }
+      const int start = i;
+      while (i < n && !isspace((unsigned char) buf[i])) { i++; }
+      if (i == n)
+      {
+         return 0;
+      }
+      if (words == 0 && i - start == 8 && !strncmp(buf + start, "parallel", 8))
+      {
+         needed = 3;
+      }
+      words++;
+   }
+   return i;
+}
+
+bool ConnectionAcceptor::PeekHeader(int fd, std::string &data_type,
+                                    int &nproc, int &proc)
+{
+#ifdef __linux__
+   char buf[HEADER_PEEK_SIZE];
+   ssize_t n = recv(fd, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+   const int len = (n > 0) ? HeaderLength(buf, (int) n) : 0;
+   if (len == 0)
+   {
+      return false;
+   }
+   istringstream is(string(buf, len));
+   is >> data_type;
+   if (data_type == "parallel")
+   {
+      is >> nproc >> proc;
+   }
+   return !is.fail();
+#else
+   return false;
+#endif
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_ACCEPTOR
+#define GLVIS_ACCEPTOR
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/** Event-driven acceptor for the connections to the server. It waits with
+    epoll on the listening sockets and on the accepted connections, and hands
+    out a connection only once its header has arrived: the data type and, for
+    parallel data, the number of processors and the rank. A client that is
+    slow to send its data does not hold up the others. Linux only. */
+class ConnectionAcceptor
+{
+public:
+   /** If 'wait_for_header' is false, e.g. for encrypted connections whose
+       header can not be inspected, a connection is handed out as soon as it
+       has data to read. */
+   ConnectionAcceptor(bool wait_for_header = true);
+   ~ConnectionAcceptor() { Close(); }
+
+   /// Listen on the TCP 'port'. Returns false if the port is in use.
+   bool ListenTCP(int port, int backlog);
+
+   /** Listen on the Unix domain socket 'path', for clients on the same node.
+       A socket left at 'path' by a server that has stopped is replaced.
+       Returns false if a server is running there, or on errors. */
+   bool ListenUnix(const char *path, int backlog);
+
+   /** Wait for the next connection whose header has arrived and return its
+       socket, which the caller then owns. If 'is_local' is given, it is set to
+       whether the connection came from the Unix domain socket, from a client
+       running as the same user as the server, see SO_PEERCRED. Only such
+       clients may send their data in shared memory. Returns -1 on errors. */
+   int Next(bool *is_local = NULL);
+
+   /** Close the listening sockets and the connections that are not handed
+       out yet, e.g. in the forked session processes. */
+   void Close();
+
+   /** Read the header of the connection 'fd', handed out by Next(), without
+       removing it from the socket. Returns false if it is not complete. */
+   static bool PeekHeader(int fd, std::string &data_type, int &nproc,
+                          int &proc);
+
+private:
+   bool wait_for_header;
+   int epoll_fd;
+   std::vector<int> listeners, pending;
+   std::deque<int> ready;
+   // the Unix domain listeners, and the connections accepted from them whose
+   // client runs as the same user
+   std::vector<int> unix_listeners, local;
+
+   bool Watch(int fd, bool edge_triggered);
+   void Unwatch(int fd);
+   bool IsListener(int fd) const;
+   /// Remove 'fd' from the local connections; returns true if it was one.
+   bool DropLocal(int fd);
+
+   /** Peek at the data of the connection 'fd': returns true if its header
+       has arrived, and sets 'closed' if the client has gone away. */
+   bool HeaderArrived(int fd, bool &closed) const;
+
+   /** The length of the header at the start of 'buf', up to the white space
+       after it, or 0 if the header is not complete. */
+   static int HeaderLength(const char *buf, int n);
+};
+
+#endif
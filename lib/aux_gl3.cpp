@@ -14,6 +14,8 @@
 #include "openglvis.hpp"
 #include <iostream>
 #include <cstddef>
+#include <cstring>
+#include <algorithm>
 
 using namespace gl3;
 
@@ -102,41 +104,129 @@ void VertexNormTex::clearAttribLayout() {
     GetGlState()->disableAttribArray(GlState::ATTR_TEXCOORD0);
 }
 
+void VertexDisp::setupAttribLayout() {
+    GetGlState()->setModeColor();
+    int loc_vtx = GlState::ATTR_VERTEX;
+    int loc_disp = GlState::ATTR_DISPLACEMENT;
+    GetGlState()->enableAttribArray(GlState::ATTR_VERTEX);
+    GetGlState()->enableAttribArray(GlState::ATTR_DISPLACEMENT);
+    glVertexAttribPointer(loc_vtx, 3, GL_FLOAT, GL_FALSE, sizeof(VertexDisp), (void*)offsetof(VertexDisp, coord));
+    glVertexAttribPointer(loc_disp, 3, GL_FLOAT, GL_FALSE, sizeof(VertexDisp), (void*)offsetof(VertexDisp, disp));
+}
+
+void VertexDisp::clearAttribLayout() {
+    GetGlState()->disableAttribArray(GlState::ATTR_DISPLACEMENT);
+}
+
+void ShrinkCenter::setupAttribLayout() {
+    int loc_elem = GlState::ATTR_SHRINK_CENTER;
+    int loc_attr = GlState::ATTR_SHRINK_ATTR_CENTER;
+    GetGlState()->enableAttribArray(GlState::ATTR_SHRINK_CENTER);
+    GetGlState()->enableAttribArray(GlState::ATTR_SHRINK_ATTR_CENTER);
+    glVertexAttribPointer(loc_elem, 4, GL_FLOAT, GL_FALSE, sizeof(ShrinkCenter), (void*)offsetof(ShrinkCenter, elem));
+    glVertexAttribPointer(loc_attr, 4, GL_FLOAT, GL_FALSE, sizeof(ShrinkCenter), (void*)offsetof(ShrinkCenter, attr));
+}
+
+void ShrinkCenter::clearAttribLayout() {
+    GetGlState()->disableAttribArray(GlState::ATTR_SHRINK_CENTER);
+    GetGlState()->disableAttribArray(GlState::ATTR_SHRINK_ATTR_CENTER);
+}
+
+// Upper bound on the number of distinct strings kept in the glyph run cache
+const size_t MAX_CACHED_GLYPH_RUNS = 1 << 16;
+
+// Corners of a glyph quad, split into two triangles
+const uint8_t glyph_corners[6][2] = {
+    {0, 0}, {1, 0}, {0, 1},
+    {1, 0}, {0, 1}, {1, 1}
+};
+
+#ifndef __EMSCRIPTEN__
+static GLuint getGlyphCornerBuffer() {
+    static GLuint corner_buf = 0;
+    if (corner_buf == 0) {
+        glGenBuffers(1, &corner_buf);
+        glBindBuffer(GL_ARRAY_BUFFER, corner_buf);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glyph_corners), glyph_corners, GL_STATIC_DRAW);
+    }
+    return corner_buf;
+}
+#endif
+
+const TextBuffer::GlyphRun& TextBuffer::getGlyphRun(const std::string& text) {
+    static std::unordered_map<std::string, GlyphRun> run_cache;
+    static int cache_font_gen = -1;
+    GlVisFont * font = GetFont();
+    if (cache_font_gen != font->getFontGeneration()
+        || run_cache.size() >= MAX_CACHED_GLYPH_RUNS) {
+        run_cache.clear();
+        cache_font_gen = font->getFontGeneration();
+    }
+    auto it = run_cache.find(text);
+    if (it != run_cache.end()) {
+        return it->second;
+    }
+    GlyphRun& run = run_cache[text];
+    float tex_w = font->getAtlasWidth();
+    float tex_h = font->getAtlasHeight();
+    float x = 0.f, y = 0.f;
+    for (char c : text) {
+        GlVisFont::glyph g = font->GetTexChar(c);
+        float cur_x = x + g.bear_x;
+        float cur_y = -y - g.bear_y;
+        x += g.adv_x;
+        y += g.adv_y;
+        if (!g.w || !g.h) {
+            continue;
+        }
+        GlyphInstance inst;
+        inst.anchor = { 0.f, 0.f, 0.f };
+        inst.rect = { (int16_t) cur_x, (int16_t) -cur_y,
+                      (int16_t) g.w, (int16_t) g.h };
+        inst.atlas = { g.tex_x, g.tex_x + g.w / tex_w, g.h / tex_h };
+        run.push_back(inst);
+    }
+    return run;
+}
+
 void TextBuffer::buffer() {
-    std::vector<float> buf_data;
-    float tex_w = GetFont()->getAtlasWidth();
-    float tex_h = GetFont()->getAtlasHeight();
+    std::vector<GlyphInstance> glyphs;
     for (auto& e : _data) {
-        float x = 0.f, y = 0.f;
-        for (char c : e.text) {
-            GlVisFont::glyph g = GetFont()->GetTexChar(c);
-            float cur_x = x + g.bear_x;
-            float cur_y = -y - g.bear_y;
-            x += g.adv_x;
-            y += g.adv_y;
-            if (!g.w || !g.h) {
-                continue;
-            }
-            float tris[] = {
-                e.rx, e.ry, e.rz, cur_x,       -cur_y,       g.tex_x,               0,           0,
-                e.rx, e.ry, e.rz, cur_x + g.w, -cur_y,       g.tex_x + g.w / tex_w, 0,           0,
-                e.rx, e.ry, e.rz, cur_x,       -cur_y - g.h, g.tex_x,               g.h / tex_h, 0,
-                e.rx, e.ry, e.rz, cur_x + g.w, -cur_y,       g.tex_x + g.w / tex_w, 0,           0,
-                e.rx, e.ry, e.rz, cur_x,       -cur_y - g.h, g.tex_x,               g.h / tex_h, 0,
-                e.rx, e.ry, e.rz, cur_x + g.w, -cur_y - g.h, g.tex_x + g.w / tex_w, g.h / tex_h, 0
-            };
-            buf_data.insert(buf_data.end(), tris, tris + 8 * 6);
+        for (GlyphInstance inst : getGlyphRun(e.text)) {
+            inst.anchor = { e.rx, e.ry, e.rz };
+            glyphs.push_back(inst);
         }
     }
-    _size = buf_data.size() / 8;
+    _size = glyphs.size();
+    _instanced = GetGlState()->isInstancingSupported();
     if (*_handle == 0) {
         glGenBuffers(1, _handle.get());
     }
     glBindBuffer(GL_ARRAY_BUFFER, *_handle);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * buf_data.size(), buf_data.data(), GL_STATIC_DRAW);
+    if (_instanced) {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GlyphInstance) * glyphs.size(), glyphs.data(), GL_STATIC_DRAW);
+    } else {
+        std::vector<GlyphVertex> verts;
+        verts.reserve(glyphs.size() * 6);
+        for (const GlyphInstance& inst : glyphs) {
+            for (int i = 0; i < 6; i++) {
+                verts.push_back({ inst, { glyph_corners[i][0], glyph_corners[i][1] } });
+            }
+        }
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GlyphVertex) * verts.size(), verts.data(), GL_STATIC_DRAW);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void TextBuffer::setupGlyphAttribs(GLsizei stride, size_t offset) {
+    glVertexAttribPointer(GlState::ATTR_VERTEX, 3, GL_FLOAT, GL_FALSE, stride,
+                          (void*)(offset + offsetof(GlyphInstance, anchor)));
+    glVertexAttribPointer(GlState::ATTR_TEXT_VERTEX, 4, GL_SHORT, GL_FALSE, stride,
+                          (void*)(offset + offsetof(GlyphInstance, rect)));
+    glVertexAttribPointer(GlState::ATTR_TEXCOORD1, 3, GL_FLOAT, GL_FALSE, stride,
+                          (void*)(offset + offsetof(GlyphInstance, atlas)));
+}
+
 void TextBuffer::getObjectSize(const std::string& text, int& w, int& h) {
     float x = 0.f;
     w = 0.f, h = 0.f;
@@ -157,29 +247,159 @@ void TextBuffer::draw() {
         return;
     }
     GetGlState()->setModeRenderText();
-    
-    int loc_rast_vtx = GlState::ATTR_VERTEX;
-    int loc_txt_vtx = GlState::ATTR_TEXT_VERTEX;
-    int loc_tex = GlState::ATTR_TEXCOORD1;
 
     GetGlState()->enableAttribArray(GlState::ATTR_VERTEX);
     GetGlState()->enableAttribArray(GlState::ATTR_TEXT_VERTEX);
     GetGlState()->enableAttribArray(GlState::ATTR_TEXCOORD1);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+    GetGlState()->enableAttribArray(GlState::ATTR_GLYPH_CORNER);
+
+    int loc_corner = GlState::ATTR_GLYPH_CORNER;
+#ifndef __EMSCRIPTEN__
+    if (_instanced) {
+        glBindBuffer(GL_ARRAY_BUFFER, getGlyphCornerBuffer());
+        glVertexAttribPointer(loc_corner, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+        setupGlyphAttribs(sizeof(GlyphInstance), 0);
+        glVertexAttribDivisor(GlState::ATTR_VERTEX, 1);
+        glVertexAttribDivisor(GlState::ATTR_TEXT_VERTEX, 1);
+        glVertexAttribDivisor(GlState::ATTR_TEXCOORD1, 1);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, _size);
+        glVertexAttribDivisor(GlState::ATTR_VERTEX, 0);
+        glVertexAttribDivisor(GlState::ATTR_TEXT_VERTEX, 0);
+        glVertexAttribDivisor(GlState::ATTR_TEXCOORD1, 0);
+    } else
+#endif
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+        setupGlyphAttribs(sizeof(GlyphVertex), offsetof(GlyphVertex, glyph));
+        glVertexAttribPointer(loc_corner, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GlyphVertex),
+                              (void*)offsetof(GlyphVertex, corner));
+        glDrawArrays(GL_TRIANGLES, 0, _size * 6);
+    }
 
-    glVertexAttribPointer(loc_rast_vtx, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, 0);
-    glVertexAttribPointer(loc_txt_vtx, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 3));
-    glVertexAttribPointer(loc_tex, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 5));
-    glDrawArrays(GL_TRIANGLES, 0, _size);
-    
     GetGlState()->disableAttribArray(GlState::ATTR_TEXT_VERTEX);
     GetGlState()->disableAttribArray(GlState::ATTR_TEXCOORD1);
+    GetGlState()->disableAttribArray(GlState::ATTR_GLYPH_CORNER);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     GetGlState()->setModeColor();
 }
 
+// Vertex of the arrow glyph mesh: the point (x, y, z, w) is placed at
+// (x * cone_scale, y * cone_scale, w + z * cone_scale) on the unit arrow
+// along the z axis, see the arrowGlyph() function of the vertex shader.
+struct ArrowMeshVertex {
+    std::array<float, 4> mesh;
+    std::array<float, 3> norm;
+};
+
+// The arrow mesh holds the cone, as triangles, followed by the shaft, as one
+// line. The cone has the same number of sides as the arrows built by
+// VisualizationSceneScalarData::Arrow().
+const int ARROW_CONE_SIDES = 8;
+const int ARROW_CONE_VERTS = 3 * ARROW_CONE_SIDES;
+const int ARROW_SHAFT_VERTS = 2;
+
+#ifndef __EMSCRIPTEN__
+static GLuint getArrowMeshBuffer() {
+    static GLuint mesh_buf = 0;
+    if (mesh_buf == 0) {
+        std::vector<ArrowMeshVertex> mesh;
+        const float nz = 1.f / 4.f;
+        for (int i = 0; i < ARROW_CONE_SIDES; i++) {
+            float a0 = 2 * M_PI * i / ARROW_CONE_SIDES;
+            float a1 = 2 * M_PI * (i + 1) / ARROW_CONE_SIDES;
+            mesh.push_back({ { 0.f, 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f } });
+            mesh.push_back({ { cosf(a0), sinf(a0), -4.f, 1.f },
+                             { cosf(a0), sinf(a0), nz } });
+            mesh.push_back({ { cosf(a1), sinf(a1), -4.f, 1.f },
+                             { cosf(a1), sinf(a1), nz } });
+        }
+        mesh.push_back({ { 0.f, 0.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } });
+        mesh.push_back({ { 0.f, 0.f, 0.f, 1.f }, { 0.f, 0.f, 1.f } });
+        glGenBuffers(1, &mesh_buf);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh_buf);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(ArrowMeshVertex) * mesh.size(), mesh.data(), GL_STATIC_DRAW);
+    }
+    return mesh_buf;
+}
+#endif
+
+ArrowBuffer::ArrowBuffer()
+    : _handle(new GLuint(0))
+    , _size(0)
+    , _length{1.f, 0.f, 0.f, -1e30f}
+    , _shape{0.075f, 0.f}
+    , _scale{1.f, 1.f, 1.f}
+    , _color_map{0.f, 1.f, 0.f}
+    , _color{0.f, 0.f, 0.f, 1.f}
+    , _color_mode(0) { }
+
+void ArrowBuffer::buffer() {
+    _size = _data.size();
+    if (*_handle == 0) {
+        glGenBuffers(1, _handle.get());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * _data.size(), _data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // the instances are only needed on the GPU
+    std::vector<Instance>().swap(_data);
+}
+
+void ArrowBuffer::draw() {
+#ifndef __EMSCRIPTEN__
+    if (_size == 0 || *_handle == 0) {
+        return;
+    }
+    GlState * gl = GetGlState();
+    if (_color_mode == 2) {
+        gl->setModeColorTexture();
+    } else {
+        gl->setModeColor();
+    }
+    float alpha[2] = { MatAlpha, MatAlphaCenter };
+    gl->enableArrows(_length, _shape, _scale, _color_map, alpha);
+    if (_color_mode == 1) {
+        glVertexAttrib4fv(GlState::ATTR_COLOR, _color);
+    }
+
+    gl->enableAttribArray(GlState::ATTR_VERTEX);
+    gl->enableAttribArray(GlState::ATTR_NORMAL);
+    gl->enableAttribArray(GlState::ATTR_ARROW_VERTEX);
+    gl->enableAttribArray(GlState::ATTR_ARROW_VECTOR);
+
+    glBindBuffer(GL_ARRAY_BUFFER, getArrowMeshBuffer());
+    glVertexAttribPointer(GlState::ATTR_ARROW_VERTEX, 4, GL_FLOAT, GL_FALSE, sizeof(ArrowMeshVertex),
+                          (void*)offsetof(ArrowMeshVertex, mesh));
+    glVertexAttribPointer(GlState::ATTR_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(ArrowMeshVertex),
+                          (void*)offsetof(ArrowMeshVertex, norm));
+    glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+    glVertexAttribPointer(GlState::ATTR_VERTEX, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)offsetof(Instance, pos));
+    glVertexAttribPointer(GlState::ATTR_ARROW_VECTOR, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)offsetof(Instance, vec));
+    glVertexAttribDivisor(GlState::ATTR_VERTEX, 1);
+    glVertexAttribDivisor(GlState::ATTR_ARROW_VECTOR, 1);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, ARROW_CONE_VERTS, _size);
+    glDrawArraysInstanced(GL_LINES, ARROW_CONE_VERTS, ARROW_SHAFT_VERTS, _size);
+    glVertexAttribDivisor(GlState::ATTR_VERTEX, 0);
+    glVertexAttribDivisor(GlState::ATTR_ARROW_VECTOR, 0);
+
+    gl->disableAttribArray(GlState::ATTR_NORMAL);
+    gl->disableAttribArray(GlState::ATTR_ARROW_VERTEX);
+    gl->disableAttribArray(GlState::ATTR_ARROW_VECTOR);
+    if (_color_mode == 1) {
+        // restores the static color
+        gl->disableAttribArray(GlState::ATTR_COLOR);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    gl->disableArrows();
+    gl->setModeColor();
+#endif
+}
+
 IDrawHook * GlDrawable::buf_hook = nullptr;
 
 void GlDrawable::addCone(float x, float y, float z,
@@ -250,6 +470,279 @@ void GlDrawable::addCone(float x, float y, float z,
     }
 }
 
+IVertexBuffer * GlDrawable::getBuffer(int layout, GLenum shape) {
+    switch (layout) {
+        case LAYOUT_VTX:
+            return getBuffer<Vertex>(shape);
+        case LAYOUT_VTX_NORMAL:
+            return getBuffer<VertexNorm>(shape);
+        case LAYOUT_VTX_COLOR:
+            return getBuffer<VertexColor>(shape);
+        case LAYOUT_VTX_TEXTURE0:
+            return getBuffer<VertexTex>(shape);
+        case LAYOUT_VTX_NORMAL_COLOR:
+            return getBuffer<VertexNormColor>(shape);
+        case LAYOUT_VTX_NORMAL_TEXTURE0:
+            return getBuffer<VertexNormTex>(shape);
+        case LAYOUT_VTX_DISPLACEMENT:
+            return getBuffer<VertexDisp>(shape);
+        default:
+            return nullptr;
+    }
+}
+
+void GlDrawable::getVertexCounts(size_t counts[NUM_LAYOUTS][NUM_SHAPES]) const {
+    for (int i = 0; i < NUM_LAYOUTS; i++) {
+        for (int j = 0; j < NUM_SHAPES; j++) {
+            counts[i][j] = buffers[i][j] ? buffers[i][j]->get_data_size()
+                                           / buffers[i][j]->get_vertex_size()
+                                         : 0;
+        }
+    }
+}
+
+void GlDrawable::beginGroup(int id) {
+    if (!groups.empty() && groups.back().id == id) {
+        return;
+    }
+    Group g;
+    g.id = id;
+    getVertexCounts(g.first);
+    groups.push_back(g);
+}
+
+void GlDrawable::setShrinkCenters(const std::array<float, 4>& elem,
+                                  const std::array<float, 4>& attr) {
+    ShrinkRun r;
+    getVertexCounts(r.first);
+    r.center.elem = elem;
+    r.center.attr = attr;
+    if (!shrink_runs.empty()
+        && memcmp(shrink_runs.back().first, r.first, sizeof(r.first)) == 0) {
+        // no vertices were added since the previous call
+        shrink_runs.back() = r;
+    } else {
+        shrink_runs.push_back(r);
+    }
+}
+
+void GlDrawable::bufferShrinkCenters() {
+    const ShrinkCenter none = {{0.f, 0.f, 0.f, 1.f}, {0.f, 0.f, 0.f, 1.f}};
+    for (int i = 0; i < NUM_LAYOUTS; i++) {
+        for (int j = 0; j < NUM_SHAPES; j++) {
+            if (shrink_bufs[i][j]) {
+                shrink_bufs[i][j]->clear();
+            }
+            if (!buffers[i][j] || shrink_runs.empty()) {
+                continue;
+            }
+            size_t total = buffers[i][j]->get_data_size()
+                           / buffers[i][j]->get_vertex_size();
+            if (total == 0) {
+                continue;
+            }
+            if (!shrink_bufs[i][j]) {
+                shrink_bufs[i][j].reset(
+                    new VertexBuffer<ShrinkCenter>(buffers[i][j]->get_shape()));
+            }
+            // the centres of run r apply up to the first vertex of run r+1
+            size_t v = 0;
+            for (size_t r = 0; r <= shrink_runs.size(); r++) {
+                size_t end = (r < shrink_runs.size())
+                             ? std::min(shrink_runs[r].first[i][j], total)
+                             : total;
+                const ShrinkCenter& c = (r > 0) ? shrink_runs[r-1].center
+                                                : none;
+                for ( ; v < end; v++) {
+                    shrink_bufs[i][j]->addVertex(c);
+                }
+            }
+            shrink_bufs[i][j]->buffer();
+        }
+    }
+}
+
+void GlDrawable::setGroupVisible(int id, bool visible) {
+    if (id >= (int) hidden_groups.size()) {
+        if (visible) {
+            return;
+        }
+        hidden_groups.resize(id + 1, false);
+    }
+    hidden_groups[id] = !visible;
+}
+
+bool GlDrawable::hasHiddenGroups() const {
+    for (bool hidden : hidden_groups) {
+        if (hidden) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GlDrawable::drawBuffer(int layout, int shape) {
+    IVertexBuffer * buf = buffers[layout][shape].get();
+    VertexBuffer<ShrinkCenter> * shrink = shrink_bufs[layout][shape].get();
+    if (shrink && shrink->count() == buf->count()) {
+        shrink->bindAttribs();
+        drawGroups(layout, shape);
+        ShrinkCenter::clearAttribLayout();
+    } else {
+        drawGroups(layout, shape);
+    }
+}
+
+void GlDrawable::drawGroups(int layout, int shape) {
+    IVertexBuffer * buf = buffers[layout][shape].get();
+    if (groups.empty() || !hasHiddenGroups()) {
+        buf->draw();
+        return;
+    }
+    // merge the consecutive visible groups into ranges; the vertices added
+    // before the first group are always drawn
+    std::vector<GLint> first;
+    std::vector<GLsizei> count;
+    size_t total = buf->count(), start = 0;
+    bool visible = true;
+    for (const Group& g : groups) {
+        size_t g_first = std::min(g.first[layout][shape], total);
+        bool g_visible = (g.id >= (int) hidden_groups.size()
+                          || !hidden_groups[g.id]);
+        if (g_visible == visible) {
+            continue;
+        }
+        if (visible && g_first > start) {
+            first.push_back(start);
+            count.push_back(g_first - start);
+        }
+        start = g_first;
+        visible = g_visible;
+    }
+    if (visible && total > start) {
+        first.push_back(start);
+        count.push_back(total - start);
+    }
+    buf->draw_ranges(first.data(), count.data(), first.size());
+}
+
+// Header of each vertex buffer written by GlDrawable::save()
+struct SavedBufferHeader {
+    uint32_t layout;
+    uint32_t shape;
+    uint64_t bytes;
+};
+
+bool GlDrawable::save(std::ostream& os) const {
+    if (text_buffer.begin() != text_buffer.end() || !shrink_runs.empty()) {
+        return false;
+    }
+    uint32_t num_bufs = 0;
+    for (int i = 0; i < NUM_LAYOUTS; i++) {
+        for (int j = 0; j < NUM_SHAPES; j++) {
+            if (buffers[i][j] && buffers[i][j]->get_data_size() > 0) {
+                num_bufs++;
+            }
+        }
+    }
+    os.write((const char*) &num_bufs, sizeof(num_bufs));
+    for (int i = 0; i < NUM_LAYOUTS; i++) {
+        for (int j = 0; j < NUM_SHAPES; j++) {
+            if (!buffers[i][j] || buffers[i][j]->get_data_size() == 0) {
+                continue;
+            }
+            SavedBufferHeader hdr;
+            hdr.layout = i;
+            hdr.shape = buffers[i][j]->get_shape();
+            hdr.bytes = buffers[i][j]->get_data_size();
+            os.write((const char*) &hdr, sizeof(hdr));
+            os.write((const char*) buffers[i][j]->get_data(), hdr.bytes);
+        }
+    }
+    uint32_t num_groups = groups.size();
+    os.write((const char*) &num_groups, sizeof(num_groups));
+    for (const Group& g : groups) {
+        int32_t id = g.id;
+        os.write((const char*) &id, sizeof(id));
+        for (int i = 0; i < NUM_LAYOUTS; i++) {
+            for (int j = 0; j < NUM_SHAPES; j++) {
+                uint64_t first = g.first[i][j];
+                os.write((const char*) &first, sizeof(first));
+            }
+        }
+    }
+    return os.good();
+}
+
+bool GlDrawable::load(const char * data, size_t size) {
+    uint32_t num_bufs;
+    if (size < sizeof(num_bufs)) {
+        return false;
+    }
+    memcpy(&num_bufs, data, sizeof(num_bufs));
+    // validate all records before touching the current buffers
+    std::vector<std::pair<SavedBufferHeader, size_t>> records;
+    size_t pos = sizeof(num_bufs);
+    for (uint32_t b = 0; b < num_bufs; b++) {
+        SavedBufferHeader hdr;
+        if (size - pos < sizeof(hdr)) {
+            return false;
+        }
+        memcpy(&hdr, data + pos, sizeof(hdr));
+        pos += sizeof(hdr);
+        if (hdr.layout >= NUM_LAYOUTS
+            || (hdr.shape != GL_LINES && hdr.shape != GL_TRIANGLES)
+            || hdr.bytes > size - pos) {
+            return false;
+        }
+        records.emplace_back(hdr, pos);
+        pos += hdr.bytes;
+    }
+    uint32_t num_groups;
+    const size_t group_size = sizeof(int32_t)
+                              + NUM_LAYOUTS * NUM_SHAPES * sizeof(uint64_t);
+    if (size - pos < sizeof(num_groups)) {
+        return false;
+    }
+    memcpy(&num_groups, data + pos, sizeof(num_groups));
+    pos += sizeof(num_groups);
+    if ((size - pos) / group_size < num_groups
+        || pos + num_groups * group_size != size) {
+        return false;
+    }
+    std::vector<Group> new_groups(num_groups);
+    for (Group& g : new_groups) {
+        int32_t id;
+        memcpy(&id, data + pos, sizeof(id));
+        pos += sizeof(id);
+        if (id < 0) {
+            return false;
+        }
+        g.id = id;
+        for (int i = 0; i < NUM_LAYOUTS; i++) {
+            for (int j = 0; j < NUM_SHAPES; j++) {
+                uint64_t first;
+                memcpy(&first, data + pos, sizeof(first));
+                pos += sizeof(first);
+                g.first[i][j] = first;
+            }
+        }
+    }
+    for (const auto& rec : records) {
+        IVertexBuffer * buf = getBuffer(rec.first.layout, rec.first.shape);
+        if (rec.first.bytes % buf->get_vertex_size() != 0) {
+            return false;
+        }
+    }
+    clear();
+    for (const auto& rec : records) {
+        getBuffer(rec.first.layout, rec.first.shape)
+            ->buffer_raw(data + rec.second, rec.first.bytes);
+    }
+    groups.swap(new_groups);
+    return true;
+}
+
 void GlBuilder::saveVertex(const GlBuilder::_vertex& v) {
     GLenum dst_buf = is_line ? GL_LINES : GL_TRIANGLES;
     if (!use_norm) {
@@ -15,6 +15,9 @@
 #include <array>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
 
 #include "platform_gl.hpp"
 
@@ -29,6 +32,7 @@ enum array_layout {
     LAYOUT_VTX_TEXTURE0,
     LAYOUT_VTX_NORMAL_COLOR,
     LAYOUT_VTX_NORMAL_TEXTURE0,
+    LAYOUT_VTX_DISPLACEMENT,
     NUM_LAYOUTS
 };
 
@@ -93,6 +97,34 @@ struct alignas(16) VertexNormTex
     static const int layout = LAYOUT_VTX_NORMAL_TEXTURE0;
 };
 
+/**
+ * Vertex drawn at coord + s * disp, where the displacement scale s is set
+ * with GlState::setDisplacementScale().
+ */
+struct alignas(16) VertexDisp
+{
+    std::array<float, 3> coord;
+    std::array<float, 3> disp;
+
+    static void setupAttribLayout();
+    static void clearAttribLayout();
+    static const int layout = LAYOUT_VTX_DISPLACEMENT;
+};
+
+/**
+ * Per-vertex centres towards which the vertex shader shrinks the vertices of
+ * a drawable, see GlDrawable::setShrinkCenters(). Kept in a separate stream
+ * next to the vertex data of any layout.
+ */
+struct alignas(16) ShrinkCenter
+{
+    std::array<float, 4> elem;
+    std::array<float, 4> attr;
+
+    static void setupAttribLayout();
+    static void clearAttribLayout();
+};
+
 inline std::array<uint8_t, 4> ColorU8(float r, float g, float b, float a) {
     return {
         (r >= 1.0) ? (uint8_t) 255 : (uint8_t)(r * 256.),
@@ -250,6 +282,14 @@ public:
     void glColor3f(float r, float g, float b) { glColor4f(r, g, b, 1.f); }
 
     void glColor4fv(float * cv) { glColor4f(cv[0], cv[1], cv[2], cv[3]); }
+
+    void glColor4ubv(const std::array<uint8_t, 4> & cv) {
+        if (count == 0) {
+            use_color = true;
+            use_tex = false;
+        }
+        curr.color = cv;
+    }
     
     void glTexCoord2f(float coord_u, float coord_v) {
         if (count == 0) {
@@ -270,6 +310,27 @@ public:
 
     virtual size_t count() const = 0;
     virtual GLenum get_shape() const = 0;
+
+    /**
+     * Gets the vertex data held on the host, the size of that data in bytes
+     * and the size of a single vertex.
+     */
+    virtual const void * get_data() const = 0;
+    virtual size_t get_data_size() const = 0;
+    virtual size_t get_vertex_size() const = 0;
+
+    /**
+     * Buffers raw vertex data (e.g. read back from a file) directly onto the
+     * GPU without keeping a host copy.
+     */
+    virtual void buffer_raw(const void * data, size_t bytes) = 0;
+
+    /**
+     * Draws n ranges of the vertex data buffered on the GPU, range i starting
+     * at vertex first[i] and holding count[i] vertices.
+     */
+    virtual void draw_ranges(const GLint * first, const GLsizei * count,
+                             GLsizei n) = 0;
 };
 
 template<typename T>
@@ -334,6 +395,25 @@ public:
         _buffered_size = _data.size();
     }
 
+    virtual const void * get_data() const { return _data.data(); }
+    virtual size_t get_data_size() const { return sizeof(T) * _data.size(); }
+    virtual size_t get_vertex_size() const { return sizeof(T); }
+
+    virtual void buffer_raw(const void * data, size_t bytes) {
+        _data.clear();
+        _buffered_size = bytes / sizeof(T);
+        if (_buffered_size == 0) {
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+        if (_allocated_size >= _buffered_size) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(T) * _buffered_size, data);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(T) * _buffered_size, data, GL_DYNAMIC_DRAW);
+            _allocated_size = _buffered_size;
+        }
+    }
+
     /**
      * Draws the vertex data buffered on the GPU.
      */
@@ -347,6 +427,32 @@ public:
         T::clearAttribLayout();
     }
 
+    virtual void draw_ranges(const GLint * first, const GLsizei * count,
+                             GLsizei n) {
+        if (_buffered_size == 0 || n == 0) {
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+        T::setupAttribLayout();
+#ifndef __EMSCRIPTEN__
+        glMultiDrawArrays(_shape, first, count, n);
+#else
+        for (GLsizei i = 0; i < n; i++) {
+            glDrawArrays(_shape, first[i], count[i]);
+        }
+#endif
+        T::clearAttribLayout();
+    }
+
+    /**
+     * Binds the vertex data buffered on the GPU as additional attributes of
+     * the vertices of the next draw call of another buffer.
+     */
+    void bindAttribs() {
+        glBindBuffer(GL_ARRAY_BUFFER, *_handle);
+        T::setupAttribLayout();
+    }
+
     /**
      * Add a vertex to the buffer.
      */
@@ -367,12 +473,44 @@ public:
     };
     typedef std::vector<Entry>::iterator Iterator;
     typedef std::vector<Entry>::const_iterator ConstIterator;
+
+    /**
+     * Per-glyph instance record: the anchor point of the string in object
+     * space, the glyph quad (x, y, w, h) as a pixel offset from the anchor,
+     * and the atlas coordinates (u0, u1, v1) of the glyph. The quad corners
+     * are expanded in the vertex shader.
+     */
+    struct GlyphInstance {
+        std::array<float, 3> anchor;
+        std::array<int16_t, 4> rect;
+        std::array<float, 3> atlas;
+    };
+
+    /**
+     * Glyph vertex used when instanced drawing is unavailable: each glyph
+     * record is repeated for the 6 corners of its quad.
+     */
+    struct GlyphVertex {
+        GlyphInstance glyph;
+        std::array<uint8_t, 2> corner;
+    };
 private:
+    typedef std::vector<GlyphInstance> GlyphRun;
+
     std::unique_ptr<GLuint> _handle;
     std::vector<Entry> _data;
     size_t _size;
+    bool _instanced;
+
+    /**
+     * Returns the laid-out glyphs of a string, relative to its anchor. Runs
+     * are cached per distinct string and reset when the font changes.
+     */
+    static const GlyphRun& getGlyphRun(const std::string& text);
+
+    void setupGlyphAttribs(GLsizei stride, size_t offset);
 public:
-    TextBuffer() : _handle(new GLuint(0)) { };
+    TextBuffer() : _handle(new GLuint(0)), _size(0), _instanced(false) { };
     ~TextBuffer() {
         if (_handle)
             glDeleteBuffers(1, _handle.get());
@@ -422,6 +560,132 @@ public:
     }
 };
 
+/**
+ * Arrow glyphs drawn with instancing: a single arrow mesh shared by all
+ * glyphs, and one (position, vector, value) record per arrow. The glyphs are
+ * oriented, scaled and colored in the vertex shader, so changing the
+ * parameters below does not require rebuilding the instance data.
+ *
+ * Requires instanced draw support, see GlState::isInstancingSupported().
+ */
+class ArrowBuffer
+{
+public:
+    struct Instance {
+        std::array<float, 3> pos;
+        std::array<float, 4> vec; // vector and scalar value
+    };
+private:
+    std::unique_ptr<GLuint> _handle;
+    std::vector<Instance> _data;
+    size_t _size;
+
+    float _length[4];
+    float _shape[2];
+    float _scale[3];
+    float _color_map[3];
+    float _color[4];
+    int _color_mode; // 0 - current static color, 1 - _color, 2 - colormap
+public:
+    ArrowBuffer();
+    ~ArrowBuffer() {
+        if (_handle)
+            glDeleteBuffers(1, _handle.get());
+    }
+
+    /**
+     * Adds an arrow at (px, py, pz) along (vx, vy, vz). Zero vectors are
+     * skipped.
+     */
+    void addArrow(float px, float py, float pz,
+                  float vx, float vy, float vz, float value) {
+        if (vx == 0.f && vy == 0.f && vz == 0.f) {
+            return;
+        }
+        _data.push_back({ { px, py, pz }, { vx, vy, vz, value } });
+    }
+
+    /**
+     * Returns the number of arrows buffered on the GPU.
+     */
+    size_t count() const { return _size; }
+
+    /**
+     * Sets the length of the arrows to max(a_vec |v| + a_val value + a_const,
+     * min_len), in the units of the scaled (drawn) coordinates.
+     */
+    void setLength(float a_vec, float a_val, float a_const,
+                   float min_len = -1e30f) {
+        _length[0] = a_vec;
+        _length[1] = a_val;
+        _length[2] = a_const;
+        _length[3] = min_len;
+    }
+
+    /**
+     * Sets the size of the cone relative to the arrow length, and whether
+     * the arrows are centered at their position or start from it.
+     */
+    void setShape(float cone_scale, bool centered) {
+        _shape[0] = cone_scale;
+        _shape[1] = centered ? -0.5f : 0.f;
+    }
+
+    /**
+     * Sets the scaling of the x, y and z axes applied to the scene, so that
+     * the drawn arrows are not distorted by it.
+     */
+    void setAxisScale(float sx, float sy, float sz) {
+        _scale[0] = sx;
+        _scale[1] = sy;
+        _scale[2] = sz;
+    }
+
+    /**
+     * Colors the arrows by their value using the current palette.
+     */
+    void setColorMap(float vmin, float vmax, bool logscale) {
+        _color_map[0] = vmin;
+        _color_map[1] = vmax;
+        _color_map[2] = logscale ? 1.f : 0.f;
+        _color_mode = 2;
+    }
+
+    /**
+     * Draws all arrows with the given color.
+     */
+    void setColor(float r, float g, float b, float a = 1.0) {
+        _color[0] = r;
+        _color[1] = g;
+        _color[2] = b;
+        _color[3] = a;
+        _color_mode = 1;
+    }
+
+    /**
+     * Draws the arrows with the static color set at draw time.
+     */
+    void useStaticColor() { _color_mode = 0; }
+
+    /**
+     * Buffers the arrow instances onto the GPU.
+     */
+    void buffer();
+
+    /**
+     * Draws the arrows buffered onto the GPU.
+     */
+    void draw();
+
+    /**
+     * Clears the arrow instances.
+     */
+    void clear() {
+        _data.clear();
+        _size = 0;
+    }
+};
+
 class IDrawHook {
 public:
     virtual void preDraw(const IVertexBuffer *) = 0;
@@ -457,6 +721,33 @@ private:
         VertexBuffer<Vert> * buf = static_cast<VertexBuffer<Vert>*>(buffers[Vert::layout][idx].get());
         return buf;
     }
+
+    IVertexBuffer * getBuffer(int layout, GLenum shape);
+
+    // Groups of primitives started by beginGroup(): the vertices of a group
+    // run from its first[][] offsets to those of the next group.
+    struct Group {
+        int id;
+        size_t first[NUM_LAYOUTS][NUM_SHAPES];
+    };
+    std::vector<Group> groups;
+    std::vector<bool> hidden_groups;
+
+    // Runs of vertices sharing their shrink centres, started by
+    // setShrinkCenters(), and the per-vertex streams built from them.
+    struct ShrinkRun {
+        size_t first[NUM_LAYOUTS][NUM_SHAPES];
+        ShrinkCenter center;
+    };
+    std::vector<ShrinkRun> shrink_runs;
+    std::unique_ptr<VertexBuffer<ShrinkCenter>>
+        shrink_bufs[NUM_LAYOUTS][NUM_SHAPES];
+
+    void getVertexCounts(size_t counts[NUM_LAYOUTS][NUM_SHAPES]) const;
+    void bufferShrinkCenters();
+    bool hasHiddenGroups() const;
+    void drawGroups(int layout, int shape);
+    void drawBuffer(int layout, int shape);
 public:
     /**
      * Sets a global draw hook to be called before and after each vertex buffer
@@ -514,8 +805,40 @@ public:
             }
         }
         text_buffer.clear();
+        groups.clear();
+        shrink_runs.clear();
+        for (int i = 0; i < NUM_LAYOUTS; i++) {
+            for (int j = 0; j < NUM_SHAPES; j++) {
+                if (shrink_bufs[i][j]) {
+                    shrink_bufs[i][j]->clear();
+                }
+            }
+        }
     }
-    
+
+    /**
+     * Starts a group of primitives: the vertices added until the next call
+     * belong to the group with the given non-negative id (e.g. an attribute
+     * index). Calling it again with the id of the current group does nothing.
+     */
+    void beginGroup(int id);
+
+    /**
+     * Shows or hides the primitives of a group in draw(), without rebuilding
+     * the object. The setting is kept by clear().
+     */
+    void setGroupVisible(int id, bool visible);
+
+    /**
+     * Sets the centres towards which the vertices added after this call are
+     * shrunk by the factors of GlState::setShrinkFactors(): first towards
+     * 'elem', then towards 'attr'. A w = 1 in a centre disables the
+     * corresponding shrink; vertices added before the first call are not
+     * shrunk. Objects with shrink centres are not saved.
+     */
+    void setShrinkCenters(const std::array<float, 4>& elem,
+                          const std::array<float, 4>& attr);
+
     /**
      * Buffers the drawable object onto the GPU.
      */
@@ -527,9 +850,37 @@ public:
                 }
             }
         }
+        bufferShrinkCenters();
         text_buffer.buffer();
     }
 
+    /**
+     * Returns the number of triangles buffered onto the GPU.
+     */
+    size_t getTriangleCount() const {
+        size_t n = 0;
+        for (int i = 0; i < NUM_LAYOUTS; i++) {
+            if (buffers[i][1]) {
+                n += buffers[i][1]->count() / 3;
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Writes the vertex data of the object to a binary stream. Returns false
+     * if the object holds text or shrink centres, which are not saved, or if
+     * writing failed.
+     */
+    bool save(std::ostream& os) const;
+
+    /**
+     * Replaces the vertex data of the object with data written by save() and
+     * buffers it onto the GPU. Returns false if the data is malformed, in
+     * which case the object is left unchanged.
+     */
+    bool load(const char * data, size_t size);
+
     /**
      * Draws the object.
      */
@@ -541,7 +892,7 @@ public:
                 if (GlDrawable::buf_hook) {
                     GlDrawable::buf_hook->preDraw(buffers[i][j].get());
                 }
-                buffers[i][j]->draw();
+                drawBuffer(i, j);
                 if (GlDrawable::buf_hook) {
                     GlDrawable::buf_hook->postDraw(buffers[i][j].get());
                 }
@@ -14,6 +14,10 @@
 #include <fstream>
 #include <cmath>
 #include <ctime>
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include <vector>
 
 #include "mfem.hpp"
 using namespace mfem;
@@ -68,6 +72,48 @@ VisualizationScene * GetVisualizationScene()
 void MyExpose(GLsizei w, GLsizei h);
 void MyExpose();
 
+// Set by WarmUpVisualization(): the hidden window is ready to be shown
+static bool wnd_warm = false;
+
+// Start time and label for the report of the first frame, see
+// SetFirstFrameTimer()
+static double first_frame_start = -1.0;
+static const char *first_frame_kind = "";
+
+double GetSteadyTime()
+{
+   return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SetFirstFrameTimer(double start, const char *kind)
+{
+   first_frame_start = start;
+   first_frame_kind = kind;
+}
+
+int WarmUpVisualization(int w, int h)
+{
+   if (wnd)
+   {
+      return 0;
+   }
+   wnd = new SdlWindow();
+   if (!wnd->createWindow("GLVis", w, h, true))
+   {
+      return 1;
+   }
+   state = new GlState();
+   if (!state->compileShaders())
+   {
+      return 1;
+   }
+   paletteInit();
+   InitFont();
+   wnd_warm = true;
+   return 0;
+}
+
 int InitVisualization (const char name[], int x, int y, int w, int h)
 {
 
@@ -90,7 +136,14 @@ int InitVisualization (const char name[], int x, int y, int w, int h)
    }
 
    paletteInit();
-   InitFont();
+   if (wnd_warm) {
+       wnd->setWindowTitle(name);
+       wnd->setWindowSize(w, h);
+       wnd->showWindow();
+       wnd_warm = false;
+   } else {
+       InitFont();
+   }
 
 #ifdef GLVIS_DEBUG
    cout << "Window should be up" << endl;
@@ -177,6 +230,11 @@ int InitVisualization (const char name[], int x, int y, int w, int h)
    wnd->setOnKeyDown(SDLK_LEFTPAREN, ShrinkWindow);
    wnd->setOnKeyDown(SDLK_RIGHTPAREN, EnlargeWindow);
 
+   wnd->setOnKeyDown(SDLK_PAGEUP, HistoryPrevious);
+   wnd->setOnKeyDown(SDLK_PAGEDOWN, HistoryNext);
+   wnd->setOnKeyDown(SDLK_HOME, HistoryFirst);
+   wnd->setOnKeyDown(SDLK_END, HistoryLast);
+
    if (locscene)
        delete locscene;
 #endif
@@ -298,6 +356,13 @@ void CallKeySequence(const char *seq)
 
 void InitIdleFuncs();
 
+static void (*StartupIdleFunc)(void) = NULL;
+
+void SetStartupIdleFunc(void (*Func)(void))
+{
+   StartupIdleFunc = Func;
+}
+
 void SetVisualizationScene(VisualizationScene * scene, int view,
                            const char *keys)
 {
@@ -317,6 +382,11 @@ void SetVisualizationScene(VisualizationScene * scene, int view,
    {
       AddIdleFunc(MainLoop);
    }
+   if (StartupIdleFunc)
+   {
+      AddIdleFunc(StartupIdleFunc);
+      StartupIdleFunc = NULL;
+   }
 
    if (keys)
    {
@@ -382,6 +452,14 @@ void MyExpose(GLsizei w, GLsizei h)
 {
    MyReshape (w, h);
    locscene -> Draw();
+   if (first_frame_start >= 0.0)
+   {
+      glFinish();
+      cout << "Session: first frame after "
+           << 1e3*(GetSteadyTime() - first_frame_start) << " ms ("
+           << first_frame_kind << ")" << endl;
+      first_frame_start = -1.0;
+   }
 }
 
 void MyExpose()
@@ -431,9 +509,26 @@ double xang = 0., yang = 0.;
 GlMatrix srot;
 double sph_t, sph_u;
 static GLint oldx, oldy, startx, starty;
+// number of mouse buttons held down, i.e. the view is being dragged
+static int mouse_buttons_down = 0;
 
 int constrained_spinning = 0;
 
+bool MouseDragging()
+{
+   return mouse_buttons_down > 0;
+}
+
+// The view stops changing: redraw what is skipped while dragging
+static void MouseButtonReleased()
+{
+   if (mouse_buttons_down > 0)
+   {
+      mouse_buttons_down--;
+   }
+   SendExposeEvent();
+}
+
 
 void MainLoop()
 {
@@ -495,6 +590,7 @@ inline void ComputeSphereAngles(int &newx, int &newy,
 
 void LeftButtonDown (EventInfo *event)
 {
+   mouse_buttons_down++;
    locscene -> spinning = 0;
    RemoveIdleFunc(MainLoop);
 
@@ -576,6 +672,8 @@ void LeftButtonUp (EventInfo *event)
    xang = (newx-startx)/5.0;
    yang = (newy-starty)/5.0;
 
+   MouseButtonReleased();
+
    if ( (event->keymod & KMOD_SHIFT) && (xang != 0.0 || yang != 0.0) )
    {
       locscene -> spinning = 1;
@@ -596,6 +694,7 @@ void LeftButtonUp (EventInfo *event)
 
 void MiddleButtonDown (EventInfo *event)
 {
+   mouse_buttons_down++;
    startx = oldx = event->mouse_x;
    starty = oldy = event->mouse_y;
 }
@@ -669,10 +768,13 @@ void MiddleButtonLoc (EventInfo *event)
 }
 
 void MiddleButtonUp (EventInfo *event)
-{}
+{
+   MouseButtonReleased();
+}
 
 void RightButtonDown (EventInfo *event)
 {
+   mouse_buttons_down++;
    startx = oldx = event->mouse_x;
    starty = oldy = event->mouse_y;
 }
@@ -727,7 +829,9 @@ void RightButtonLoc (EventInfo *event)
 }
 
 void RightButtonUp (EventInfo *event)
-{}
+{
+   MouseButtonReleased();
+}
 
 #if defined(GLVIS_USE_LIBTIFF)
 const char *glvis_screenshot_ext = ".tif";
@@ -1001,6 +1105,38 @@ void ThreadsPauseFunc(GLenum state)
    }
 }
 
+void HistoryPrevious()
+{
+   if (glvis_command)
+   {
+      glvis_command->HistoryStep(-1);
+   }
+}
+
+void HistoryNext()
+{
+   if (glvis_command)
+   {
+      glvis_command->HistoryStep(1);
+   }
+}
+
+void HistoryFirst()
+{
+   if (glvis_command)
+   {
+      glvis_command->HistoryStep(INT_MIN/2);
+   }
+}
+
+void HistoryLast()
+{
+   if (glvis_command)
+   {
+      glvis_command->HistoryStep(INT_MAX/2);
+   }
+}
+
 void ThreadsStop()
 {
    if (visualize == 1)
@@ -1032,6 +1168,7 @@ void CheckSpin()
    {
       locscene->spinning = 0;
       RemoveIdleFunc(MainLoop);
+      SendExposeEvent();
    }
 }
 
@@ -1053,6 +1190,7 @@ void KeyDeletePressed()
       locscene -> spinning = 0;
       RemoveIdleFunc(MainLoop);
       constrained_spinning = 1;
+      SendExposeEvent();
    }
    else
    {
@@ -1371,7 +1509,8 @@ void MySetColor (gl3::GlBuilder& builder, double val, double min, double max) {
   }
 }
 
-float MySetColor (double val, float (&rgba)[4])
+// Palette color and transparency of val in [0,1]; returns the alpha value.
+static double PaletteColor (double val, float (&rgba)[4])
 {
    int i;
    double t, *pal;
@@ -1397,12 +1536,6 @@ float MySetColor (double val, float (&rgba)[4])
          malpha *= exp(-fabs(val-MatAlphaCenter));
       }
    }
-   
-   if (UseTexture)
-   {
-      //return 1-alpha since default attrib value is 0.0
-      return MatAlpha < 1.0 ? 1.0 - malpha : 0.0;
-   }
 
    val *= 0.999999999 * ( palSize - 1 ) * abs(RepeatPaletteTimes);
    i = (int) floor( val );
@@ -1424,64 +1557,143 @@ float MySetColor (double val, float (&rgba)[4])
    rgba[1] = (1.0 - t) * pal[1] + t * pal[4];
    rgba[2] = (1.0 - t) * pal[2] + t * pal[5];
    rgba[3] = MatAlpha < 1.0 ? malpha : 1.0;
-   return 0.0;
+   return rgba[3];
 }
 
-void MySetColor (gl3::GlBuilder& builder, double val)
+float MySetColor (double val, float (&rgba)[4])
 {
-   int i;
-   double t, *pal;
+   double alpha = PaletteColor(val, rgba);
+   if (UseTexture)
+   {
+      //return 1-alpha since default attrib value is 0.0
+      return 1.0 - alpha;
+   }
+   return 0.0;
+}
 
-   int palSize = paletteGetSize();
+// Colors and alpha values of equally spaced values in [0,1], used by the
+// GlBuilder versions of MySetColor() and by MySetColors(). The table has
+// PALETTE_LUT_STEPS entries between consecutive palette colors, so that its
+// colors are within 1 of the interpolated ones also for palettes with few,
+// contrasting colors (see glvis-palette-bench.cpp). It is rebuilt when the
+// palette, its repetition or the transparency settings change.
+static const int PALETTE_LUT_STEPS = 512;
+static const int PALETTE_LUT_MIN_SIZE = 4096;
+static const int PALETTE_LUT_MAX_SIZE = 1 << 20;
 
-   if (val < 0.0) { val = 0.0; }
-   if (val > 1.0) { val = 1.0; }
+struct PaletteLUT
+{
+   const double *palette = NULL;
+   int size = 0, repeat = 0;
+   float alpha = -1.0f, alpha_center = 0.0f;
 
-   double malpha = MatAlpha;
-   if (malpha < 1.0)
-   {
-      if (MatAlphaCenter > 1.0)
-      {
-         malpha *= exp(-(MatAlphaCenter)*fabs(val-1.0));
-      }
-      else if (MatAlphaCenter < 0.0)
-      {
-         malpha *= exp((MatAlphaCenter-1.0)*fabs(val-0.0));
-      }
-      else
+   float scale = 0.0f; // number of entries - 1
+   std::vector<std::array<uint8_t, 4>> rgba;
+   std::vector<float> tex_alpha;
+};
+
+static PaletteLUT palette_lut;
+
+static const PaletteLUT &GetPaletteLUT()
+{
+   PaletteLUT &lut = palette_lut;
+   if (lut.palette != paletteGet() || lut.size != paletteGetSize() ||
+       lut.repeat != RepeatPaletteTimes || lut.alpha != MatAlpha ||
+       lut.alpha_center != MatAlphaCenter)
+   {
+      lut.palette = paletteGet();
+      lut.size = paletteGetSize();
+      lut.repeat = RepeatPaletteTimes;
+      lut.alpha = MatAlpha;
+      lut.alpha_center = MatAlphaCenter;
+      const long steps = (long) PALETTE_LUT_STEPS*(lut.size - 1)*
+                         std::max(abs(lut.repeat), 1);
+      const int n = (int) std::max<long>(
+                       std::min<long>(steps + 1, PALETTE_LUT_MAX_SIZE),
+                       PALETTE_LUT_MIN_SIZE);
+      lut.scale = n - 1;
+      lut.rgba.resize(n);
+      lut.tex_alpha.resize(n);
+      for (int k = 0; k < n; k++)
       {
-         malpha *= exp(-fabs(val-MatAlphaCenter));
+         float rgba[4];
+         lut.tex_alpha[k] = PaletteColor(double(k)/(n-1), rgba);
+         lut.rgba[k] = gl3::ColorU8(rgba);
       }
    }
+   return lut;
+}
 
-   if (UseTexture)
-   {
-      builder.glTexCoord2f(val, MatAlpha < 1.0 ? malpha : 1.0);
-      return;
-   }
+// Clamp to [0,1] without branches; NaN is mapped to 0.
+static inline float ClampUnit(float t)
+{
+   return (t > 0.0f) ? ((t < 1.0f) ? t : 1.0f) : 0.0f;
+}
 
-   val *= 0.999999999 * ( palSize - 1 ) * abs(RepeatPaletteTimes);
-   i = (int) floor( val );
-   t = val - i;
+static inline void LookupColor(const PaletteLUT &lut, float t,
+                               MappedColor &color)
+{
+   const int k = (int)(t*lut.scale + 0.5f);
+   color.texcoord[0] = t;
+   color.texcoord[1] = lut.tex_alpha[k];
+   color.rgba = lut.rgba[k];
+}
 
-   if (((i / (palSize-1)) % 2 == 0 && RepeatPaletteTimes > 0) ||
-       ((i / (palSize-1)) % 2 == 1 && RepeatPaletteTimes < 0))
+void MySetColor (gl3::GlBuilder& builder, double val)
+{
+   MappedColor color;
+   LookupColor(GetPaletteLUT(), ClampUnit(val), color);
+   MySetColor(builder, color);
+}
+
+void MySetColor (gl3::GlBuilder& builder, const MappedColor &color)
+{
+   if (UseTexture)
    {
-      pal = paletteGet() + 3 * ( i % (palSize-1) );
+      builder.glTexCoord2f(color.texcoord[0], color.texcoord[1]);
    }
    else
    {
-      pal = paletteGet() + 3 * ( (palSize-2) -
-                                i % (palSize-1) );
-      t = 1.0 - t;
+      builder.glColor4ubv(color.rgba);
+   }
+}
+
+void MySetColors (const double *vals, int n, double min, double max,
+                  MappedColor *colors)
+{
+   const PaletteLUT &lut = GetPaletteLUT();
+
+   // Map the values in blocks: the normalization loop reads and writes
+   // contiguous arrays and has no branches, so that the compiler can
+   // vectorize it, and the table lookups follow in a separate loop.
+   const int block = 256;
+   float t[block];
+   for (int i0 = 0; i0 < n; i0 += block)
+   {
+      const int nb = std::min(block, n - i0);
+      const double *v = vals + i0;
+      if (MySetColorLogscale)
+      {
+         const double s = 1.0/log(fabs(max/min));
+         for (int i = 0; i < nb; i++)
+         {
+            const double c = (v[i] < min) ? min : ((v[i] > max) ? max : v[i]);
+            t[i] = ClampUnit(log(fabs(c/min))*s);
+         }
+      }
+      else
+      {
+         const double s = 1.0/(max-min);
+         for (int i = 0; i < nb; i++)
+         {
+            t[i] = ClampUnit((v[i]-min)*s);
+         }
+      }
+      for (int i = 0; i < nb; i++)
+      {
+         LookupColor(lut, t[i], colors[i0+i]);
+      }
    }
-   float rgba[4] = {
-       (float)((1.0 - t) * pal[0] + t * pal[3]),
-       (float)((1.0 - t) * pal[1] + t * pal[4]),
-       (float)((1.0 - t) * pal[2] + t * pal[5]),
-       (float)(MatAlpha < 1.0 ? malpha : 1.0)
-   };
-   builder.glColor4fv(rgba);
 }
 
 int GetUseTexture()
@@ -1561,6 +1773,45 @@ GlVisFont * GetFont() {
    return &glvis_font;
 }
 
+#ifndef __EMSCRIPTEN__
+// Returns the file of the first font that matches the fontconfig pattern, or
+// "" if there is none. Requires FcInit().
+static std::string FindFontFile(const char *font_pattern)
+{
+    FcPattern * pat = FcNameParse((FcChar8*)font_pattern);
+    if (!pat) {
+        return "";
+    }
+    FcObjectSet * os = FcObjectSetBuild(FC_FAMILY, FC_STYLE, FC_FILE, nullptr);
+    FcFontSet * fs = os ? FcFontList(0, pat, os) : nullptr;
+    FcPatternDestroy(pat);
+    if (os)
+        FcObjectSetDestroy(os);
+    if (!fs) {
+        return "";
+    }
+#ifdef GLVIS_DEBUG
+    if (fs->nfont > 1) {
+        cout << "Font pattern '" << font_pattern
+             << "' matched multiple fonts:\n";
+    }
+#endif
+    std::string font_file = "";
+    for (int fnt_idx = 0; fnt_idx < fs->nfont; fnt_idx++) {
+        FcChar8 * s;
+        FcResult res = FcPatternGetString(fs->fonts[fnt_idx], FC_FILE, 0, &s);
+        FcChar8 * fnt = FcNameUnparse(fs->fonts[fnt_idx]);
+        cout << fnt << endl;
+        if (res == FcResultMatch && s && font_file == "") {
+            font_file = (char*) s;
+        }
+        free(fnt);
+    }
+    FcFontSetDestroy(fs);
+    return font_file;
+}
+#endif
+
 bool SetFont(const char *font_patterns[], int num_patterns, int height) {
 #ifdef __EMSCRIPTEN__
     return glvis_font.LoadFont("OpenSans.ttf", height);
@@ -1569,59 +1820,39 @@ bool SetFont(const char *font_patterns[], int num_patterns, int height) {
         return false;
     }
 
-    FcObjectSet * os = FcObjectSetBuild(FC_FAMILY, FC_STYLE, FC_FILE, nullptr);
-
     for (int i = 0; i < num_patterns; i++) {
-        FcPattern * pat = FcNameParse((FcChar8*)font_patterns[i]);
-        if (!pat) {
-            continue;
-        }
-
-        FcFontSet * fs = FcFontList(0, pat, os);
-        if (!fs) {
-            FcPatternDestroy(pat);
-            continue;
-        }
-#ifdef GLVIS_DEBUG
-        if (fs->nfont > 1) {
-            cout << "Font pattern '" << font_patterns[i]
-                 << "' matched multiple fonts:\n";
-        }
-#endif
-        std::string font_file = "";
-        std::string font_name = "";
-        for (int fnt_idx = 0; fnt_idx < fs->nfont; fnt_idx++) {
-            FcChar8 * s;
-            FcResult res = FcPatternGetString(fs->fonts[fnt_idx], FC_FILE, 0, &s);
-            FcChar8 * fnt = FcNameUnparse(fs->fonts[fnt_idx]);
-            cout << fnt << endl;
-            if (res == FcResultMatch && s && font_file == "") {
-                font_file = (char*) s;
-                font_name = (char*) fnt;
-            }
-            free(fnt);
-        }
-        
-        FcFontSetDestroy(fs);
+        std::string font_file = FindFontFile(font_patterns[i]);
         if (font_file != "") {
             if (glvis_font.LoadFont(font_file.c_str(), height)) {
 #ifdef GLVIS_DEBUG
-                cout << "Using font: " << font_name << endl;
+                cout << "Using font: " << font_file << endl;
 #endif
                 break;
             }
         }
     }
 
-    if (os)
-        FcObjectSetDestroy(os);
-
     FcFini();
 
     return glvis_font.isFontLoaded();
 #endif
 }
 
+void ResolveFont()
+{
+#ifndef __EMSCRIPTEN__
+   if (priority_font != "" || !FcInit())
+   {
+      return;
+   }
+   for (int i = 0; i < num_font_patterns && priority_font == ""; i++)
+   {
+      priority_font = FindFontFile(fc_font_patterns[i]);
+   }
+   FcFini();
+#endif
+}
+
 void SetFont(const char *fn)
 {
    priority_font = fn;
@@ -24,9 +24,21 @@ extern GLuint fontbase;
 extern float MatAlpha;
 extern float MatAlphaCenter;
 
+/** Open the window hidden, compile the shaders, and load the palettes and
+    the font, so that the next InitVisualization() only shows the window. Used
+    by the warm workers of the server. */
+int WarmUpVisualization(int w, int h);
+
 /// Initializes the visualization and some keys.
 int InitVisualization(const char name[], int x, int y, int w, int h);
 
+/// Seconds of a steady clock, the same in all processes of the server.
+double GetSteadyTime();
+
+/** Print the time from 'start' (see GetSteadyTime()) to the end of the first
+    frame, e.g. to compare the cold and warm starts of the server sessions. */
+void SetFirstFrameTimer(double start, const char *kind);
+
 /// Start the infinite visualization loop.
 void SetVisualizationScene(VisualizationScene * scene,
                            int view = 3, const char *keys = NULL);
@@ -46,6 +58,9 @@ VisualizationScene * GetVisualizationScene();
 
 void AddIdleFunc(void (*Func)(void));
 void RemoveIdleFunc(void (*Func)(void));
+/** Add 'Func' to the idle functions when the main loop of the next
+    SetVisualizationScene() starts, e.g. to run a script without user input. */
+void SetStartupIdleFunc(void (*Func)(void));
 
 void LeftButtonDown  (EventInfo *event);
 void LeftButtonLoc   (EventInfo *event);
@@ -56,6 +71,8 @@ void MiddleButtonUp  (EventInfo *event);
 void RightButtonDown (EventInfo *event);
 void RightButtonLoc  (EventInfo *event);
 void RightButtonUp   (EventInfo *event);
+/// True while a mouse button is held down to change the view.
+bool MouseDragging();
 
 void KeyCtrlP();
 void KeyS();
@@ -63,6 +80,10 @@ void KeyQPressed();
 void ToggleThreads();
 void ThreadsPauseFunc(GLenum);
 void ThreadsStop();
+void HistoryPrevious();
+void HistoryNext();
+void HistoryFirst();
+void HistoryLast();
 void ThreadsRun();
 
 void Key1Pressed();
@@ -116,6 +137,20 @@ void Cone();
 extern int MySetColorLogscale;
 void MySetColor(gl3::GlBuilder& builder, double val);
 void MySetColor(gl3::GlBuilder& builder, double val, double min, double max);
+
+/// Color of a scalar value: the palette texture coordinates (value and alpha)
+/// used when UseTexture is set, and the RGBA color used otherwise.
+struct MappedColor
+{
+   float texcoord[2];
+   std::array<uint8_t, 4> rgba;
+};
+/** Map the n values 'vals' in [min,max] to colors, like n calls to
+    MySetColor(builder, vals[i], min, max) but using a precomputed palette
+    table. */
+void MySetColors(const double *vals, int n, double min, double max,
+                 MappedColor *colors);
+void MySetColor(gl3::GlBuilder& builder, const MappedColor &color);
 //float returned is alpha value
 float MySetColor (double val, float (&argb)[4]);
 float MySetColor (double val, double min, double max, float (&argb)[4]);
@@ -128,5 +163,8 @@ void InitFont();
 GlVisFont * GetFont();
 bool SetFont(const char *font_patterns[], int num_patterns, int height);
 void SetFont(const char *fn);
+/** Look up the default font file with fontconfig now, so that the windows
+    opened later, e.g. by the forked server sessions, skip the lookup. */
+void ResolveFont();
 
 #endif
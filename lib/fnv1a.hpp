@@ -0,0 +1,53 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_FNV1A
+#define GLVIS_FNV1A
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** Incremental 64-bit FNV-1a style hash. Whole 64-bit words are mixed at
+    once, with the tail hashed byte by byte. It is fast, but not collision
+    resistant: use it to detect changes, not to identify data on its own. */
+class Fnv1aHash
+{
+   uint64_t hash;
+
+public:
+   Fnv1aHash() : hash(14695981039346656037ULL) { }
+
+   void Add(const void *data, size_t bytes)
+   {
+      const uint64_t prime = 1099511628211ULL;
+      const char *p = (const char *) data;
+      for ( ; bytes >= sizeof(uint64_t); p += sizeof(uint64_t),
+           bytes -= sizeof(uint64_t))
+      {
+         uint64_t w;
+         memcpy(&w, p, sizeof(w));
+         hash = (hash ^ w) * prime;
+         hash ^= hash >> 32;
+      }
+      for ( ; bytes > 0; p++, bytes--)
+      {
+         hash = (hash ^ (unsigned char)(*p)) * prime;
+      }
+   }
+   void AddString(const char *str) { Add(str, strlen(str) + 1); }
+   template <typename T>
+   void Add(const T &value) { Add(&value, sizeof(T)); }
+
+   uint64_t Get() const { return hash; }
+};
+
+#endif
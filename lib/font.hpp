@@ -35,6 +35,7 @@ public:
 private:
     bool init;
     bool font_init;
+    int font_gen;
     glyph font_chars[256];
     float tex_w;
     float tex_h;
@@ -52,7 +53,8 @@ public:
 
     GlVisFont()
         : init(false)
-        , font_init(false) {
+        , font_init(false)
+        , font_gen(0) {
         if (FT_Init_FreeType(&library)) {
             cout << "GLVis: Can not initialize FreeType library!" << endl;
         }
@@ -66,6 +68,12 @@ public:
 
     bool isFontLoaded() { return font_init; }
 
+    /**
+     * Returns a counter incremented each time a new font is loaded, so that
+     * cached glyph layouts can be invalidated.
+     */
+    int getFontGeneration() { return font_gen; }
+
     float getAtlasWidth() { return tex_w; }
 
     float getAtlasHeight() { return tex_h; }
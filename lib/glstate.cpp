@@ -8,6 +8,9 @@ using std::endl;
 
 #ifdef __EMSCRIPTEN__
 const std::string _glsl_add = "precision mediump float;\n";
+// fwidth() in the fragment shaders, for the shader isolines
+const std::string _glsl_add_frag =
+    "#extension GL_OES_standard_derivatives : enable\n";
 #else
 const std::string _glsl_add = "#version GLSL_VER\n";
 #endif
@@ -17,6 +20,8 @@ enum ShaderFile {
     FS_CLIP_PLANE,
     VS_LIGHTING,
     FS_LIGHTING,
+    VS_PALETTE,
+    FS_PALETTE,
     VS_DEFAULT,
     FS_DEFAULT,
     VS_PRINTING,
@@ -33,6 +38,10 @@ const std::string shader_files[] = {
 ,
 #include "shaders/lighting.glsl"
 ,
+#include "shaders/palette.glsl"
+,
+#include "shaders/palette.glsl"
+,
 #include "shaders/default.vert"
 ,
 #include "shaders/default.frag"
@@ -60,6 +69,11 @@ GLuint compileShaderFile(GLenum shaderType, const std::string& shaderText, int g
         fmt_shader = std::regex_replace(fmt_shader, std::regex("texture2D"), "texture");
     }
     fmt_shader = _glsl_add + fmt_shader;
+#ifdef __EMSCRIPTEN__
+    if (shaderType == GL_FRAGMENT_SHADER) {
+        fmt_shader = _glsl_add_frag + fmt_shader;
+    }
+#endif
     fmt_shader = std::regex_replace(fmt_shader, std::regex("GLSL_VER"), std::to_string(glslVersion));
     int shader_len = fmt_shader.length();
     const char * shader_cstr = fmt_shader.c_str();
@@ -91,6 +105,13 @@ bool linkShaders(GLuint prgm, const GLuint (&shaders)[Count]) {
     glBindAttribLocation(prgm, GlState::ATTR_COLOR, "color");
     glBindAttribLocation(prgm, GlState::ATTR_TEXCOORD0, "texCoord0");
     glBindAttribLocation(prgm, GlState::ATTR_TEXCOORD1, "texCoord1");
+    glBindAttribLocation(prgm, GlState::ATTR_GLYPH_CORNER, "glyphCorner");
+    glBindAttribLocation(prgm, GlState::ATTR_ARROW_VERTEX, "arrowVertex");
+    glBindAttribLocation(prgm, GlState::ATTR_ARROW_VECTOR, "arrowVector");
+    glBindAttribLocation(prgm, GlState::ATTR_DISPLACEMENT, "displacement");
+    glBindAttribLocation(prgm, GlState::ATTR_SHRINK_CENTER, "shrinkCenter");
+    glBindAttribLocation(prgm, GlState::ATTR_SHRINK_ATTR_CENTER,
+                         "shrinkAttrCenter");
     for (int i = 0; i < Count; i++) {
         glAttachShader(prgm, shaders[i]);
     }
@@ -121,6 +142,7 @@ bool GlState::compileShaders() {
     } else if (GLEW_VERSION_2_0) {
         glsl_ver = 110;
     }
+    _use_instancing = GLEW_VERSION_3_3;
 #endif
     for (int i = 0; i < NUM_SHADERS; i++) {
         GLenum shader_type = (i % 2 == 0) ? GL_VERTEX_SHADER
@@ -134,6 +156,7 @@ bool GlState::compileShaders() {
         refshaders[VS_CLIP_PLANE],
         refshaders[VS_DEFAULT],
         refshaders[FS_LIGHTING],
+        refshaders[FS_PALETTE],
         refshaders[FS_CLIP_PLANE],
         refshaders[FS_DEFAULT]
     };
@@ -154,6 +177,7 @@ bool GlState::compileShaders() {
                                     GL_INTERLEAVED_ATTRIBS);
         GLuint print_pipeline[] = {
             refshaders[VS_LIGHTING],
+            refshaders[VS_PALETTE],
             refshaders[VS_PRINTING],
             refshaders[FS_PRINTING]
         };
@@ -205,6 +229,8 @@ void GlState::initShaderState(GLuint program) {
     GLuint locFontTex = glGetUniformLocation(program, "fontTex");
     glUniform1i(locColorTex, 0);
     glUniform1i(locFontTex, 1);
+    locPalette = glGetUniformLocation(program, "palette");
+    glUniform2fv(locPalette, 1, glm::value_ptr(_palette));
     // Set render type uniforms
     locContainsText = glGetUniformLocation(program, "containsText");
     locUseColorTex = glGetUniformLocation(program, "useColorTex");
@@ -218,6 +244,27 @@ void GlState::initShaderState(GLuint program) {
         glUniform1i(locContainsText, GL_TRUE);
         glUniform1i(locUseColorTex, GL_FALSE);
     }
+    // Set arrow glyph uniforms; the parameters are loaded by enableArrows()
+    locContainsArrows = glGetUniformLocation(program, "containsArrows");
+    locArrowLength = glGetUniformLocation(program, "arrowLength");
+    locArrowShape = glGetUniformLocation(program, "arrowShape");
+    locArrowScale = glGetUniformLocation(program, "arrowScale");
+    locArrowColorMap = glGetUniformLocation(program, "arrowColorMap");
+    locArrowAlpha = glGetUniformLocation(program, "arrowAlpha");
+    glUniform1i(locContainsArrows, GL_FALSE);
+    gl_arrows = false;
+    // Set isoline uniforms; the levels are loaded by enableIsolines()
+    locUseIsolines = glGetUniformLocation(program, "useIsolines");
+    locIsolines = glGetUniformLocation(program, "isolines");
+    glUniform1i(locUseIsolines, GL_FALSE);
+    glUniform4f(locIsolines, 0.f, 1.f, 0.f, 1.f);
+    gl_isolines = false;
+    // Set displacement uniforms
+    locDispScale = glGetUniformLocation(program, "displacementScale");
+    glUniform1f(locDispScale, _disp_scale);
+    // Set shrink uniforms
+    locShrinkFactors = glGetUniformLocation(program, "shrinkFactors");
+    glUniform3fv(locShrinkFactors, 1, glm::value_ptr(_shrink));
     // Set lighting uniforms
     glUniform1i(locNumLights, gl_lighting ? _num_lights : 0);
     glUniform4fv(locGlobalAmb, 1, _ambient);
@@ -94,12 +94,19 @@ public:
         ATTR_COLOR,
         ATTR_TEXCOORD0,
         ATTR_TEXCOORD1,
+        ATTR_GLYPH_CORNER,
+        ATTR_ARROW_VERTEX,
+        ATTR_ARROW_VECTOR,
+        ATTR_DISPLACEMENT,
+        ATTR_SHRINK_CENTER,
+        ATTR_SHRINK_ATTR_CENTER,
         NUM_ATTRS
     };
 
 protected:
     render_type _shaderMode;
     bool _render_feedback = false;
+    bool _use_instancing = false;
 
     GLuint default_program;
     GLuint feedback_program;
@@ -112,8 +119,13 @@ protected:
     bool gl_lighting = false,
          gl_depth_test = false,
          gl_blend = false,
-         gl_clip_plane = false;
+         gl_clip_plane = false,
+         gl_arrows = false,
+         gl_isolines = false;
     float _static_color[4];
+    float _disp_scale = 0.f;
+    glm::vec3 _shrink = glm::vec3(1.f, 1.f, 0.f);
+    glm::vec2 _palette = glm::vec2(0.5f, 1.f);
 
     static const int MAX_LIGHTS = 3;
     //cached uniforms
@@ -135,6 +147,12 @@ protected:
     GLuint locModelView, locProject, locProjectText, locNormal;
     GLuint locNumLights, locGlobalAmb;
     GLuint locPosition[MAX_LIGHTS], locDiffuse[MAX_LIGHTS], locSpecular[MAX_LIGHTS];
+    GLuint locContainsArrows, locArrowLength, locArrowShape, locArrowScale;
+    GLuint locArrowColorMap, locArrowAlpha;
+    GLuint locDispScale;
+    GLuint locShrinkFactors;
+    GLuint locPalette;
+    GLuint locUseIsolines, locIsolines;
 
     void initShaderState(GLuint program);
 public:
@@ -271,6 +289,47 @@ public:
             glVertexAttrib4fv(ATTR_COLOR, _static_color);
         } else if (attr == ATTR_NORMAL) {
             glVertexAttrib3f(ATTR_NORMAL, 0.f, 0.f, 1.f);
+        } else if (attr == ATTR_DISPLACEMENT) {
+            glVertexAttrib3f(ATTR_DISPLACEMENT, 0.f, 0.f, 0.f);
+        } else if (attr == ATTR_SHRINK_CENTER
+                   || attr == ATTR_SHRINK_ATTR_CENTER) {
+            glVertexAttrib4f(attr, 0.f, 0.f, 0.f, 1.f);
+        }
+    }
+
+    /**
+     * Sets the scale of the displacements of gl3::VertexDisp vertices.
+     */
+    void setDisplacementScale(float s) {
+        if (_disp_scale != s) {
+            _disp_scale = s;
+            glUniform1f(locDispScale, s);
+        }
+    }
+
+    /**
+     * Sets the factors by which the vertices with shrink centres (see
+     * GlDrawable::setShrinkCenters()) are moved towards the element and the
+     * attribute centres. With xy_only, the z coordinate is kept.
+     */
+    void setShrinkFactors(float s_elem, float s_attr, bool xy_only) {
+        glm::vec3 f(s_elem, s_attr, xy_only ? 1.f : 0.f);
+        if (_shrink != f) {
+            _shrink = f;
+            glUniform3fv(locShrinkFactors, 1, glm::value_ptr(f));
+        }
+    }
+
+    /**
+     * Selects the palette in the palette texture: 'row' is the texture
+     * coordinate of its row and 'repeat' the number of repetitions of the
+     * palette, negative to flip it.
+     */
+    void setPalette(float row, float repeat) {
+        glm::vec2 p(row, repeat);
+        if (_palette != p) {
+            _palette = p;
+            glUniform2fv(locPalette, 1, glm::value_ptr(p));
         }
     }
 
@@ -366,6 +425,52 @@ public:
         }
     }
 
+    /**
+     * Switches the vertex shader to instanced arrow glyphs (see
+     * gl3::ArrowBuffer): the glyph is placed, oriented and colored from the
+     * per-instance attributes using the given parameters.
+     */
+    void enableArrows(const float (&length)[4], const float (&shape)[2],
+                      const float (&scale)[3], const float (&color_map)[3],
+                      const float (&alpha)[2]) {
+        glUniform4fv(locArrowLength, 1, length);
+        glUniform2fv(locArrowShape, 1, shape);
+        glUniform3fv(locArrowScale, 1, scale);
+        glUniform3fv(locArrowColorMap, 1, color_map);
+        glUniform2fv(locArrowAlpha, 1, alpha);
+        if (!gl_arrows) {
+            glUniform1i(locContainsArrows, GL_TRUE);
+            gl_arrows = true;
+        }
+    }
+
+    void disableArrows() {
+        if (gl_arrows) {
+            glUniform1i(locContainsArrows, GL_FALSE);
+            gl_arrows = false;
+        }
+    }
+
+    /**
+     * Draws level lines in the fragment shader on geometry rendered with the
+     * color texture: 'count'+1 levels of palette coordinate first + i*step,
+     * 'width' pixels wide.
+     */
+    void enableIsolines(float first, float step, int count, float width) {
+        glUniform4f(locIsolines, first, step, (float)count, width);
+        if (!gl_isolines) {
+            glUniform1i(locUseIsolines, GL_TRUE);
+            gl_isolines = true;
+        }
+    }
+
+    void disableIsolines() {
+        if (gl_isolines) {
+            glUniform1i(locUseIsolines, GL_FALSE);
+            gl_isolines = false;
+        }
+    }
+
     /**
      * Prepares the shader pipeline for text rendering.
      */
@@ -431,6 +536,12 @@ public:
 
     render_type getRenderMode() { return _shaderMode; }
 
+    /**
+     * Returns true if instanced draw calls (glDrawArraysInstanced with
+     * per-instance attribute divisors) are available.
+     */
+    bool isInstancingSupported() { return _use_instancing; }
+
     bool isClipPlaneEnabled() { return gl_clip_plane; }
 };
 
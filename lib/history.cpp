@@ -0,0 +1,391 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "history.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+static size_t history_max_bytes = 0;
+static int history_bits = 32;
+
+void SetSolutionHistoryOptions(size_t max_bytes, int bits)
+{
+   history_max_bytes = max_bytes;
+   history_bits = bits;
+}
+
+// IEEE half precision conversions, rounding to nearest even
+static uint16_t FloatToHalf(float f)
+{
+   uint32_t x;
+   memcpy(&x, &f, sizeof(x));
+   const uint16_t sign = (x >> 16) & 0x8000;
+   x &= 0x7fffffff;
+   if (x >= 0x7f800000) // inf, nan
+   {
+      return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+   }
+   if (x >= 0x477ff000) // rounds to 65520 or more
+   {
+      return sign | 0x7c00;
+   }
+   uint32_t h, rem, half;
+   if (x >= 0x38800000) // normal half
+   {
+      h = (x - 0x38000000) >> 13;
+      rem = x & 0x1fff;
+      half = 0x1000;
+   }
+   else if (x >= 0x33000000) // subnormal half
+   {
+      const int shift = 126 - (int)(x >> 23);
+      const uint32_t m = (x & 0x7fffff) | 0x800000;
+      h = m >> shift;
+      rem = m & ((1u << shift) - 1);
+      half = 1u << (shift - 1);
+   }
+   else
+   {
+      return sign;
+   }
+   if (rem > half || (rem == half && (h & 1)))
+   {
+      h++;
+   }
+   return sign | (uint16_t) h;
+}
+
+static float HalfToFloat(uint16_t h)
+{
+   const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+   uint32_t e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+   if (e == 0x1f)
+   {
+      x = sign | 0x7f800000 | (m << 13);
+   }
+   else if (e != 0)
+   {
+      x = sign | ((e + 112) << 23) | (m << 13);
+   }
+   else if (m == 0)
+   {
+      x = sign;
+   }
+   else
+   {
+      for (e = 113; !(m & 0x400); e--)
+      {
+         m <<= 1;
+      }
+      x = sign | (e << 23) | ((m & 0x3ff) << 13);
+   }
+   float f;
+   memcpy(&f, &x, sizeof(f));
+   return f;
+}
+
+static void Encode(const double *v, int n, int bits, vector<uint8_t> &data)
+{
+   data.resize(size_t(n)*(bits/8));
+   uint8_t *p = data.data();
+   for (int i = 0; i < n; i++)
+   {
+      if (bits == 64)
+      {
+         memcpy(p + 8*i, v + i, 8);
+      }
+      else if (bits == 32)
+      {
+         const float f = (float) v[i];
+         memcpy(p + 4*i, &f, 4);
+      }
+      else
+      {
+         const uint16_t h = FloatToHalf((float) v[i]);
+         memcpy(p + 2*i, &h, 2);
+      }
+   }
+}
+
+static void Decode(const vector<uint8_t> &data, int bits, int n, double *v)
+{
+   const uint8_t *p = data.data();
+   for (int i = 0; i < n; i++)
+   {
+      if (bits == 64)
+      {
+         memcpy(v + i, p + 8*i, 8);
+      }
+      else if (bits == 32)
+      {
+         float f;
+         memcpy(&f, p + 4*i, 4);
+         v[i] = f;
+      }
+      else
+      {
+         uint16_t h;
+         memcpy(&h, p + 2*i, 2);
+         v[i] = HalfToFloat(h);
+      }
+   }
+}
+
+// Output buffer appending to a string, which fails once the string would
+// exceed a limit: printing a mesh larger than the history stops early
+class LimitedStringBuf : public streambuf
+{
+   string &str;
+   size_t limit;
+
+protected:
+   virtual int_type overflow(int_type c)
+   {
+      if (traits_type::eq_int_type(c, traits_type::eof()))
+      {
+         return traits_type::not_eof(c);
+      }
+      if (str.size() >= limit)
+      {
+         return traits_type::eof();
+      }
+      str.push_back(traits_type::to_char_type(c));
+      return c;
+   }
+
+   virtual streamsize xsputn(const char *s, streamsize n)
+   {
+      n = min(n, (streamsize)(limit - str.size()));
+      str.append(s, n);
+      return n;
+   }
+
+public:
+   LimitedStringBuf(string &_str, size_t _limit) : str(_str), limit(_limit) { }
+};
+
+// Print 'mesh' to 'text', unless its text is longer than 'limit' bytes
+static bool PrintMesh(Mesh &mesh, size_t limit, string &text)
+{
+   text.clear();
+   LimitedStringBuf buf(text, limit);
+   ostream os(&buf);
+   mesh.Print(os);
+   return os.good();
+}
+
+static void AppendElement(Element *el, vector<int> &topo)
+{
+   const int *v = el->GetVertices();
+   topo.push_back(el->GetAttribute());
+   topo.push_back(el->GetGeometryType());
+   topo.insert(topo.end(), v, v + el->GetNVertices());
+}
+
+// Collect the arrays that define 'mesh': the vertex and node coordinates in
+// 'coords', the sizes and the elements in 'topo', and the collection of the
+// nodes in 'nodes_fec'. Comparing them is much cheaper than printing the mesh.
+static void MeshArrays(Mesh &mesh, vector<double> &coords, vector<int> &topo,
+                       string &nodes_fec)
+{
+   static_assert(sizeof(Vertex) == 3*sizeof(double),
+                 "the mesh vertices are not packed (x,y,z) triples");
+   const int nv = mesh.GetNV();
+   coords.clear();
+   if (nv > 0)
+   {
+      coords.assign(mesh.GetVertex(0), mesh.GetVertex(0) + 3*nv);
+   }
+   topo.clear();
+   topo.push_back(mesh.Dimension());
+   topo.push_back(mesh.SpaceDimension());
+   topo.push_back(nv);
+   topo.push_back(mesh.GetNE());
+   topo.push_back(mesh.GetNBE());
+   for (int i = 0; i < mesh.GetNE(); i++)
+   {
+      AppendElement(mesh.GetElement(i), topo);
+   }
+   for (int i = 0; i < mesh.GetNBE(); i++)
+   {
+      AppendElement(mesh.GetBdrElement(i), topo);
+   }
+   nodes_fec.clear();
+   const GridFunction *nodes = mesh.GetNodes();
+   if (nodes)
+   {
+      nodes_fec = nodes->FESpace()->FEColl()->Name();
+      topo.push_back((int) nodes->FESpace()->GetOrdering());
+      coords.insert(coords.end(), nodes->GetData(),
+                    nodes->GetData() + nodes->Size());
+   }
+}
+
+template <typename T>
+static bool SameArray(const vector<T> &a, const vector<T> &b)
+{
+   return (a.size() == b.size() &&
+           (a.empty() || memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0));
+}
+
+SolutionHistory::SolutionHistory()
+   : current(-1), used(0), max_bytes(history_max_bytes), bits(history_bits),
+     shown_seg(NULL), shown_mesh(NULL), skip_reported(false),
+     size_reported(false), last_seg(NULL)
+{ }
+
+void SolutionHistory::Add(Mesh *mesh, const GridFunction &gf)
+{
+   if (max_bytes == 0)
+   {
+      return;
+   }
+   if (mesh->ncmesh || mesh->NURBSext)
+   {
+      if (!skip_reported)
+      {
+         cout << "History: nonconforming and NURBS meshes are not stored."
+              << endl;
+         skip_reported = true;
+      }
+      return;
+   }
+
+   Frame f;
+   if (!frames.empty() && mesh == shown_mesh &&
+       shown_seg == frames.back().seg.get())
+   {
+      // the mesh of the last frame is shown again
+      f.seg = frames.back().seg;
+   }
+   else
+   {
+      vector<double> coords;
+      vector<int> topo;
+      string nodes_fec;
+      MeshArrays(*mesh, coords, topo, nodes_fec);
+      if (!frames.empty() && last_seg == frames.back().seg.get() &&
+          SameArray(coords, last_coords) && SameArray(topo, last_topo) &&
+          nodes_fec == last_nodes_fec)
+      {
+         // streams send the mesh with every solution: share the copy of an
+         // unchanged one
+         f.seg = frames.back().seg;
+      }
+      else
+      {
+         string text;
+         if (!PrintMesh(*mesh, max_bytes, text))
+         {
+            if (!size_reported)
+            {
+               cout << "History: the mesh is larger than the memory limit, "
+                    "the solutions on it are not stored." << endl;
+               size_reported = true;
+            }
+            return;
+         }
+         f.seg = make_shared<Segment>();
+         f.seg->mesh_text.swap(text);
+         used += f.seg->mesh_text.size();
+         last_seg = f.seg.get();
+         last_coords.swap(coords);
+         last_topo.swap(topo);
+         last_nodes_fec.swap(nodes_fec);
+      }
+   }
+   const FiniteElementSpace *fes = gf.FESpace();
+   f.fec_name = fes->FEColl()->Name();
+   f.vdim = fes->GetVDim();
+   f.ordering = (int) fes->GetOrdering();
+   f.bits = bits;
+   f.size = gf.Size();
+   Encode(gf.GetData(), f.size, f.bits, f.data);
+   used += f.data.size();
+
+   frames.push_back(f);
+   current = Size() - 1;
+   shown_seg = f.seg.get();
+   shown_mesh = mesh;
+
+   while (used > max_bytes && frames.size() > 1)
+   {
+      DropOldest();
+   }
+}
+
+void SolutionHistory::DropOldest()
+{
+   Frame &f = frames.front();
+   used -= f.data.size();
+   if (f.seg.use_count() == 1)
+   {
+      used -= f.seg->mesh_text.size();
+      if (shown_seg == f.seg.get())
+      {
+         shown_seg = NULL;
+      }
+   }
+   frames.pop_front();
+   current = std::max(current - 1, 0);
+}
+
+bool SolutionHistory::Step(int step, Mesh *shown, bool fix_elem_orient,
+                           Mesh **mp, GridFunction **gp)
+{
+   if (frames.empty())
+   {
+      return false;
+   }
+   const int i = std::min(std::max(current + step, 0), Size() - 1);
+   if (i == current)
+   {
+      return false;
+   }
+
+   const Frame &f = frames[i];
+   Mesh *m = shown;
+   if (f.seg.get() != shown_seg || shown != shown_mesh)
+   {
+      istringstream is(f.seg->mesh_text);
+      m = new Mesh(is, 1, 0, fix_elem_orient);
+   }
+   FiniteElementCollection *fec =
+      FiniteElementCollection::New(f.fec_name.c_str());
+   FiniteElementSpace *fes = new FiniteElementSpace(m, fec, f.vdim,
+                                                    f.ordering);
+   GridFunction *g = new GridFunction(fes);
+   g->MakeOwner(fec);
+   if (g->Size() != f.size)
+   {
+      cout << "History: the stored solution does not match its mesh."
+           << endl;
+      delete g;
+      if (m != shown)
+      {
+         delete m;
+      }
+      return false;
+   }
+   Decode(f.data, f.bits, f.size, g->GetData());
+
+   current = i;
+   shown_seg = f.seg.get();
+   shown_mesh = m;
+   *mp = m;
+   *gp = g;
+   return true;
+}
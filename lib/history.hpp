@@ -0,0 +1,90 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_HISTORY
+#define GLVIS_HISTORY
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mfem.hpp"
+using namespace mfem;
+
+/** Set the memory limit of the solution history of streams, in bytes (0,
+    the default, disables the history), and the precision of the stored solutions: 64, 32
+    or 16 bits per value. */
+void SetSolutionHistoryOptions(size_t max_bytes, int bits);
+
+/** The most recent meshes and solutions received from a stream, so that the
+    user can step back and forth through them. Consecutive frames with the
+    same mesh share one serialized copy of it, and the solution of each frame
+    is stored as its vector of dofs, optionally in reduced precision. The
+    oldest frames are dropped when the memory limit is reached. */
+class SolutionHistory
+{
+public:
+   SolutionHistory();
+
+   /** Append the shown 'mesh' and solution 'gf', which become the current
+       frame. Nonconforming and NURBS meshes are not stored. */
+   void Add(Mesh *mesh, const GridFunction &gf);
+
+   /** Move the current frame by 'step', clamped to the stored frames, and
+       return its mesh and solution in 'mp' and 'gp'. If the frame uses the
+       mesh 'shown', the one from the last Add() or Step(), that mesh is
+       returned; otherwise the mesh is read from its stored copy. Returns
+       false if the current frame does not change. */
+   bool Step(int step, Mesh *shown, bool fix_elem_orient, Mesh **mp,
+             GridFunction **gp);
+
+   int Size() const { return (int) frames.size(); }
+   int Current() const { return current; }
+   size_t MemoryUsage() const { return used; }
+
+private:
+   struct Segment
+   {
+      std::string mesh_text;
+   };
+
+   struct Frame
+   {
+      std::shared_ptr<Segment> seg;
+      std::string fec_name;
+      int vdim, ordering;
+      int bits, size;
+      std::vector<uint8_t> data;
+   };
+
+   std::deque<Frame> frames;
+   int current;
+   size_t used, max_bytes;
+   int bits;
+
+   // the segment of the mesh that is shown, and that mesh
+   const Segment *shown_seg;
+   const Mesh *shown_mesh;
+   bool skip_reported, size_reported;
+
+   // the arrays of the mesh of the last stored segment, compared with the
+   // ones of each new mesh to share the segment of an unchanged mesh
+   const Segment *last_seg;
+   std::vector<double> last_coords;
+   std::vector<int> last_topo;
+   std::string last_nodes_fec;
+
+   void DropOldest();
+};
+
+#endif
@@ -0,0 +1,187 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "minmax.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+using namespace std;
+
+// Minimum number of points per thread, below which the threads cost more
+// than they save
+static const size_t MINMAX_GRAIN = 1 << 16;
+static const size_t MINMAX_MAX_THREADS = 8;
+
+void MinMaxBox::Reset()
+{
+   for (int c = 0; c < MAX_COMP; c++)
+   {
+      min[c] = numeric_limits<double>::infinity();
+      max[c] = -min[c];
+   }
+}
+
+void MinMaxBox::Merge(const MinMaxBox &b)
+{
+   for (int c = 0; c < MAX_COMP; c++)
+   {
+      min[c] = std::min(min[c], b.min[c]);
+      max[c] = std::max(max[c], b.max[c]);
+   }
+}
+
+// Consecutive points go to separate accumulators, so that consecutive min/max
+// operations do not depend on each other.
+template <int NC, bool FINITE>
+static void AddPoints(const double *data, size_t n, int stride,
+                      double *vmin, double *vmax)
+{
+   double lo[2][NC], hi[2][NC];
+   for (int l = 0; l < 2; l++)
+   {
+      for (int c = 0; c < NC; c++)
+      {
+         lo[l][c] = vmin[c];
+         hi[l][c] = vmax[c];
+      }
+   }
+   for (size_t j = 0; j < n; j++)
+   {
+      const int l = j % 2;
+      const double *p = data + j*stride;
+      for (int c = 0; c < NC; c++)
+      {
+         const double v = p[c];
+         // v - v is NaN for infinite and NaN values
+         const bool ok = !FINITE || (v - v == 0.0);
+         lo[l][c] = (ok && v < lo[l][c]) ? v : lo[l][c];
+         hi[l][c] = (ok && v > hi[l][c]) ? v : hi[l][c];
+      }
+   }
+   for (int c = 0; c < NC; c++)
+   {
+      vmin[c] = std::min(lo[0][c], lo[1][c]);
+      vmax[c] = std::max(hi[0][c], hi[1][c]);
+   }
+}
+
+template <int NC>
+static void AddPoints(const double *data, size_t n, int stride,
+                      bool finite_only, double *vmin, double *vmax)
+{
+   if (finite_only)
+   {
+      AddPoints<NC, true>(data, n, stride, vmin, vmax);
+   }
+   else
+   {
+      AddPoints<NC, false>(data, n, stride, vmin, vmax);
+   }
+}
+
+void MinMaxBox::Add(const double *data, size_t n, int ncomp, int stride,
+                    int first, bool finite_only)
+{
+   double *vmin = min + first, *vmax = max + first;
+   switch (ncomp)
+   {
+      case 1: AddPoints<1>(data, n, stride, finite_only, vmin, vmax); break;
+      case 2: AddPoints<2>(data, n, stride, finite_only, vmin, vmax); break;
+      case 3: AddPoints<3>(data, n, stride, finite_only, vmin, vmax); break;
+      case 4: AddPoints<4>(data, n, stride, finite_only, vmin, vmax); break;
+   }
+}
+
+// Number of threads for 'n' items, in chunks of at least 'grain' items
+static size_t NumThreads(size_t n, size_t grain)
+{
+#ifndef __EMSCRIPTEN__
+   size_t nthreads = std::min<size_t>(thread::hardware_concurrency(),
+                                      MINMAX_MAX_THREADS);
+   return std::min(nthreads, n / std::max<size_t>(grain, 1));
+#else
+   return 1;
+#endif
+}
+
+void ParallelFor(size_t n, size_t grain,
+                 const function<void(size_t, size_t)> &body)
+{
+#ifndef __EMSCRIPTEN__
+   const size_t nthreads = NumThreads(n, grain);
+   if (nthreads > 1)
+   {
+      vector<thread> threads;
+      size_t chunk = (n + nthreads - 1) / nthreads;
+      for (size_t t = 1; t < nthreads; t++)
+      {
+         size_t begin = std::min(n, t*chunk);
+         size_t end = std::min(n, begin + chunk);
+         threads.emplace_back(body, begin, end);
+      }
+      body(0, std::min(n, chunk));
+      for (size_t t = 0; t < threads.size(); t++)
+      {
+         threads[t].join();
+      }
+      return;
+   }
+#endif
+   body(0, n);
+}
+
+void ParallelMinMax(size_t n, size_t grain, MinMaxBox &box,
+                    const function<void(size_t, size_t, MinMaxBox &)> &body)
+{
+#ifndef __EMSCRIPTEN__
+   const size_t nthreads = NumThreads(n, grain);
+   if (nthreads > 1)
+   {
+      vector<MinMaxBox> boxes(nthreads);
+      vector<thread> threads;
+      size_t chunk = (n + nthreads - 1) / nthreads;
+      for (size_t t = 1; t < nthreads; t++)
+      {
+         size_t begin = std::min(n, t*chunk);
+         size_t end = std::min(n, begin + chunk);
+         threads.emplace_back(body, begin, end, ref(boxes[t]));
+      }
+      body(0, std::min(n, chunk), boxes[0]);
+      for (size_t t = 0; t < threads.size(); t++)
+      {
+         threads[t].join();
+      }
+      for (size_t t = 0; t < nthreads; t++)
+      {
+         box.Merge(boxes[t]);
+      }
+      return;
+   }
+#endif
+   body(0, n, box);
+}
+
+void MinMaxReduce(const double *data, size_t n, int ncomp, int stride,
+                  MinMaxBox &box, int first, bool finite_only)
+{
+   ParallelMinMax(n, MINMAX_GRAIN, box,
+                  [=](size_t begin, size_t end, MinMaxBox &b)
+   {
+      b.Add(data + begin*stride, end - begin, ncomp, stride, first,
+            finite_only);
+   });
+}
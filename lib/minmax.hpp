@@ -0,0 +1,60 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_MINMAX
+#define GLVIS_MINMAX
+
+#include <cstddef>
+#include <functional>
+
+/** Componentwise minimum and maximum of up to 4 components, e.g. the x, y
+    and z coordinates and the value, used for the bounding box and the value
+    range of the scenes. */
+class MinMaxBox
+{
+public:
+   static const int MAX_COMP = 4;
+   double min[MAX_COMP], max[MAX_COMP];
+
+   /// An empty box: +inf minimum and -inf maximum.
+   MinMaxBox() { Reset(); }
+
+   void Reset();
+   void Merge(const MinMaxBox &b);
+
+   /** Add the 'ncomp' components of 'n' points to the components 'first',
+       'first'+1, ... of the box. Point j starts at data[j*stride]. If
+       'finite_only', infinite and NaN components are skipped. The loops have
+       no branches, so that the compiler can use SIMD min/max instructions. */
+   void Add(const double *data, size_t n, int ncomp, int stride,
+            int first = 0, bool finite_only = false);
+};
+
+/** Split [0, n) into chunks of at least 'grain' items and call body(begin,
+    end) for each chunk in its own thread. The chunks must write to separate
+    data. Small ranges, and builds without threads, use the calling thread
+    only. */
+void ParallelFor(size_t n, size_t grain,
+                 const std::function<void(size_t, size_t)> &body);
+
+/** Split [0, n) into chunks of at least 'grain' items, call body(begin, end,
+    box) for each chunk with a box per thread, and merge the results into
+    'box'. Small ranges, and builds without threads, use the calling thread
+    only. */
+void ParallelMinMax(size_t n, size_t grain, MinMaxBox &box,
+                    const std::function<void(size_t, size_t, MinMaxBox &)>
+                    &body);
+
+/// Same as MinMaxBox::Add(), using several threads for large arrays.
+void MinMaxReduce(const double *data, size_t n, int ncomp, int stride,
+                  MinMaxBox &box, int first = 0, bool finite_only = false);
+
+#endif
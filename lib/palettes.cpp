@@ -1,13 +1,21 @@
 #include "palettes.hpp"
 #include "platform_gl.hpp"
+#include "glstate.hpp"
 
 #include <cstdio>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
+GlState * GetGlState(); // defined in aux_vis.cpp
+
 const int RGB_Palette_1_Size = 5;
 double RGB_Palette_1[RGB_Palette_1_Size][3] =
 {
@@ -4609,19 +4617,55 @@ void Init_Palettes()
 }
 
 bool first_init = true;
-GLuint palette_tex[Num_RGB_Palettes][2];
+GLuint palette_tex = 0;
 int curr_palette = 2;
 int use_smooth = 0;
 
+// Palettes loaded with paletteLoad(), numbered after the built-in ones
+vector<vector<double> > User_Palettes;
+vector<string> User_Palettes_Names;
+
+static int NumPalettes()
+{
+   return Num_RGB_Palettes + (int) User_Palettes.size();
+}
+
+static double *PaletteData(int pal)
+{
+   if (pal < Num_RGB_Palettes)
+   {
+      return RGB_Palettes[pal];
+   }
+   return User_Palettes[pal - Num_RGB_Palettes].data();
+}
+
+static int PaletteSize(int pal)
+{
+   if (pal < Num_RGB_Palettes)
+   {
+      return RGB_Palettes_Sizes[pal];
+   }
+   return (int) User_Palettes[pal - Num_RGB_Palettes].size() / 3;
+}
+
+static const char *PaletteName(int pal)
+{
+   if (pal < Num_RGB_Palettes)
+   {
+      return RGB_Palettes_Names[pal];
+   }
+   return User_Palettes_Names[pal - Num_RGB_Palettes].c_str();
+}
+
 int Select_New_RGB_Palette()
 {
    const int buflen = 256;
    char buffer[buflen];
    int pal;
    cout << "Choose a palette:\n";
-   for (pal = 0; pal < Num_RGB_Palettes; pal++)
+   for (pal = 0; pal < NumPalettes(); pal++)
    {
-      cout << setw(4) << pal+1 << ") " << RGB_Palettes_Names[pal];
+      cout << setw(4) << pal+1 << ") " << PaletteName(pal);
       if ((pal+1)%5 == 0)
       {
          cout << '\n';
@@ -4645,9 +4689,9 @@ int Select_New_RGB_Palette()
    {
       pal = 1;
    }
-   else if (pal > Num_RGB_Palettes)
+   else if (pal > NumPalettes())
    {
-      pal = Num_RGB_Palettes;
+      pal = NumPalettes();
    }
 
    paletteSet(pal-1);
@@ -4655,119 +4699,179 @@ int Select_New_RGB_Palette()
    return pal-1;
 }
 
-
-int RepeatPaletteTimes = 1;
-const size_t Max_Texture_Size = 4*1024;
-
-/* *
- * Generates a discrete texture from the given palette.
- */
-void _paletteToTextureDiscrete(double * palette, size_t plt_size, GLuint tex)
+bool paletteLoad(const char *filename)
 {
-   GLfloat * texture_buf = new GLfloat[4 * plt_size]; 
-
-   if (RepeatPaletteTimes > 0)
+   ifstream ifs(filename);
+   if (!ifs)
    {
-      for (size_t i = 0; i < plt_size; i++)
+      cout << "Can not open palette file: " << filename << endl;
+      return false;
+   }
+   vector<vector<double> > pals;
+   vector<string> names;
+   string line;
+   int line_no = 0;
+   while (getline(ifs, line))
+   {
+      line_no++;
+      istringstream iss(line);
+      string word;
+      if (!(iss >> word) || word[0] == '#')
       {
-         texture_buf[4*i] = palette[3*i];
-         texture_buf[4*i+1] = palette[3*i+1];
-         texture_buf[4*i+2] = palette[3*i+2];
-         texture_buf[4*i+3] = 1.0;
+         continue;
+      }
+      if (word == "palette")
+      {
+         string name;
+         iss >> ws;
+         getline(iss, name);
+         names.push_back(name);
+         pals.push_back(vector<double>());
+         continue;
+      }
+      double rgb[3];
+      istringstream color(line);
+      if (pals.empty() || !(color >> rgb[0] >> rgb[1] >> rgb[2]))
+      {
+         cout << "Invalid line " << line_no << " in palette file "
+              << filename << endl;
+         return false;
+      }
+      for (int k = 0; k < 3; k++)
+      {
+         pals.back().push_back(std::min(std::max(rgb[k], 0.0), 1.0));
       }
    }
-   else
+   for (size_t i = 0; i < pals.size(); i++)
    {
-      for (size_t i = 0; i < plt_size; i++)
+      if (pals[i].size() < 2*3)
       {
-         texture_buf[4*i+0] = palette[3*(plt_size-1-i)+0];
-         texture_buf[4*i+1] = palette[3*(plt_size-1-i)+1];
-         texture_buf[4*i+2] = palette[3*(plt_size-1-i)+2];
-         texture_buf[4*i+3] = 1.0;
+         cout << "Palette '" << names[i] << "' in " << filename
+              << " needs at least two colors" << endl;
+         return false;
       }
    }
-   glBindTexture(GL_TEXTURE_2D, tex);
-   glTexImage2D(GL_TEXTURE_2D,
-                0,
-                GL_RGBA,
-                plt_size,
-                1,
-                0,
-                GL_RGBA,
-                GL_FLOAT,
-                texture_buf);
+   for (size_t i = 0; i < pals.size(); i++)
+   {
+      User_Palettes.push_back(pals[i]);
+      // pad the names as the built-in ones for Select_New_RGB_Palette()
+      names[i].resize(std::max<size_t>(names[i].size(), 10), ' ');
+      User_Palettes_Names.push_back(names[i]);
+   }
+   cout << "Loaded " << pals.size() << " palette(s) from " << filename
+        << ", numbered from " << NumPalettes() - pals.size() + 1 << endl;
+   return true;
+}
 
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+int RepeatPaletteTimes = 1;
+const size_t Max_Texture_Size = 4*1024;
+
+/* *
+ * Fills a row of the palette texture with the discrete version of the given
+ * palette: each color covers 1/plt_size of the row.
+ */
+void _paletteToTextureDiscrete(double * palette, size_t plt_size,
+                               GLfloat * texture_buf)
+{
+    for (size_t i = 0; i < Max_Texture_Size; i++)
+    {
+        size_t j = i * plt_size / Max_Texture_Size;
+        texture_buf[4*i+0] = palette[3*j+0];
+        texture_buf[4*i+1] = palette[3*j+1];
+        texture_buf[4*i+2] = palette[3*j+2];
+        texture_buf[4*i+3] = 1.0;
+    }
 }
 
 /* *
- * Generates a smooth texture from the given palette.
+ * Fills a row of the palette texture with the smooth version of the given
+ * palette. The repetitions of RepeatPaletteTimes are applied by the shaders.
  */
-void _paletteToTextureSmooth(double * palette, size_t plt_size, GLuint tex)
+void _paletteToTextureSmooth(double * palette, size_t plt_size,
+                             GLfloat * texture_buf)
 {
-   int j;
-   double t;
-   int offset;
+    for (size_t i = 0; i < Max_Texture_Size; i++)
+    {
+        double t = double(i) / (Max_Texture_Size - 1);
+        t *= 0.999999999 * ( plt_size - 1 );
+        int j = (int) floor(t);
+        t -= j;
+        int offset = 3 * j;
 
-   size_t Texture_Size = Max_Texture_Size;
-   GLfloat texture_buf[4 * Texture_Size];
-   for (size_t i = 0; i < Texture_Size; i++)
-   {
-      t = double(i) / (Texture_Size - 1);
-      t *= 0.999999999 * ( plt_size - 1 ) * abs(RepeatPaletteTimes);
-      j = (int) floor(t);
-      t -= j;
+        texture_buf[4*i+0] = (1.0 - t) * palette[offset] + t * palette[offset + 3];
+        texture_buf[4*i+1] = (1.0 - t) * palette[offset + 1] + t * palette[offset + 4];
+        texture_buf[4*i+2] = (1.0 - t) * palette[offset + 2] + t * palette[offset + 5];
+        texture_buf[4*i+3] = 1.0;
+    }
+}
 
-      if (((j / (plt_size-1)) % 2 == 0 && RepeatPaletteTimes > 0) ||
-          ((j / (plt_size-1)) % 2 == 1 && RepeatPaletteTimes < 0))
-      {
-         offset = 3 * ( j % (plt_size-1) );
-      }
-      else
-      {
-         offset = 3 * ( (plt_size-2) - j % (plt_size-1) );
-         t = 1.0 - t;
-      }
+// Texels of the palette texture: row 2*i is the discrete and row 2*i+1 the
+// smooth version of palette i
+vector<GLfloat> palette_texels;
 
-      texture_buf[4*i+0] = (1.0 - t) * palette[offset] + t * palette[offset + 3];
-      texture_buf[4*i+1] = (1.0 - t) * palette[offset + 1] + t * palette[offset + 4];
-      texture_buf[4*i+2] = (1.0 - t) * palette[offset + 2] + t * palette[offset + 5];
-      texture_buf[4*i+3] = 1.0;
-   }
-   glBindTexture(GL_TEXTURE_2D, tex);
-   glTexImage2D(GL_TEXTURE_2D,
-                0,
-                GL_RGBA,
-                Texture_Size,
-                1,
-                0,
-                GL_RGBA,
-                GL_FLOAT,
-                texture_buf);
+void palettePrepare() {
+    if (first_init) {
+        Init_Palettes();
+        first_init = false;
+    }
+    const size_t row = 4 * Max_Texture_Size;
+    if (palette_texels.size() == 2 * NumPalettes() * row) {
+        return;
+    }
+    palette_texels.resize(2 * NumPalettes() * row);
+    for (int i = 0; i < NumPalettes(); i++) {
+        _paletteToTextureDiscrete(PaletteData(i), PaletteSize(i),
+                                  &palette_texels[2 * i * row]);
+        _paletteToTextureSmooth(PaletteData(i), PaletteSize(i),
+                                &palette_texels[(2 * i + 1) * row]);
+    }
+}
+
+/* *
+ * Uploads all palettes to the palette texture.
+ */
+void _paletteUpload() {
+    static int uploaded = 0;
+    if (uploaded == NumPalettes()) {
+        return;
+    }
+    uploaded = NumPalettes();
+
+    glBindTexture(GL_TEXTURE_2D, palette_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Max_Texture_Size, 2 * uploaded,
+                 0, GL_RGBA, GL_FLOAT, palette_texels.data());
 
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 }
 
+/* *
+ * Points the shaders to the row of the current palette. The discrete
+ * palettes are flipped but not repeated by RepeatPaletteTimes.
+ */
 void _paletteRebind() {
-    glBindTexture(GL_TEXTURE_2D, palette_tex[curr_palette][use_smooth]);
+    if (palette_tex == 0) {
+        // paletteInit() selects the row
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, palette_tex);
+    float row = (2 * curr_palette + use_smooth + 0.5f) / (2 * NumPalettes());
+    float repeat = RepeatPaletteTimes;
+    if (!use_smooth) {
+        repeat = (RepeatPaletteTimes > 0) ? 1.f : -1.f;
+    }
+    GetGlState()->setPalette(row, repeat);
 }
 
 void paletteInit() {
-    if (first_init) {
-        Init_Palettes();
-        first_init = false;
-    }
-    glGenTextures(Num_RGB_Palettes * 2, &(palette_tex[0][0]));
-    for (int i = 0; i < Num_RGB_Palettes; i++) {
-        _paletteToTextureDiscrete(RGB_Palettes[i], RGB_Palettes_Sizes[i], palette_tex[i][0]);
-        _paletteToTextureSmooth(RGB_Palettes[i], RGB_Palettes_Sizes[i], palette_tex[i][1]);
+    palettePrepare();
+    if (palette_tex == 0) {
+        glGenTextures(1, &palette_tex);
     }
+    _paletteUpload();
     _paletteRebind();
 }
 
@@ -4782,26 +4886,25 @@ void paletteUseSmooth() {
 }
 
 void paletteSet(int num) {
-    curr_palette = num;
+    curr_palette = std::max(0, std::min(num, NumPalettes() - 1));
     _paletteRebind();
 }
 
 double * paletteGet() {
-    return RGB_Palettes[curr_palette];
+    return PaletteData(curr_palette);
 }
 
 int paletteGetSize() {
-    return RGB_Palettes_Sizes[curr_palette];
+    return PaletteSize(curr_palette);
 }
 
 void Next_RGB_Palette()
 {
-   paletteSet((curr_palette + 1) % Num_RGB_Palettes);
+   paletteSet((curr_palette + 1) % NumPalettes());
 }
 
 void Prev_RGB_Palette()
 {
-   paletteSet((curr_palette == 0) ? Num_RGB_Palettes - 1 :
+   paletteSet((curr_palette == 0) ? NumPalettes() - 1 :
                curr_palette - 1);
 }
-
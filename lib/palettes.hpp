@@ -17,6 +17,12 @@
  * Initializes the palette textures.
  */
 void paletteInit();
+/**
+ * Computes the palettes and the texels of the palette texture, if they are
+ * not up to date. This needs no GL context, so that the server can do it
+ * once before forking the sessions, which then share the data.
+ */
+void palettePrepare();
 /**
  * Binds the discrete version of the current palette texture.
  */
@@ -34,6 +40,13 @@ void paletteSet(int num);
  */
 double * paletteGet();
 int paletteGetSize();
+/**
+ * Loads additional palettes from a file, numbered after the built-in ones.
+ * Each palette starts with a line "palette <name>", followed by one line
+ * "<r> <g> <b>" per color, with components in [0,1]. Lines starting with '#'
+ * are ignored. Returns false, loading no palettes, if the file is invalid.
+ */
+bool paletteLoad(const char *filename);
 
 void Next_RGB_Palette();
 void Prev_RGB_Palette();
@@ -52,7 +52,8 @@ SdlWindow::SdlWindow()
     , takeScreenshot(false) {
 }
 
-bool SdlWindow::createWindow(const char * title, int w, int h) {
+bool SdlWindow::createWindow(const char * title, int w, int h,
+                             bool hidden) {
     if (!SDL_WasInit(SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
         if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
             cerr << "Failed to initialize SDL: " << SDL_GetError() << endl;
@@ -81,7 +82,8 @@ bool SdlWindow::createWindow(const char * title, int w, int h) {
                                      h,
                                      SDL_WINDOW_OPENGL |
                                      SDL_WINDOW_ALLOW_HIGHDPI |
-                                     SDL_WINDOW_RESIZABLE);
+                                     SDL_WINDOW_RESIZABLE |
+                                     (hidden ? SDL_WINDOW_HIDDEN : 0));
 
     SDL_GLContext context = SDL_GL_CreateContext(_handle->hwnd);
     if (!context) {
@@ -340,6 +342,11 @@ void SdlWindow::setWindowPos(int x, int y) {
         SDL_SetWindowPosition(_handle->hwnd, x, y);
 }
 
+void SdlWindow::showWindow() {
+    if (_handle)
+        SDL_ShowWindow(_handle->hwnd);
+}
+
 void SdlWindow::signalKeyDown(SDL_Keycode k, SDL_Keymod m) {
     SDL_Event event;
     event.type = SDL_KEYDOWN;
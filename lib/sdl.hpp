@@ -61,10 +61,10 @@ public:
     ~SdlWindow();
 
     /**
-     * Creates a new OpenGL window.
+     * Creates a new OpenGL window, hidden until showWindow() if 'hidden'.
      * Returns false if SDL or OpenGL intialization fails.
      */
-    bool createWindow(const char * title, int w, int h);
+    bool createWindow(const char * title, int w, int h, bool hidden = false);
     /**
      * Runs the window loop.
      */
@@ -105,6 +105,7 @@ public:
     void setWindowTitle(const char* title);
     void setWindowSize(int w, int h);
     void setWindowPos(int x, int y);
+    void showWindow();
 
     void signalKeyDown(SDL_Keycode k, SDL_Keymod m = KMOD_NONE);
     void signalExpose() { requiresExpose = true; }
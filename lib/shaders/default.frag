@@ -3,7 +3,11 @@ uniform bool containsText;
 uniform bool useColorTex;
  
 uniform sampler2D fontTex; 
-uniform sampler2D colorTex;
+
+uniform bool useIsolines;
+// first level and spacing of the levels in palette coordinates, number of
+// level intervals, line width in pixels
+uniform vec4 isolines;
  
 varying vec3 fNormal; 
 varying vec3 fPosition; 
@@ -12,10 +16,32 @@ varying vec2 fTexCoord;
 
 void fragmentClipPlane();
 vec4 blinnPhong(in vec3 pos, in vec3 norm, in vec4 color);
+vec3 paletteColor(in float t);
+
+#if defined(GL_ES) && !defined(GL_OES_standard_derivatives)
+// without derivatives the lines have a fixed width in level units
+#define fwidth(x) 0.02
+#endif
+
+// Coverage of the fragment by the level lines, from the distance to the
+// nearest level in pixels, estimated with the screen-space derivative.
+float isolineCoverage(in float f, in float df)
+{
+    float nearest = floor(f + 0.5);
+    if (df <= 0.0 || nearest < 0.0 || nearest > isolines.z) {
+        return 0.0;
+    }
+    float dist = abs(f - nearest) / df;
+    return 1.0 - smoothstep(0.5 * isolines.w - 0.5, 0.5 * isolines.w + 0.5, dist);
+}
 
 void main() 
 {
     fragmentClipPlane();
+    // level coordinate of the palette value; the derivative is taken outside
+    // of the branches below
+    float level = (fTexCoord.x - isolines.x) / isolines.y;
+    float dlevel = fwidth(level);
     vec4 color;
     if (containsText) {
 
@@ -26,12 +52,16 @@ void main()
 #endif
     } else {
         if (useColorTex) {
-            color.xyz = texture2D(colorTex, vec2(fTexCoord.x, 0.0)).xyz;
+            color.xyz = paletteColor(fTexCoord.x);
             color.w = fTexCoord.y;
         } else {
             color = fColor; 
         }
         color = blinnPhong(fPosition, fNormal, color);
+        if (useColorTex && useIsolines) {
+            // level lines are drawn black, as Set_Black_Material() does
+            color.xyz *= 1.0 - isolineCoverage(level, dlevel);
+        }
     }
     gl_FragColor = color;
 }
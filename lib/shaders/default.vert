@@ -1,12 +1,20 @@
 R"(
 attribute vec3 vertex;
-attribute vec2 textVertex;
+attribute vec4 textVertex;
 attribute vec4 color;
 attribute vec3 normal;
 attribute vec2 texCoord0;
-attribute vec2 texCoord1;
+attribute vec3 texCoord1;
+attribute vec2 glyphCorner;
+attribute vec3 displacement;
+attribute vec4 shrinkCenter;
+attribute vec4 shrinkAttrCenter;
+attribute vec4 arrowVertex;
+attribute vec4 arrowVector;
 
 uniform bool containsText;
+uniform bool containsArrows;
+uniform bool useColorTex;
 
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
@@ -14,6 +22,18 @@ uniform mat4 textProjMatrix;
 uniform mat3 normalMatrix; 
  
 uniform vec4 clipPlane;
+uniform float displacementScale;
+// element and attribute shrink factors, 1 to keep the z coordinate
+uniform vec3 shrinkFactors;
+
+// arrow glyph length = max(x |v| + y value + z, w)
+uniform vec4 arrowLength;
+// cone scale, axial shift of the glyph
+uniform vec2 arrowShape;
+uniform vec3 arrowScale;
+// colormap range (min, max) and log scale flag
+uniform vec3 arrowColorMap;
+uniform vec2 arrowAlpha;
 
 varying vec3 fNormal; 
 varying vec3 fPosition; 
@@ -22,19 +42,98 @@ varying vec2 fTexCoord;
 
 void setupClipPlane(in float dist);
 
+// Moves a vertex towards the centre of its element and then towards the
+// centre of its attribute, as ShrinkPoints() does on the CPU. The w = 1 of
+// the default centres leaves the vertex in place.
+void shrinkVertex(inout vec3 objPos, inout vec3 objNormal)
+{
+    float s0 = mix(shrinkFactors.x, 1.0, shrinkCenter.w);
+    float s1 = mix(shrinkFactors.y, 1.0, shrinkAttrCenter.w);
+    vec3 p = mix(shrinkAttrCenter.xyz, mix(shrinkCenter.xyz, objPos, s0), s1);
+    if (shrinkFactors.z != 0.0) {
+        // the z coordinate holds the solution value
+        objPos.xy = p.xy;
+        objNormal.xy /= s0 * s1;
+    } else {
+        objPos = p;
+    }
+}
+
+// Places a vertex of the arrow glyph mesh for the instance at 'vertex' with
+// vector and value 'arrowVector', as VisualizationSceneScalarData::Arrow()
+// does on the CPU.
+void arrowGlyph(inout vec3 objPos, inout vec3 objNormal)
+{
+    vec3 v = arrowVector.xyz;
+    vec3 u = normalize(v);
+    float theta = (u.x == 0.0 && u.y == 0.0) ? 0.0 : atan(u.y, u.x);
+    float phi = acos(clamp(u.z, -1.0, 1.0));
+    mat3 rot = mat3(vec3(cos(theta) * cos(phi), sin(theta) * cos(phi), -sin(phi)),
+                    vec3(-sin(theta), cos(theta), 0.0),
+                    u);
+    float len = max(dot(arrowLength.xyz, vec3(length(v), arrowVector.w, 1.0)),
+                    arrowLength.w);
+    len /= length(u / arrowScale);
+    vec3 local = vec3(arrowVertex.xy * arrowShape.x,
+                      arrowVertex.w + arrowVertex.z * arrowShape.x + arrowShape.y);
+    objPos += (rot * (local * len)) / arrowScale;
+    objNormal = (rot * objNormal) * arrowScale;
+}
+
+// Palette coordinate and alpha of the arrow value, as MySetColor() computes
+// them on the CPU.
+vec2 arrowTexCoord()
+{
+    float vmin = arrowColorMap.x, vmax = arrowColorMap.y;
+    float t;
+    if (arrowColorMap.z != 0.0) {
+        float val = clamp(arrowVector.w, vmin, vmax);
+        t = log(abs(val / vmin)) / log(abs(vmax / vmin));
+    } else {
+        t = (arrowVector.w - vmin) / (vmax - vmin);
+    }
+    t = clamp(t, 0.0, 1.0);
+    float alpha = arrowAlpha.x;
+    if (alpha < 1.0) {
+        float center = arrowAlpha.y;
+        if (center > 1.0) {
+            alpha *= exp(-center * abs(t - 1.0));
+        } else if (center < 0.0) {
+            alpha *= exp((center - 1.0) * abs(t));
+        } else {
+            alpha *= exp(-abs(t - center));
+        }
+    }
+    return vec2(t, alpha);
+}
+
 void main() 
 { 
-    vec4 pos = modelViewMatrix * vec4(vertex, 1.0);
+    vec3 objPos = vertex;
+    vec3 objNormal = normal;
+    shrinkVertex(objPos, objNormal);
+    objPos += displacementScale * displacement;
+    fTexCoord = texCoord0.xy;
+    if (containsArrows) {
+        arrowGlyph(objPos, objNormal);
+        if (useColorTex) {
+            fTexCoord = arrowTexCoord();
+        }
+    }
+    vec4 pos = modelViewMatrix * vec4(objPos, 1.0);
     fPosition = pos.xyz; 
-    fNormal = normalize(normalMatrix * normal); 
+    fNormal = normalize(normalMatrix * objNormal); 
     fColor = color; 
-    fTexCoord = texCoord0.xy;
     setupClipPlane(dot(vec4(pos.xyz, 1.0), clipPlane));
     pos = projectionMatrix * pos;
     gl_Position = pos;
     if (containsText) {
-        vec4 textOffset = textProjMatrix * vec4(textVertex, 0.0, 0.0);
-        fTexCoord = texCoord1.xy;
+        // expand the glyph quad (x, y, w, h) from the current corner
+        vec2 glyphOffset = textVertex.xy
+                         + glyphCorner * vec2(textVertex.z, -textVertex.w);
+        vec4 textOffset = textProjMatrix * vec4(glyphOffset, 0.0, 0.0);
+        fTexCoord = vec2(mix(texCoord1.x, texCoord1.y, glyphCorner.x),
+                         texCoord1.z * glyphCorner.y);
         gl_Position += vec4((textOffset.xy * pos.w), -0.005, 0.0);
     }
 })"
@@ -0,0 +1,21 @@
+R"(
+uniform sampler2D colorTex;
+
+// texture coordinate of the row of the current palette in the palette
+// texture, and the number of palette repetitions (negative when the palette
+// is flipped)
+uniform vec2 palette;
+
+// Color of the palette coordinate t in [0,1]. Every other repetition of the
+// palette is mirrored, so that the colors are continuous.
+vec3 paletteColor(in float t)
+{
+    float u = t * abs(palette.y);
+    float cycle = floor(u);
+    u -= cycle;
+    if ((mod(cycle, 2.0) == 1.0) != (palette.y < 0.0)) {
+        u = 1.0 - u;
+    }
+    return texture2D(colorTex, vec2(u, palette.x)).xyz;
+}
+)"
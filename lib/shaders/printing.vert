@@ -1,10 +1,14 @@
 R"(
 attribute vec3 vertex;
-attribute vec2 textVertex;
+attribute vec4 textVertex;
 attribute vec4 color;
 attribute vec3 normal;
 attribute vec2 texCoord0;
-attribute vec2 texCoord1;
+attribute vec3 texCoord1;
+attribute vec2 glyphCorner;
+attribute vec3 displacement;
+attribute vec4 shrinkCenter;
+attribute vec4 shrinkAttrCenter;
 
 uniform bool containsText;
 uniform bool useColorTex;
@@ -15,20 +19,43 @@ uniform mat4 textProjMatrix;
 uniform mat3 normalMatrix; 
  
 uniform vec4 clipPlane;
+uniform float displacementScale;
+// element and attribute shrink factors, 1 to keep the z coordinate
+uniform vec3 shrinkFactors;
 
 varying vec4 fColor;
 varying float fClipCoord;
 
-uniform sampler2D colorTex;
-
 vec4 blinnPhong(in vec3 pos, in vec3 norm, in vec4 color);
+vec3 paletteColor(in float t);
+
+// Moves a vertex towards the centre of its element and then towards the
+// centre of its attribute, as ShrinkPoints() does on the CPU. The w = 1 of
+// the default centres leaves the vertex in place.
+void shrinkVertex(inout vec3 objPos, inout vec3 objNormal)
+{
+    float s0 = mix(shrinkFactors.x, 1.0, shrinkCenter.w);
+    float s1 = mix(shrinkFactors.y, 1.0, shrinkAttrCenter.w);
+    vec3 p = mix(shrinkAttrCenter.xyz, mix(shrinkCenter.xyz, objPos, s0), s1);
+    if (shrinkFactors.z != 0.0) {
+        // the z coordinate holds the solution value
+        objPos.xy = p.xy;
+        objNormal.xy /= s0 * s1;
+    } else {
+        objPos = p;
+    }
+}
  
 void main() 
 { 
-    vec4 pos = modelViewMatrix * vec4(vertex, 1.0);
-    vec3 eye_normal = normalize(normalMatrix * normal);
+    vec3 objPos = vertex;
+    vec3 objNormal = normal;
+    shrinkVertex(objPos, objNormal);
+    objPos += displacementScale * displacement;
+    vec4 pos = modelViewMatrix * vec4(objPos, 1.0);
+    vec3 eye_normal = normalize(normalMatrix * objNormal);
     if (useColorTex) {
-        fColor.xyz = texture2DLod(colorTex, vec2(texCoord0.x, 0.0), 0.0).xyz;
+        fColor.xyz = paletteColor(texCoord0.x);
         fColor.w = texCoord0.y;
     } else {
         fColor = color;
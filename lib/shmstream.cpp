@@ -0,0 +1,214 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "shmstream.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Prefix of the names of the shared memory objects that may be mapped, and
+// removed, on behalf of a client
+static const char SHM_PREFIX[] = "/glvis-";
+
+bool shmbuf::open(const char *name, size_t size)
+{
+   close();
+   if (strncmp(name, SHM_PREFIX, sizeof(SHM_PREFIX) - 1) ||
+       strchr(name + 1, '/') || size == 0)
+   {
+      return false;
+   }
+   int fd = shm_open(name, O_RDONLY, 0);
+   if (fd < 0)
+   {
+      return false;
+   }
+   // the object is used once: remove it also when it can not be mapped
+   shm_unlink(name);
+   struct stat st;
+   void *p = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && (size_t) st.st_size >= size)
+   {
+      p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+   }
+   ::close(fd);
+   if (p == MAP_FAILED)
+   {
+      return false;
+   }
+   madvise(p, size, MADV_SEQUENTIAL);
+   addr = (char *) p;
+   length = size;
+   setg(addr, addr, addr + length);
+   return true;
+}
+
+void shmbuf::close()
+{
+   if (addr)
+   {
+      munmap(addr, length);
+      addr = NULL;
+      length = 0;
+   }
+   setg(NULL, NULL, NULL);
+}
+
+shmbuf::pos_type shmbuf::seekoff(off_type off, ios_base::seekdir dir,
+                                 ios_base::openmode which)
+{
+   if (!addr || !(which & ios_base::in))
+   {
+      return pos_type(off_type(-1));
+   }
+   off_type pos = off;
+   if (dir == ios_base::cur)
+   {
+      pos += gptr() - eback();
+   }
+   else if (dir == ios_base::end)
+   {
+      pos += length;
+   }
+   if (pos < 0 || pos > (off_type) length)
+   {
+      return pos_type(off_type(-1));
+   }
+   setg(addr, addr + pos, addr + length);
+   return pos_type(pos);
+}
+
+shmbuf::pos_type shmbuf::seekpos(pos_type pos, ios_base::openmode which)
+{
+   return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+bool shmstream::open(const char *name, size_t size)
+{
+   if (!buf.open(name, size))
+   {
+      setstate(ios::failbit);
+      return false;
+   }
+   clear();
+   return true;
+}
+
+bool OpenSharedPayload(istream &is, shmstream &shm)
+{
+   string name;
+   size_t size = 0;
+   is >> name >> size;
+   if (!is)
+   {
+      cout << "Stream: invalid shared memory command." << endl;
+      return false;
+   }
+   if (!shm.open(name.c_str(), size))
+   {
+      cout << "Stream: can not map the shared memory object " << name
+           << " of " << size << " bytes." << endl;
+      return false;
+   }
+   return true;
+}
+
+istream &ReadCommand(istream &is, string &ident, shmstream &shm,
+                     bool allow_shm)
+{
+   // no white space is skipped after the command, which may have no
+   // arguments and be the last one for a while
+   is >> ident;
+   if (!is || ident != "shm")
+   {
+      return is;
+   }
+   ident.clear();
+   if (!allow_shm)
+   {
+      cout << "Stream: shared memory is only accepted from local clients."
+           << endl;
+      is.setstate(ios::failbit);
+      return is;
+   }
+   if (!OpenSharedPayload(is, shm))
+   {
+      shm.setstate(ios::failbit);
+      return shm;
+   }
+   shm >> ident >> ws;
+   if (ident == "shm" || ident == "parallel")
+   {
+      cout << "Stream: unexpected command in shared memory: " << ident
+           << endl;
+      shm.setstate(ios::failbit);
+   }
+   return shm;
+}
+
+GridFunction *LoadGridFunction(Mesh *mesh, istream &is)
+{
+   const istream::pos_type start = is.tellg();
+   if (start == istream::pos_type(-1))
+   {
+      // e.g. a socket: the values are in text
+      return new GridFunction(mesh, is);
+   }
+
+   string ident, fec_name;
+   int vdim = 0, ordering = -1;
+   is >> ws;
+   getline(is, ident); // 'FiniteElementSpace'
+   if (ident == "FiniteElementSpace")
+   {
+      is >> ident >> fec_name; // 'FiniteElementCollection:' and name
+      is >> ident >> vdim; // 'VDim:' and vdim
+      is >> ident >> ordering >> ws; // 'Ordering:' and value
+   }
+   size_t size = 0;
+   if (is && is.peek() == 'b')
+   {
+      is >> ident >> size; // 'binary_values' and size
+   }
+   if (!is || ident != "binary_values" || is.get() != '\n')
+   {
+      // the format of GridFunction::Save
+      is.clear();
+      is.seekg(start);
+      return new GridFunction(mesh, is);
+   }
+
+   FiniteElementCollection *fec =
+      FiniteElementCollection::New(fec_name.c_str());
+   FiniteElementSpace *fes =
+      new FiniteElementSpace(mesh, fec, vdim, ordering);
+   if ((size_t) fes->GetVSize() != size)
+   {
+      cout << "Stream: " << size << " binary values, expected "
+           << fes->GetVSize() << endl;
+      mfem_error("LoadGridFunction");
+   }
+   GridFunction *gf = new GridFunction(fes);
+   gf->MakeOwner(fec);
+   is.read((char *) gf->GetData(), size*sizeof(double));
+   if (!is)
+   {
+      mfem_error("LoadGridFunction: the binary values are incomplete");
+   }
+   return gf;
+}
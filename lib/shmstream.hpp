@@ -0,0 +1,83 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_SHMSTREAM
+#define GLVIS_SHMSTREAM
+
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+#include "mfem.hpp"
+using namespace mfem;
+
+/** Stream buffer over a POSIX shared memory object, mapped read-only. A
+    client on the same node writes its data to such an object and sends only
+    the command "shm <name> <size>" over its connection; the data is then
+    parsed straight from the mapping. Only the names starting with "/glvis-"
+    are accepted. */
+class shmbuf : public std::streambuf
+{
+public:
+   shmbuf() : addr(NULL), length(0) { }
+   ~shmbuf() { close(); }
+
+   /** Map the object 'name' of 'size' bytes and remove its name, so that it
+       is freed once it is unmapped. Returns false on errors. */
+   bool open(const char *name, size_t size);
+   void close();
+   bool is_open() const { return addr != NULL; }
+
+protected:
+   virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                            std::ios_base::openmode which);
+   virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+private:
+   char *addr;
+   size_t length;
+};
+
+class shmstream : public std::istream
+{
+public:
+   shmstream() : std::istream(&buf) { }
+
+   bool open(const char *name, size_t size);
+   void close() { buf.close(); }
+   shmbuf *rdbuf() { return &buf; }
+
+private:
+   shmbuf buf;
+};
+
+/** Read the "<name> <size>" of a "shm" command from 'is' and map the shared
+    memory object it names into 'shm'. Returns false, with a message, on
+    errors. */
+bool OpenSharedPayload(std::istream &is, shmstream &shm);
+
+/** Read the next command of a stream from 'is' into 'ident'. If it is a
+    "shm" command, map its object into 'shm', read the command at the start
+    of the object, e.g. "solution", and return 'shm' to read the data of the
+    command from; otherwise return 'is'. The "shm" command is rejected, and
+    'is' fails, unless 'allow_shm' is set: only the local clients of the Unix
+    domain socket, running as the same user, may send it. */
+std::istream &ReadCommand(std::istream &is, std::string &ident,
+                          shmstream &shm, bool allow_shm);
+
+/** Read a GridFunction on 'mesh' from 'is', as written by GridFunction::Save
+    or, in a seekable stream such as a shmstream, with its values given after
+    the header as "binary_values <size>", a new line and the values as native
+    doubles. The binary values are copied at once from the stream buffer. */
+GridFunction *LoadGridFunction(Mesh *mesh, std::istream &is);
+
+#endif
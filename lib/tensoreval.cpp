@@ -0,0 +1,389 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "tensoreval.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+// Upper bound on the number of cached (basis, points) tables
+static const size_t MAX_BASIS_TABLES = 64;
+
+// Element vertex of each lexicographically ordered linear "dof"
+static const int quad_vert_lex[4] = { 0, 1, 3, 2 };
+static const int hex_vert_lex[8] = { 0, 1, 3, 2, 4, 5, 7, 6 };
+
+TensorRefinedEval::~TensorRefinedEval()
+{
+   for (size_t k = 0; k < tables.size(); k++)
+   {
+      delete tables[k];
+   }
+}
+
+bool TensorRefinedEval::IsTensorElement(Mesh &mesh, int i)
+{
+   const int dim = mesh.Dimension();
+   const int geom = mesh.GetElementBaseGeometry(i);
+   return (mesh.SpaceDimension() == dim &&
+           ((dim == 2 && geom == Geometry::SQUARE) ||
+            (dim == 3 && geom == Geometry::CUBE)));
+}
+
+bool TensorRefinedEval::GetTensorPoints(int dim, const IntegrationRule &ir)
+{
+   // The refined points of SQUARE and CUBE are ordered with x fastest:
+   // ip(i0 + n*i1 + n*n*i2) = (p(i0), p(i1), p(i2))
+   const int npts = ir.GetNPoints();
+   const int n = (int) floor(pow(double(npts), 1.0/dim) + 0.5);
+   if (n < 1 || (dim == 2 ? n*n : n*n*n) != npts)
+   {
+      return false;
+   }
+   pts1d.SetSize(n);
+   for (int k = 0; k < n; k++)
+   {
+      pts1d(k) = ir.IntPoint(k).x;
+   }
+   for (int j = 0; j < npts; j++)
+   {
+      const IntegrationPoint &ip = ir.IntPoint(j);
+      if (ip.x != pts1d(j%n) || ip.y != pts1d((j/n)%n) ||
+          (dim == 3 && ip.z != pts1d(j/(n*n))))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+const TensorRefinedEval::BasisTables &TensorRefinedEval::GetTables(
+   const Poly_1D::Basis *basis, int ndof)
+{
+   const int nq = pts1d.Size();
+   for (size_t k = 0; k < tables.size(); k++)
+   {
+      BasisTables &t = *tables[k];
+      if (t.basis != basis || t.ndof != ndof || t.pts.Size() != nq)
+      {
+         continue;
+      }
+      int q = 0;
+      while (q < nq && t.pts(q) == pts1d(q)) { q++; }
+      if (q == nq)
+      {
+         return t;
+      }
+   }
+   if (tables.size() >= MAX_BASIS_TABLES)
+   {
+      for (size_t k = 0; k < tables.size(); k++)
+      {
+         delete tables[k];
+      }
+      tables.clear();
+   }
+
+   BasisTables *t = new BasisTables;
+   t->basis = basis;
+   t->ndof = ndof;
+   t->pts = pts1d;
+   t->B.SetSize(nq*ndof);
+   t->D.SetSize(nq*ndof);
+   Vector u(ndof), d(ndof);
+   for (int q = 0; q < nq; q++)
+   {
+      if (basis)
+      {
+         basis->Eval(pts1d(q), u, d);
+      }
+      else
+      {
+         u(0) = 1.0 - pts1d(q);  u(1) = pts1d(q);
+         d(0) = -1.0;            d(1) = 1.0;
+      }
+      for (int a = 0; a < ndof; a++)
+      {
+         t->B(q*ndof + a) = u(a);
+         t->D(q*ndof + a) = d(a);
+      }
+   }
+   tables.push_back(t);
+   return *t;
+}
+
+void TensorRefinedEval::Contract(int dim, const double *dofs,
+                                 const double *const A[], int nd, int nq,
+                                 double *out)
+{
+   // One direction at a time, x first. The intermediate results keep the
+   // remaining dof indices outermost, so that the innermost loops run over
+   // contiguous point indices.
+   tmp1.resize(nq*nd*nd);
+   for (int a = 0; a < nd*(dim == 2 ? 1 : nd); a++)
+   {
+      // tmp1(q0, a1[, a2]) = sum_a0 A0(q0, a0) dofs(a0, a1[, a2])
+      const double *u = dofs + a*nd;
+      double *t = &tmp1[a*nq];
+      for (int q0 = 0; q0 < nq; q0++)
+      {
+         const double *w = A[0] + q0*nd;
+         double s = 0.0;
+         for (int a0 = 0; a0 < nd; a0++)
+         {
+            s += w[a0]*u[a0];
+         }
+         t[q0] = s;
+      }
+   }
+   if (dim == 2)
+   {
+      // out(q0, q1) = sum_a1 A1(q1, a1) tmp1(q0, a1)
+      for (int q1 = 0; q1 < nq; q1++)
+      {
+         double *o = out + q1*nq;
+         for (int q0 = 0; q0 < nq; q0++) { o[q0] = 0.0; }
+         for (int a1 = 0; a1 < nd; a1++)
+         {
+            const double w = A[1][q1*nd + a1];
+            const double *t = &tmp1[a1*nq];
+            for (int q0 = 0; q0 < nq; q0++)
+            {
+               o[q0] += w*t[q0];
+            }
+         }
+      }
+      return;
+   }
+
+   // tmp2(q0, q1, a2) = sum_a1 A1(q1, a1) tmp1(q0, a1, a2)
+   tmp2.resize(nq*nq*nd);
+   for (int a2 = 0; a2 < nd; a2++)
+   {
+      for (int q1 = 0; q1 < nq; q1++)
+      {
+         double *o = &tmp2[(a2*nq + q1)*nq];
+         for (int q0 = 0; q0 < nq; q0++) { o[q0] = 0.0; }
+         for (int a1 = 0; a1 < nd; a1++)
+         {
+            const double w = A[1][q1*nd + a1];
+            const double *t = &tmp1[(a2*nd + a1)*nq];
+            for (int q0 = 0; q0 < nq; q0++)
+            {
+               o[q0] += w*t[q0];
+            }
+         }
+      }
+   }
+   // out(q0, q1, q2) = sum_a2 A2(q2, a2) tmp2(q0, q1, a2)
+   const int nq2 = nq*nq;
+   for (int q2 = 0; q2 < nq; q2++)
+   {
+      double *o = out + q2*nq2;
+      for (int m = 0; m < nq2; m++) { o[m] = 0.0; }
+      for (int a2 = 0; a2 < nd; a2++)
+      {
+         const double w = A[2][q2*nd + a2];
+         const double *t = &tmp2[a2*nq2];
+         for (int m = 0; m < nq2; m++)
+         {
+            o[m] += w*t[m];
+         }
+      }
+   }
+}
+
+const TensorRefinedEval::BasisTables *TensorRefinedEval::GetElementDofs(
+   const GridFunction &gf, int i, int comp, Vector &lex)
+{
+   const FiniteElementSpace *fes = gf.FESpace();
+   const FiniteElement *fe = fes->GetFE(i);
+   const TensorBasisElement *tfe = dynamic_cast<const TensorBasisElement *>(fe);
+   if (!tfe || fe->GetMapType() != FiniteElement::VALUE)
+   {
+      return NULL;
+   }
+   const int nd = fe->GetOrder() + 1;
+   const int ndof = fe->GetDof();
+   if (ndof != ((fe->GetDim() == 2) ? nd*nd : nd*nd*nd))
+   {
+      return NULL;
+   }
+
+   fes->GetElementVDofs(i, vdofs);
+   gf.GetSubVector(vdofs, loc_dofs);
+   const Array<int> &dof_map = tfe->GetDofMap();
+   const double *ld = loc_dofs.GetData() + comp*ndof;
+   lex.SetSize(ndof);
+   for (int k = 0; k < ndof; k++)
+   {
+      lex(k) = ld[dof_map.Size() ? dof_map[k] : k];
+   }
+   return &GetTables(&tfe->GetBasis1D(), nd);
+}
+
+bool TensorRefinedEval::EvalGeometry(Mesh &mesh, int i, DenseMatrix &tr,
+                                     DenseTensor *jac)
+{
+   const int dim = mesh.Dimension();
+   const int nq = pts1d.Size();
+   const int npts = (dim == 2) ? nq*nq : nq*nq*nq;
+   const GridFunction *nodes = mesh.GetNodes();
+   Array<int> vertices;
+   if (!nodes)
+   {
+      mesh.GetElementVertices(i, vertices);
+   }
+
+   tr.SetSize(dim, npts);
+   if (jac)
+   {
+      jac->SetSize(dim, dim, npts);
+   }
+   ref_vals.SetSize(npts);
+   for (int c = 0; c < dim; c++)
+   {
+      const BasisTables *t;
+      if (nodes)
+      {
+         if (!(t = GetElementDofs(*nodes, i, c, lex_dofs)))
+         {
+            return false;
+         }
+      }
+      else
+      {
+         const int *lex_map = (dim == 2) ? quad_vert_lex : hex_vert_lex;
+         lex_dofs.SetSize(vertices.Size());
+         for (int k = 0; k < vertices.Size(); k++)
+         {
+            lex_dofs(k) = mesh.GetVertex(vertices[lex_map[k]])[c];
+         }
+         t = &GetTables(NULL, 2);
+      }
+
+      const double *A[3] = { t->B.GetData(), t->B.GetData(), t->B.GetData() };
+      Contract(dim, lex_dofs.GetData(), A, t->ndof, nq, ref_vals.GetData());
+      for (int j = 0; j < npts; j++)
+      {
+         tr(c, j) = ref_vals(j);
+      }
+      if (!jac) { continue; }
+      for (int k = 0; k < dim; k++)
+      {
+         A[k] = t->D.GetData();
+         Contract(dim, lex_dofs.GetData(), A, t->ndof, nq, ref_vals.GetData());
+         A[k] = t->B.GetData();
+         for (int j = 0; j < npts; j++)
+         {
+            (*jac)(c, k, j) = ref_vals(j);
+         }
+      }
+   }
+   return true;
+}
+
+bool TensorRefinedEval::GetValues(const GridFunction &gf, int i,
+                                  const IntegrationRule &ir, Vector &vals,
+                                  DenseMatrix &tr)
+{
+   Mesh &mesh = *gf.FESpace()->GetMesh();
+   const int dim = mesh.Dimension();
+   if (gf.FESpace()->GetVDim() != 1 || !IsTensorElement(mesh, i) ||
+       !GetTensorPoints(dim, ir))
+   {
+      return false;
+   }
+   const BasisTables *t = GetElementDofs(gf, i, 0, lex_dofs);
+   if (!t)
+   {
+      return false;
+   }
+   Vector sol_dofs(lex_dofs);
+   if (!EvalGeometry(mesh, i, geom_tr, NULL))
+   {
+      return false;
+   }
+
+   const double *A[3] = { t->B.GetData(), t->B.GetData(), t->B.GetData() };
+   vals.SetSize(ir.GetNPoints());
+   Contract(dim, sol_dofs.GetData(), A, t->ndof, pts1d.Size(), vals.GetData());
+   tr = geom_tr;
+   return true;
+}
+
+bool TensorRefinedEval::GetGradients(const GridFunction &gf, int i,
+                                     const IntegrationRule &ir,
+                                     DenseMatrix &grad)
+{
+   Mesh &mesh = *gf.FESpace()->GetMesh();
+   const int dim = mesh.Dimension();
+   if (gf.FESpace()->GetVDim() != 1 || !IsTensorElement(mesh, i) ||
+       !GetTensorPoints(dim, ir))
+   {
+      return false;
+   }
+   const BasisTables *t = GetElementDofs(gf, i, 0, lex_dofs);
+   if (!t)
+   {
+      return false;
+   }
+   Vector sol_dofs(lex_dofs);
+   if (!EvalGeometry(mesh, i, geom_tr, &geom_jac))
+   {
+      return false;
+   }
+
+   // reference gradients, one direction at a time
+   const int npts = ir.GetNPoints();
+   Vector ref_grad(dim*npts);
+   const double *A[3] = { t->B.GetData(), t->B.GetData(), t->B.GetData() };
+   for (int k = 0; k < dim; k++)
+   {
+      A[k] = t->D.GetData();
+      Contract(dim, sol_dofs.GetData(), A, t->ndof, pts1d.Size(),
+               ref_grad.GetData() + k*npts);
+      A[k] = t->B.GetData();
+   }
+
+   // physical gradients: J^{-T} times the reference gradients
+   DenseMatrix adjJ(dim);
+   double g[3], gp[3];
+   grad.SetSize(dim, npts);
+   for (int j = 0; j < npts; j++)
+   {
+      DenseMatrix &J = geom_jac(j);
+      CalcAdjugate(J, adjJ);
+      const double det = J.Det();
+      for (int k = 0; k < dim; k++)
+      {
+         g[k] = ref_grad(k*npts + j);
+      }
+      adjJ.MultTranspose(g, gp);
+      for (int k = 0; k < dim; k++)
+      {
+         grad(k, j) = gp[k]/det;
+      }
+   }
+   return true;
+}
+
+bool TensorRefinedEval::GetJacobians(Mesh &mesh, int i,
+                                     const IntegrationRule &ir,
+                                     DenseMatrix &tr, DenseTensor &jac)
+{
+   if (!IsTensorElement(mesh, i) || !GetTensorPoints(mesh.Dimension(), ir))
+   {
+      return false;
+   }
+   return EvalGeometry(mesh, i, tr, &jac);
+}
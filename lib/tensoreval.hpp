@@ -0,0 +1,87 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_TENSOREVAL
+#define GLVIS_TENSOREVAL
+
+#include <vector>
+
+#include "mfem.hpp"
+using namespace mfem;
+
+/** Sum-factorized evaluation of scalar GridFunctions and of the mesh geometry
+    at the refined points of SQUARE and CUBE elements with tensor-product bases.
+    With n refined points and polynomial order p per direction, the values at
+    all n^d points cost O(d n p^d) instead of O(n^d p^d).
+
+    Each method returns false if the element, the mesh nodes or the
+    integration rule are not of tensor-product type; the caller then uses the
+    generic GridFunction / ElementTransformation path. */
+class TensorRefinedEval
+{
+public:
+   ~TensorRefinedEval();
+
+   /// Same as GridFunction::GetValues(i, ir, vals, tr) for a scalar 'gf'.
+   bool GetValues(const GridFunction &gf, int i, const IntegrationRule &ir,
+                  Vector &vals, DenseMatrix &tr);
+
+   /// Same as GridFunction::GetGradients(i, ir, grad) for a scalar 'gf'.
+   bool GetGradients(const GridFunction &gf, int i, const IntegrationRule &ir,
+                     DenseMatrix &grad);
+
+   /** Physical coordinates of the points of 'ir' in element i and the
+       Jacobians of the element transformation, jac(j) being the Jacobian at
+       point j. */
+   bool GetJacobians(Mesh &mesh, int i, const IntegrationRule &ir,
+                     DenseMatrix &tr, DenseTensor &jac);
+
+private:
+   // 1D basis functions (B) and their derivatives (D) at the 1D points, as
+   // row-major (number of points) x (number of dofs) tables. A NULL basis
+   // stands for the linear basis on the element vertices.
+   struct BasisTables
+   {
+      const Poly_1D::Basis *basis;
+      int ndof;
+      Vector pts, B, D;
+   };
+   std::vector<BasisTables *> tables;
+
+   Vector pts1d;
+   Vector lex_dofs, ref_vals;
+   std::vector<double> tmp1, tmp2;
+   Array<int> vdofs;
+   Vector loc_dofs;
+   DenseMatrix geom_tr;
+   DenseTensor geom_jac;
+
+   bool GetTensorPoints(int dim, const IntegrationRule &ir);
+   const BasisTables &GetTables(const Poly_1D::Basis *basis, int ndof);
+
+   /** Contract the lexicographically ordered 'dofs' with the 1D table 'A[k]'
+       in direction k, writing the values at the tensor points to 'out'. */
+   void Contract(int dim, const double *dofs, const double *const A[],
+                 int nd, int nq, double *out);
+
+   // Lexicographically ordered dofs of scalar 'gf' (component 'comp') in
+   // element i, or NULL if the element is not of tensor-product type.
+   const BasisTables *GetElementDofs(const GridFunction &gf, int i, int comp,
+                                     Vector &lex);
+
+   // Physical coordinates and, if 'jac' is not NULL, the Jacobians at the
+   // points set by GetTensorPoints().
+   bool EvalGeometry(Mesh &mesh, int i, DenseMatrix &tr, DenseTensor *jac);
+
+   static bool IsTensorElement(Mesh &mesh, int i);
+};
+
+#endif
@@ -0,0 +1,193 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "tesscache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#ifndef __EMSCRIPTEN__
+#include <unistd.h>    // close, getpid
+#include <fcntl.h>     // open
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat, mkdir
+#endif
+
+using namespace std;
+
+static string tess_cache_dir;
+
+// Bump when the vertex layouts or the format of GlDrawable::save() change
+static const uint32_t TESS_CACHE_VERSION = 4;
+
+struct TessCacheHeader
+{
+   char     magic[8];
+   uint32_t version;
+   uint32_t reserved;
+   uint64_t key;
+   uint64_t check;
+   uint64_t num_elements;
+   uint64_t num_values;
+   uint64_t payload;
+};
+
+static const char tess_cache_magic[8] = "GLVISTC";
+
+static inline uint64_t CheckMix(uint64_t h, uint64_t w)
+{
+   h ^= w * 0x9e3779b97f4a7c15ULL;
+   h = (h << 29) | (h >> 35);
+   return h * 0xbf58476d1ce4e5b9ULL;
+}
+
+void TessCacheKey::AddCheck(const void *data, size_t bytes)
+{
+   // multiply-rotate mixing, unrelated to the FNV hash, with the tail and the
+   // length mixed as a last word
+   const char *p = (const char *) data;
+   uint64_t w;
+   for ( ; bytes >= sizeof(w); p += sizeof(w), bytes -= sizeof(w))
+   {
+      memcpy(&w, p, sizeof(w));
+      check = CheckMix(check, w);
+   }
+   w = 0;
+   memcpy(&w, p, bytes);
+   check = CheckMix(check, w ^ ((uint64_t) bytes << 56));
+}
+
+void SetTessCacheDir(const string &dir)
+{
+   tess_cache_dir = dir;
+#ifndef __EMSCRIPTEN__
+   if (!dir.empty())
+   {
+      mkdir(dir.c_str(), 0777);
+   }
+#else
+   if (!dir.empty())
+   {
+      cout << "The tessellation cache is not available in this build." << endl;
+      tess_cache_dir.clear();
+   }
+#endif
+}
+
+bool TessCacheEnabled()
+{
+   return !tess_cache_dir.empty();
+}
+
+static string TessCachePath(const TessCacheKey &key)
+{
+   ostringstream path;
+   path << tess_cache_dir << '/' << hex << setfill('0') << setw(16)
+        << key.Get() << ".glvc";
+   return path.str();
+}
+
+bool TessCacheLoad(const TessCacheKey &key, gl3::GlDrawable &buf)
+{
+#ifndef __EMSCRIPTEN__
+   if (!TessCacheEnabled())
+   {
+      return false;
+   }
+   string path = TessCachePath(key);
+   int fd = open(path.c_str(), O_RDONLY);
+   if (fd < 0)
+   {
+      return false;
+   }
+   bool ok = false;
+   struct stat st;
+   if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(TessCacheHeader))
+   {
+      size_t size = st.st_size;
+      void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+      {
+         const char *data = (const char *) map;
+         TessCacheHeader hdr;
+         memcpy(&hdr, data, sizeof(hdr));
+         if (memcmp(hdr.magic, tess_cache_magic, sizeof(hdr.magic)) == 0 &&
+             hdr.version == TESS_CACHE_VERSION && hdr.key == key.Get() &&
+             hdr.check == key.GetCheck() &&
+             hdr.num_elements == key.GetNumElements() &&
+             hdr.num_values == key.GetNumValues() &&
+             hdr.payload == size - sizeof(hdr))
+         {
+            ok = buf.load(data + sizeof(hdr), hdr.payload);
+         }
+         munmap(map, size);
+      }
+   }
+   close(fd);
+   if (!ok)
+   {
+      cout << "Ignoring invalid tessellation cache file: " << path << endl;
+   }
+   return ok;
+#else
+   return false;
+#endif
+}
+
+void TessCacheSave(const TessCacheKey &key, const gl3::GlDrawable &buf)
+{
+#ifndef __EMSCRIPTEN__
+   if (!TessCacheEnabled())
+   {
+      return;
+   }
+   string path = TessCachePath(key);
+   // write to a temporary file and rename it, so that concurrent GLVis
+   // processes never see a partially written entry
+   ostringstream tmp_path;
+   tmp_path << path << '.' << getpid() << ".tmp";
+
+   ofstream ofs(tmp_path.str().c_str(), ios::binary);
+   if (!ofs)
+   {
+      cout << "Can not write to the tessellation cache directory "
+           << tess_cache_dir << ", disabling the cache." << endl;
+      tess_cache_dir.clear();
+      return;
+   }
+   TessCacheHeader hdr;
+   memcpy(hdr.magic, tess_cache_magic, sizeof(hdr.magic));
+   hdr.version = TESS_CACHE_VERSION;
+   hdr.reserved = 0;
+   hdr.key = key.Get();
+   hdr.check = key.GetCheck();
+   hdr.num_elements = key.GetNumElements();
+   hdr.num_values = key.GetNumValues();
+   hdr.payload = 0;
+   ofs.write((const char *) &hdr, sizeof(hdr));
+   bool ok = buf.save(ofs);
+   if (ok)
+   {
+      hdr.payload = (uint64_t) ofs.tellp() - sizeof(hdr);
+      ofs.seekp(0);
+      ofs.write((const char *) &hdr, sizeof(hdr));
+   }
+   ofs.close();
+   if (!ok || !ofs || rename(tmp_path.str().c_str(), path.c_str()) != 0)
+   {
+      remove(tmp_path.str().c_str());
+   }
+#endif
+}
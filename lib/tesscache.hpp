@@ -0,0 +1,68 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_TESSCACHE
+#define GLVIS_TESSCACHE
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "aux_gl3.hpp"
+#include "fnv1a.hpp"
+
+/** Key of everything a prepared drawable depends on: the mesh and solution
+    data, the refinement factors, the shading mode, etc. The FNV hash names the
+    cache file; a second, independent hash and the numbers of elements and
+    solution values are stored in the file and checked on load, so that a
+    collision of the first hash is not taken for a hit. */
+class TessCacheKey
+{
+   Fnv1aHash hash;
+   uint64_t check;
+   uint64_t num_elements, num_values;
+
+   void AddCheck(const void *data, size_t bytes);
+
+public:
+   TessCacheKey()
+      : check(0x243f6a8885a308d3ULL), num_elements(0), num_values(0) { }
+
+   void Add(const void *data, size_t bytes)
+   { hash.Add(data, bytes); AddCheck(data, bytes); }
+   void AddString(const char *str) { Add(str, strlen(str) + 1); }
+   template <typename T>
+   void Add(const T &value) { Add(&value, sizeof(T)); }
+
+   /// Set the sizes of the mesh and solution, also checked on load.
+   void SetCounts(uint64_t elements, uint64_t values)
+   { num_elements = elements; num_values = values; }
+
+   uint64_t Get() const { return hash.Get(); }
+   uint64_t GetCheck() const { return check; }
+   uint64_t GetNumElements() const { return num_elements; }
+   uint64_t GetNumValues() const { return num_values; }
+};
+
+/** Set the directory of the on-disk tessellation cache, creating it if needed.
+    An empty string disables the cache (the default). */
+void SetTessCacheDir(const std::string &dir);
+bool TessCacheEnabled();
+
+/** Load the drawable stored under the given key, uploading the vertex data
+    straight from the memory-mapped file. Returns false on a cache miss. */
+bool TessCacheLoad(const TessCacheKey &key, gl3::GlDrawable &buf);
+
+/// Store the vertex data of a freshly prepared drawable under the given key.
+void TessCacheSave(const TessCacheKey &key, const gl3::GlDrawable &buf);
+
+#endif
@@ -15,6 +15,7 @@
 #include <cstdio>      // perror
 #include "visual.hpp"
 #include "palettes.hpp"
+#include "shmstream.hpp"
 
 using namespace std;
 
@@ -49,6 +50,11 @@ GLVisCommand::GLVisCommand(
    command = NO_COMMAND;
 
    autopause = 0;
+
+   if (*grid_f)
+   {
+      history.Add(*mesh, **grid_f);
+   }
 }
 
 int GLVisCommand::lock()
@@ -397,6 +403,70 @@ int GLVisCommand::Autopause(const char *mode)
 
 extern GridFunction *ProjectVectorFEGridFunction(GridFunction*);
 
+bool GLVisCommand::ShowMeshAndSolution(Mesh *new_m, GridFunction *new_g,
+                                       double mesh_range)
+{
+   if (new_m->SpaceDimension() == (*mesh)->SpaceDimension() &&
+       new_g->VectorDim() == (*grid_f)->VectorDim())
+   {
+      if (new_m->SpaceDimension() == 2)
+      {
+         if (new_g->VectorDim() == 1)
+         {
+            VisualizationSceneSolution *vss =
+               dynamic_cast<VisualizationSceneSolution *>(*vs);
+            new_g->GetNodalValues(*sol);
+            vss->NewMeshAndSolution(new_m, sol, new_g);
+         }
+         else
+         {
+            VisualizationSceneVector *vsv =
+               dynamic_cast<VisualizationSceneVector *>(*vs);
+            vsv->NewMeshAndSolution(*new_g);
+         }
+      }
+      else
+      {
+         if (new_g->VectorDim() == 1)
+         {
+            VisualizationSceneSolution3d *vss =
+               dynamic_cast<VisualizationSceneSolution3d *>(*vs);
+            new_g->GetNodalValues(*sol);
+            vss->NewMeshAndSolution(new_m, sol, new_g);
+         }
+         else
+         {
+            new_g = ProjectVectorFEGridFunction(new_g);
+            VisualizationSceneVector3d *vss =
+               dynamic_cast<VisualizationSceneVector3d *>(*vs);
+            vss->NewMeshAndSolution(new_m, new_g);
+         }
+      }
+      if (mesh_range > 0.0)
+      {
+         (*vs)->SetValueRange(-mesh_range, mesh_range);
+      }
+      delete (*grid_f);
+      *grid_f = new_g;
+      // frames from the history may reuse the shown mesh
+      if (*mesh != new_m)
+      {
+         delete (*mesh);
+      }
+      *mesh = new_m;
+
+      (*vs)->Draw();
+      return true;
+   }
+   cout << "Stream: field type does not match!" << endl;
+   delete new_g;
+   if (new_m != *mesh)
+   {
+      delete new_m;
+   }
+   return false;
+}
+
 int GLVisCommand::Execute()
 {
    char c;
@@ -419,63 +489,15 @@ int GLVisCommand::Execute()
       case NEW_MESH_AND_SOLUTION:
       {
          double mesh_range = -1.0;
+         const bool record = (new_g != NULL);
          if (new_g == NULL)
          {
             SetMeshSolution(new_m, new_g, false);
             mesh_range = new_g->Max() + 1.0;
          }
-         if (new_m->SpaceDimension() == (*mesh)->SpaceDimension() &&
-             new_g->VectorDim() == (*grid_f)->VectorDim())
+         if (ShowMeshAndSolution(new_m, new_g, mesh_range) && record)
          {
-            if (new_m->SpaceDimension() == 2)
-            {
-               if (new_g->VectorDim() == 1)
-               {
-                  VisualizationSceneSolution *vss =
-                     dynamic_cast<VisualizationSceneSolution *>(*vs);
-                  new_g->GetNodalValues(*sol);
-                  vss->NewMeshAndSolution(new_m, sol, new_g);
-               }
-               else
-               {
-                  VisualizationSceneVector *vsv =
-                     dynamic_cast<VisualizationSceneVector *>(*vs);
-                  vsv->NewMeshAndSolution(*new_g);
-               }
-            }
-            else
-            {
-               if (new_g->VectorDim() == 1)
-               {
-                  VisualizationSceneSolution3d *vss =
-                     dynamic_cast<VisualizationSceneSolution3d *>(*vs);
-                  new_g->GetNodalValues(*sol);
-                  vss->NewMeshAndSolution(new_m, sol, new_g);
-               }
-               else
-               {
-                  new_g = ProjectVectorFEGridFunction(new_g);
-                  VisualizationSceneVector3d *vss =
-                     dynamic_cast<VisualizationSceneVector3d *>(*vs);
-                  vss->NewMeshAndSolution(new_m, new_g);
-               }
-            }
-            if (mesh_range > 0.0)
-            {
-               (*vs)->SetValueRange(-mesh_range, mesh_range);
-            }
-            delete (*grid_f);
-            *grid_f = new_g;
-            delete (*mesh);
-            *mesh = new_m;
-
-            (*vs)->Draw();
-         }
-         else
-         {
-            cout << "Stream: field type does not match!" << endl;
-            delete new_g;
-            delete new_m;
+            history.Add(*mesh, **grid_f);
          }
          if (autopause)
          {
@@ -739,6 +761,22 @@ void GLVisCommand::Terminate()
    pthread_mutex_unlock(&glvis_mutex);
 }
 
+void GLVisCommand::HistoryStep(int step)
+{
+   Mesh *new_m;
+   GridFunction *new_g;
+   if (!history.Step(step, *mesh, *fix_elem_orient, &new_m, &new_g))
+   {
+      return;
+   }
+   // keep the selected frame until the user resumes the stream
+   ThreadsStop();
+   cout << "History: frame " << history.Current() + 1 << " of "
+        << history.Size() << " (" << history.MemoryUsage()/1024 << " KB)"
+        << endl;
+   ShowMeshAndSolution(new_m, new_g, -1.0);
+}
+
 void GLVisCommand::ToggleAutopause()
 {
    autopause = autopause ? 0 : 1;
@@ -764,8 +802,9 @@ GLVisCommand::~GLVisCommand()
    pthread_mutex_destroy(&glvis_mutex);
 }
 
-communication_thread::communication_thread(Array<istream *> &_is)
-   : is(_is)
+communication_thread::communication_thread(Array<istream *> &_is,
+                                           bool _allow_shm)
+   : is(_is), allow_shm(_allow_shm)
 {
    new_m = NULL;
    new_g = NULL;
@@ -801,9 +840,19 @@ void *communication_thread::execute(void *p)
 
       _this->cancel_off();
 
-      *_this->is[0] >> _this->ident;
-      if (!(*_this->is[0]))
+      // the data of a command sent in shared memory is read from 'shm'
+      shmstream shm;
+      istream &in = ReadCommand(*_this->is[0], _this->ident, shm,
+                                _this->allow_shm);
+      if (!in)
+      {
+         break;
+      }
+      if (&in == &shm && _this->ident != "mesh" &&
+          _this->ident != "solution")
       {
+         cout << "Stream: unexpected command in shared memory: "
+              << _this->ident << endl;
          break;
       }
 
@@ -813,8 +862,8 @@ void *communication_thread::execute(void *p)
          bool fix_elem_orient = glvis_command->FixElementOrientations();
          if (_this->ident == "mesh")
          {
-            _this->new_m = new Mesh(*_this->is[0], 1, 0, fix_elem_orient);
-            if (!(*_this->is[0]))
+            _this->new_m = new Mesh(in, 1, 0, fix_elem_orient);
+            if (!in)
             {
                break;
             }
@@ -822,13 +871,13 @@ void *communication_thread::execute(void *p)
          }
          else if (_this->ident == "solution")
          {
-            _this->new_m = new Mesh(*_this->is[0], 1, 0, fix_elem_orient);
-            if (!(*_this->is[0]))
+            _this->new_m = new Mesh(in, 1, 0, fix_elem_orient);
+            if (!in)
             {
                break;
             }
-            _this->new_g = new GridFunction(_this->new_m, *_this->is[0]);
-            if (!(*_this->is[0]))
+            _this->new_g = LoadGridFunction(_this->new_m, in);
+            if (!in)
             {
                break;
             }
@@ -847,10 +896,13 @@ void *communication_thread::execute(void *p)
                cout << "connection[" << np << "]: parallel " << nproc << ' '
                     << proc << endl;
 #endif
-               isock >> _this->ident >> ws; // "solution"
+               shmstream proc_shm;
+               istream &proc_in = ReadCommand(isock, _this->ident, proc_shm,
+                                              _this->allow_shm);
+               proc_in >> ws; // "solution"
                mesh_array.SetSize(nproc);
                gf_array.SetSize(nproc);
-               mesh_array[proc] = new Mesh(isock, 1, 0, fix_elem_orient);
+               mesh_array[proc] = new Mesh(proc_in, 1, 0, fix_elem_orient);
                if (!keep_attr)
                {
                   // set element and boundary attributes to proc+1
@@ -863,7 +915,7 @@ void *communication_thread::execute(void *p)
                      mesh_array[proc]->GetBdrElement(i)->SetAttribute(proc+1);
                   }
                }
-               gf_array[proc] = new GridFunction(mesh_array[proc], isock);
+               gf_array[proc] = LoadGridFunction(mesh_array[proc], proc_in);
                np++;
                if (np == nproc)
                {
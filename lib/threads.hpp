@@ -13,6 +13,7 @@
 #define GLVIS_THREADS
 
 #include <pthread.h>
+#include "history.hpp"
 
 class GLVisCommand
 {
@@ -83,11 +84,17 @@ private:
 
    // internal variables
    int autopause;
+   SolutionHistory history;
 
    int lock();
    int signal();
    void unlock();
 
+   // Show a new mesh and solution, taking ownership of them. Returns false
+   // (and deletes them) if their type does not match the shown data.
+   bool ShowMeshAndSolution(Mesh *new_m, GridFunction *new_g,
+                            double mesh_range);
+
 public:
    // called by the main execution thread
    GLVisCommand(VisualizationSceneScalarData **_vs, Mesh **_mesh,
@@ -130,6 +137,10 @@ public:
 
    void ToggleAutopause();
 
+   // called by the main execution thread: show the frame 'step' frames
+   // after (or before, if negative) the current one in the history
+   void HistoryStep(int step);
+
    // called by the main execution thread
    ~GLVisCommand();
 };
@@ -141,6 +152,8 @@ class communication_thread
 private:
    // streams to read data from
    Array<std::istream *> &is;
+   // whether the streams may send their data in shared memory
+   bool allow_shm;
 
    // data that may be dynamically allocated by the thread
    Mesh *new_m;
@@ -163,7 +176,7 @@ private:
    static void *execute(void *);
 
 public:
-   communication_thread(Array<std::istream *> &_is);
+   communication_thread(Array<std::istream *> &_is, bool _allow_shm);
 
    ~communication_thread();
 };
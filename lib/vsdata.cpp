@@ -15,11 +15,13 @@
 #include <iomanip>
 #include <sstream>
 #include <limits>
+#include <unordered_map>
 using namespace std;
 
 #include "vsdata.hpp"
 #include "aux_vis.hpp"
 #include "material.hpp"
+#include "palettes.hpp"
 
 #include "gl2ps.h"
 
@@ -45,6 +47,144 @@ void VisualizationSceneScalarData::FixValueRange()
    }
 }
 
+const Table &VisualizationSceneScalarData::GetAttributeElements(bool bdr)
+{
+   Table *&attr_table = bdr ? bdr_attr_to_bel : attr_to_el;
+   if (!attr_table)
+   {
+      const int ne = bdr ? mesh->GetNBE() : mesh->GetNE();
+      Table el_to_attr;
+      el_to_attr.MakeI(ne);
+      for (int i = 0; i < ne; i++)
+      {
+         el_to_attr.AddAColumnInRow(i);
+      }
+      el_to_attr.MakeJ();
+      for (int i = 0; i < ne; i++)
+      {
+         const int attr = bdr ? mesh->GetBdrAttribute(i) : mesh->GetAttribute(i);
+         el_to_attr.AddConnection(i, attr-1);
+      }
+      el_to_attr.ShiftUpI();
+
+      attr_table = new Table;
+      Transpose(el_to_attr, *attr_table);
+   }
+   return *attr_table;
+}
+
+void VisualizationSceneScalarData::ResetAttributeTables()
+{
+   delete attr_to_el;
+   delete bdr_attr_to_bel;
+   attr_to_el = bdr_attr_to_bel = NULL;
+}
+
+extern GeometryRefiner GLVisGeometryRefiner;
+extern int RepeatPaletteTimes;
+
+static void HashVector(TessCacheKey &key, const Vector &v)
+{
+   key.Add(v.Size());
+   key.Add(v.GetData(), v.Size()*sizeof(double));
+}
+
+bool VisualizationSceneScalarData::InitTessCacheKey(
+   const char *name, const GridFunction *gf, TessCacheKey &key)
+{
+   if (!TessCacheEnabled())
+   {
+      return false;
+   }
+
+   if (!content_key_valid || content_key_gf != gf)
+   {
+      TessCacheKey ck;
+      const int sdim = mesh->SpaceDimension();
+      ck.Add(mesh->Dimension());
+      ck.Add(sdim);
+      ck.Add(mesh->GetNV());
+      for (int i = 0; i < mesh->GetNV(); i++)
+      {
+         ck.Add(mesh->GetVertex(i), sdim*sizeof(double));
+      }
+      for (int bdr = 0; bdr < 2; bdr++)
+      {
+         const int ne = bdr ? mesh->GetNBE() : mesh->GetNE();
+         ck.Add(ne);
+         for (int i = 0; i < ne; i++)
+         {
+            Element *el = bdr ? mesh->GetBdrElement(i) : mesh->GetElement(i);
+            ck.Add((int) el->GetGeometryType());
+            ck.Add(el->GetAttribute());
+            ck.Add(el->GetVertices(), el->GetNVertices()*sizeof(int));
+         }
+      }
+      const GridFunction *nodes = mesh->GetNodes();
+      const GridFunction *gfs[2] = { nodes, gf };
+      for (int k = 0; k < 2; k++)
+      {
+         ck.Add(gfs[k] != NULL);
+         if (gfs[k])
+         {
+            const FiniteElementSpace *fes = gfs[k]->FESpace();
+            ck.AddString(fes->FEColl()->Name());
+            ck.Add(fes->GetVDim());
+            ck.Add((int) fes->GetOrdering());
+            HashVector(ck, *gfs[k]);
+         }
+      }
+      HashVector(ck, *sol);
+      ck.SetCounts(mesh->GetNE(), sol->Size());
+
+      content_key = ck;
+      content_key_gf = gf;
+      content_key_valid = true;
+   }
+
+   key = content_key;
+   key.AddString(name);
+   key.Add(minv);
+   key.Add(maxv);
+   key.Add(logscale);
+   key.Add(MySetColorLogscale);
+   key.Add(x);
+   key.Add(y);
+   key.Add(z);
+   key.Add(shrink);
+   key.Add(shrinkmat);
+   key.Add(GLVisGeometryRefiner.GetType());
+   key.Add(GetUseTexture());
+   key.Add(MatAlpha);
+   key.Add(MatAlphaCenter);
+   key.Add(RepeatPaletteTimes);
+   key.Add(paletteGetSize());
+   key.Add(paletteGet(), 3*paletteGetSize()*sizeof(double));
+   return true;
+}
+
+int VisualizationSceneScalarData::GetRefinedEdgeLocalIndex(
+   int geom, const IntegrationPoint &ip1, const IntegrationPoint &ip2)
+{
+   const double eps = 1e-12;
+   // refined edges do not cross the element edges, so the midpoint decides
+   const double x = 0.5*(ip1.x + ip2.x), y = 0.5*(ip1.y + ip2.y);
+   if (geom == Geometry::TRIANGLE)
+   {
+      if (fabs(y) < eps) { return 0; }
+      if (fabs(x + y - 1.0) < eps) { return 1; }
+      if (fabs(x) < eps) { return 2; }
+   }
+   else if (geom == Geometry::SQUARE)
+   {
+      if (fabs(y) < eps) { return 0; }
+      if (fabs(x - 1.0) < eps) { return 1; }
+      if (fabs(y - 1.0) < eps) { return 2; }
+      if (fabs(x) < eps) { return 3; }
+   }
+   return -1;
+}
+
 void VisualizationSceneScalarData::DoAutoscale(bool prepare)
 {
    if (autoscale == 1)
@@ -175,6 +315,133 @@ void VisualizationSceneScalarData::Arrow2(double px, double py, double pz,
 
 }
 
+void VisualizationSceneScalarData::DecimateArrows(
+   vector<ArrowSample> &arrows, int dim)
+{
+   if (arrow_decimation == 0 || arrows.empty())
+   {
+      return;
+   }
+   const double bb_min[3] = { x[0], y[0], z[0] };
+   const double bb_size[3] = { x[1]-x[0], y[1]-y[0], z[1]-z[0] };
+   double h = 0.0;
+   for (int d = 0; d < dim; d++)
+   {
+      h = max(h, bb_size[d]);
+   }
+   h *= arrow_spacing;
+   if (h <= 0.0)
+   {
+      return;
+   }
+
+   // spatial hash of the occupied cells: cell -> index of its representative,
+   // stored in place at the front of 'arrows'
+   unordered_map<uint64_t, size_t> cells;
+   vector<int> count;
+   size_t n = 0;
+   for (size_t i = 0; i < arrows.size(); i++)
+   {
+      const ArrowSample &a = arrows[i];
+      uint64_t key = 0;
+      for (int d = 0; d < dim; d++)
+      {
+         // 21 bits per direction suffice for cells not smaller than 1e-6 of
+         // the bounding box
+         long long c = (long long) floor((a.pos[d] - bb_min[d])/h);
+         key = (key << 21) | (uint64_t)(max(c, 0LL) & 0x1FFFFF);
+      }
+      auto it = cells.find(key);
+      if (it == cells.end())
+      {
+         cells[key] = n;
+         arrows[n++] = a;
+         count.push_back(1);
+         continue;
+      }
+      ArrowSample &rep = arrows[it->second];
+      if (arrow_decimation == 1)
+      {
+         double a2 = a.vec[0]*a.vec[0] + a.vec[1]*a.vec[1] + a.vec[2]*a.vec[2];
+         double r2 = (rep.vec[0]*rep.vec[0] + rep.vec[1]*rep.vec[1] +
+                      rep.vec[2]*rep.vec[2]);
+         if (a2 > r2)
+         {
+            rep = a;
+         }
+      }
+      else
+      {
+         for (int d = 0; d < 3; d++)
+         {
+            rep.pos[d] += a.pos[d];
+            rep.vec[d] += a.vec[d];
+         }
+         rep.val += a.val;
+         count[it->second]++;
+      }
+   }
+   arrows.resize(n);
+
+   if (arrow_decimation == 2)
+   {
+      for (size_t i = 0; i < n; i++)
+      {
+         double s = 1.0/count[i];
+         for (int d = 0; d < 3; d++)
+         {
+            arrows[i].pos[d] *= s;
+            arrows[i].vec[d] *= s;
+         }
+         arrows[i].val *= s;
+      }
+   }
+}
+
+void VisualizationSceneScalarData::SetArrowDecimation()
+{
+   const char *modes[] = { "off", "longest arrow per cell",
+                           "average arrow per cell"
+                         };
+   cout << "Arrow decimation modes:\n";
+   for (int i = 0; i < 3; i++)
+   {
+      cout << "   " << i << " - " << modes[i] << '\n';
+   }
+   cout << "New arrow decimation mode: " << flush;
+   int mode;
+   cin >> mode;
+   if (!cin || mode < 0 || mode > 2)
+   {
+      cin.clear();
+      cout << "Invalid arrow decimation mode." << endl;
+      return;
+   }
+   arrow_decimation = mode;
+   if (arrow_decimation)
+   {
+      cout << "Cell size, relative to the size of the bounding box ["
+           << arrow_spacing << "]: " << flush;
+      double spacing;
+      cin >> spacing;
+      if (cin && spacing >= 1e-6 && spacing <= 1.0)
+      {
+         arrow_spacing = spacing;
+      }
+      else
+      {
+         cin.clear();
+         cout << "Invalid cell size, keeping " << arrow_spacing << endl;
+      }
+   }
+   cout << "Arrow decimation: " << modes[arrow_decimation];
+   if (arrow_decimation)
+   {
+      cout << ", cell size = " << arrow_spacing;
+   }
+   cout << endl;
+}
+
 void VisualizationSceneScalarData::Arrow(gl3::GlBuilder& builder,
                                          double px, double py, double pz,
                                          double vx, double vy, double vz,
@@ -827,7 +1094,6 @@ static void KeyF5Pressed()
    SendExposeEvent();
 }
 
-extern int RepeatPaletteTimes;
 void KeyF6Pressed()
 {
    cout << "Palette is repeated " << RepeatPaletteTimes << " times.\n"
@@ -1172,11 +1438,16 @@ void VisualizationSceneScalarData::Init()
    wnd = GetAppWindow(); 
 
    arrow_type = arrow_scaling_type = 0;
+   arrow_decimation = 0;
+   arrow_spacing = 0.025;
+   shader_isolines = false;
    scaling = 0;
    light   = 1;
    drawaxes = colorbar = 0;
    auto_ref_max = 16;
    auto_ref_max_surf_elem = 20000;
+   auto_ref_tri_budget = auto_ref_tri_estimate = 0;
+   auto_ref_budget_factor = 0;
    minv = 0.0;
    maxv = 1.0;
    logscale = false;
@@ -1271,6 +1542,7 @@ void VisualizationSceneScalarData::Init()
 
 VisualizationSceneScalarData::~VisualizationSceneScalarData()
 {
+   ResetAttributeTables();
    delete CuttingPlane;
 }
 
@@ -1484,6 +1756,8 @@ void VisualizationSceneScalarData::SetLevelLines (
    }
 
    nl = n;
+   level_first = (maxv > minv) ? (min - minv) / (maxv - minv) : 0.0;
+   level_step = (maxv > minv) ? (max - min) / (n * (maxv - minv)) : 1.0;
    level.SetSize(nl+1);
    for (i = 0; i <= nl; i++)
    {
@@ -1507,6 +1781,31 @@ void VisualizationSceneScalarData::SetLevelLines (
    }
 }
 
+bool VisualizationSceneScalarData::ShaderIsolines()
+{
+   return shader_isolines && GetUseTexture() && !print;
+}
+
+void VisualizationSceneScalarData::ToggleShaderIsolines()
+{
+   shader_isolines = !shader_isolines;
+   cout << "Level lines drawn by the shader: "
+        << strings_off_on[shader_isolines ? 1 : 0] << endl;
+   if (shader_isolines && !GetUseTexture())
+   {
+      // the shader needs the palette coordinate of the surface
+      SetUseTexture(1);
+      EventUpdateColors();
+   }
+   UpdateLevelLines();
+}
+
+void VisualizationSceneScalarData::EnableShaderIsolines()
+{
+   // with a log scale the levels are uniform in the palette coordinate too
+   gl->enableIsolines(level_first, level_step, nl, Get_LineWidth());
+}
+
 void VisualizationSceneScalarData::PrintState()
 {
    cout << "\nlight " << strings_off_on[light ? 1 : 0]
@@ -1525,6 +1824,33 @@ void VisualizationSceneScalarData::PrintState()
         << '\n' << endl;
    cam.Print();
    cout.flags(fmt);
+   if (auto_ref_tri_budget > 0)
+   {
+      cout << "triangle budget " << auto_ref_tri_budget
+           << "\n  subdivision factor " << auto_ref_budget_factor
+           << "\n  estimated triangles " << auto_ref_tri_estimate
+           << "\n  drawn triangles " << GetTriangleCount() << '\n' << endl;
+   }
+}
+
+int VisualizationSceneScalarData::GetBudgetRefineFactor()
+{
+   double tris = EstimateTriangleCount();
+   int ref = 1;
+   while (ref < auto_ref_max &&
+          tris*(ref+1)*(ref+1) <= (double) auto_ref_tri_budget)
+   {
+      ref++;
+   }
+   auto_ref_budget_factor = ref;
+   auto_ref_tri_estimate = (long long)(tris*ref*ref);
+   if (auto_ref_tri_estimate > auto_ref_tri_budget)
+   {
+      cout << "Estimated " << auto_ref_tri_estimate << " triangles without "
+           << "subdivision, over the budget of " << auto_ref_tri_budget
+           << endl;
+   }
+   return ref;
 }
 
 void VisualizationSceneScalarData::ShrinkPoints(DenseMatrix &pointmat,
@@ -1593,6 +1919,78 @@ void VisualizationSceneScalarData::ShrinkPoints(DenseMatrix &pointmat,
    }
 }
 
+void VisualizationSceneScalarData::SetShrinkCenters(
+   gl3::GlDrawable &buf, const DenseMatrix &pointmat, int i, int fn, int di,
+   bool elem_shrink)
+{
+   if (shrink == 1.0 && shrinkmat == 1.0)
+   {
+      return;
+   }
+
+   int dim = mesh->Dimension();
+   int sdim = mesh->SpaceDimension();
+   // a w = 1 disables the shrink towards the center
+   std::array<float, 4> elem_c = {{ 0.f, 0.f, 0.f, 1.f }};
+   std::array<float, 4> attr_c = {{ 0.f, 0.f, 0.f, 0.f }};
+
+   if (elem_shrink)
+   {
+      if (dim == 2)
+      {
+         for (int d = 0; d < sdim; d++)
+         {
+            double cd = 0.0;
+            for (int k = 0; k < pointmat.Width(); k++)
+            {
+               cd += pointmat(d,k);
+            }
+            elem_c[d] = cd / pointmat.Width();
+         }
+      }
+      else
+      {
+         if (bdrc.Width() == 0)
+         {
+            ComputeBdrAttrCenter();
+         }
+         int attr = mesh->GetBdrAttribute(i);
+         for (int d = 0; d < sdim; d++)
+         {
+            elem_c[d] = bdrc(d,attr-1);
+         }
+      }
+      elem_c[3] = 0.f;
+   }
+
+   int attr, elem1, elem2;
+   if (dim == 2 || sdim == 2)
+   {
+      attr = mesh->GetAttribute(i);
+   }
+   else
+   {
+      mesh->GetFaceElements(fn, &elem1, &elem2);
+      attr = mesh->GetAttribute((di == 0) ? elem1 : elem2);
+   }
+   if (matc.Width() == 0)
+   {
+      ComputeElemAttrCenter();
+   }
+   for (int d = 0; d < sdim; d++)
+   {
+      attr_c[d] = matc(d,attr-1);
+   }
+
+   buf.setShrinkCenters(elem_c, attr_c);
+}
+
+void VisualizationSceneScalarData::SetShrinkFactors()
+{
+   // in 2D the z coordinate holds the solution value
+   gl->setShrinkFactors(shrink, shrinkmat, mesh->SpaceDimension() == 2);
+}
+
 void VisualizationSceneScalarData::ComputeBdrAttrCenter()
 {
    DenseMatrix pointmat;
@@ -13,10 +13,13 @@
 #define GLVIS_VSDATA
 
 #include <array>
+#include <vector>
 
 #include "openglvis.hpp"
 #include "mfem.hpp"
 #include "aux_gl3.hpp"
+#include "tesscache.hpp"
+#include "tensoreval.hpp"
 using namespace mfem;
 
 extern std::string plot_caption; // defined in glvis.cpp
@@ -64,6 +67,19 @@ protected:
 
    int scaling, colorbar, drawaxes;
    int auto_ref_max, auto_ref_max_surf_elem;
+   // When auto_ref_tri_budget > 0, AutoRefine() picks the factor from the
+   // estimated triangle count instead of auto_ref_max_surf_elem.
+   long long auto_ref_tri_budget, auto_ref_tri_estimate;
+   int auto_ref_budget_factor;
+
+   /** Estimated number of triangles of the surfaces, level surfaces and
+       cutting planes currently shown, for subdivision factor 1. With factor
+       n, the count is n^2 times larger. */
+   virtual double EstimateTriangleCount() { return 0.0; }
+   /// Number of triangles in the prepared surfaces, level surfaces, etc.
+   virtual long long GetTriangleCount() { return 0; }
+   /// Highest factor, up to auto_ref_max, that fits in auto_ref_tri_budget.
+   int GetBudgetRefineFactor();
 
    gl3::GlDrawable axes_buf;
    bool coord_cross_init = false,
@@ -74,8 +90,31 @@ protected:
 
    int arrow_type, arrow_scaling_type;
 
+   // Arrow decimation of vector fields: 0 - off, 1 - the longest arrow of each
+   // cell of a grid with cell size 'arrow_spacing' (relative to the size of
+   // the bounding box), 2 - the average arrow of each cell.
+   int arrow_decimation;
+   double arrow_spacing;
+
+   struct ArrowSample
+   {
+      double pos[3], vec[3], val;
+   };
+
+   /** Replaces 'arrows' by one representative arrow per grid cell, according
+       to 'arrow_decimation'. The grid covers the first 'dim' coordinates of
+       the bounding box. */
+   void DecimateArrows(std::vector<ArrowSample> &arrows, int dim);
+
    int nl;
    Array<double> level;
+   // The levels set by SetLevelLines() as palette coordinates: the first
+   // level and the spacing between levels.
+   double level_first, level_step;
+
+   // Draw the level lines of surfaces in the fragment shader instead of
+   // extracting them on the CPU, see ShaderIsolines().
+   bool shader_isolines;
 
    int ruler_on;
    double ruler_x, ruler_y, ruler_z;
@@ -121,6 +160,51 @@ protected:
 
    void FixValueRange();
 
+   // Elements (or boundary elements) grouped by attribute, with row attr-1
+   // listing the entities with attribute attr. Built on first use and kept
+   // until ResetAttributeTables() is called for a new mesh.
+   Table *attr_to_el = NULL, *bdr_attr_to_bel = NULL;
+   const Table &GetAttributeElements(bool bdr);
+   // All elements (or boundary elements) sorted by attribute
+   const int *GetAttributeOrder(bool bdr)
+   { return GetAttributeElements(bdr).GetJ(); }
+   bool SameAttribute(int i, int j)
+   { return mesh->GetAttribute(i) == mesh->GetAttribute(j); }
+   void ResetAttributeTables();
+   // Minimum number of elements per thread when the unit normals of the
+   // elements are computed in parallel, before they are summed per attribute
+   static const int NORMALS_GRAIN = 8192;
+
+   // Key of the mesh and solution data that starts the tessellation cache
+   // keys. Computed on first use; ResetContentKey() must be called when the
+   // mesh or the solution changes.
+   TessCacheKey content_key;
+   const GridFunction *content_key_gf;
+   bool content_key_valid = false;
+   void ResetContentKey() { content_key_valid = false; }
+
+   /** Start the tessellation cache key of the drawable 'name' with the mesh and
+       solution data (including the GridFunction 'gf', if any) and the state
+       shared by all scenes: value range, bounding box, shrink factors, geometry
+       refiner and colors. Returns false if the cache is disabled. */
+   bool InitTessCacheKey(const char *name, const GridFunction *gf,
+                         TessCacheKey &key);
+
+   /** Set 'key' to the tessellation cache key of the drawable 'name', adding
+       the scene state it depends on. Scenes that do not redefine this method
+       are never cached. */
+   virtual bool GetTessCacheKey(const char *name, TessCacheKey &key)
+   { return false; }
+
+   // Fast evaluation of the refined values on quads and hexes
+   TensorRefinedEval tensor_eval;
+
+   /** Return the local index of the edge of the reference triangle or square
+       containing the refined edge (ip1,ip2), or -1 if the refined edge is
+       inside the element. Used to draw each mesh edge only once. */
+   static int GetRefinedEdgeLocalIndex(int geom, const IntegrationPoint &ip1,
+                                       const IntegrationPoint &ip2);
+
 public:
    Plane *CuttingPlane;
    int light;
@@ -182,6 +266,8 @@ public:
       auto_ref_max = max_ref;
       auto_ref_max_surf_elem = max_surf_elem;
    }
+   void SetAutoRefineTriangleBudget(long long budget)
+   { auto_ref_tri_budget = budget; }
    virtual void AutoRefine() = 0;
    virtual void ToggleAttributes(Array<int> &attr_list) = 0;
 
@@ -213,6 +299,23 @@ public:
                double length,
                double cone_scale = 0.075);
 
+   /** Vector fields are drawn as instanced arrow glyphs (gl3::ArrowBuffer)
+       when the GL supports instancing, except when printing, which captures
+       the arrows built on the CPU by Arrow(). */
+   bool UseArrowGlyphs()
+   { return gl->isInstancingSupported() && !print; }
+
+   /// Asks for the arrow decimation mode and cell size on the terminal.
+   void SetArrowDecimation();
+
+   /** Level lines are drawn by the fragment shader when shader isolines are
+       on and the surface uses the palette texture, except when printing,
+       which captures only the geometry. */
+   bool ShaderIsolines();
+   void ToggleShaderIsolines();
+   /// Loads the current levels into the isoline uniforms of the shader.
+   void EnableShaderIsolines();
+
    void DrawPolygonLevelLines(gl3::GlBuilder& builder, double *point, int n,
                               Array<double> &level, bool log_vals);
 
@@ -284,6 +387,21 @@ public:
 
    /// Shrink the set of points towards attributes centers of gravity
    void ShrinkPoints(DenseMatrix &pointmat, int i, int fn, int di);
+   /** Set the centers towards which ShrinkPoints() would move the points in
+       'pointmat' as the shrink centers of the next vertices added to 'buf'.
+       The vertex shader then applies 'shrink' and 'shrinkmat', see
+       SetShrinkFactors(). Does nothing if both factors are 1. With
+       'elem_shrink' false only 'shrinkmat' applies. */
+   void SetShrinkCenters(gl3::GlDrawable &buf, const DenseMatrix &pointmat,
+                         int i, int fn, int di, bool elem_shrink = true);
+   /// Load the shrink factors into the shader before drawing
+   void SetShrinkFactors();
+   /** The shrink factors are applied in the vertex shader to the prepared
+       objects, which only record the shrink centers once a factor is not 1.
+       Returns true if the objects have to be prepared again before changing
+       the factors. */
+   bool ShrinkNeedsPrepare() const
+   { return (shrink == 1.0 && shrinkmat == 1.0); }
    // Centers of gravity based on the boundary/element attributes
    DenseMatrix bdrc, matc;
    /// Compute the center of gravity for each boundary attribute
@@ -15,10 +15,13 @@
 #include <limits>
 #include <cmath>
 #include <vector>
+#include <set>
+#include <algorithm>
 
 #include "mfem.hpp"
 using namespace mfem;
 #include "visual.hpp"
+#include "minmax.hpp"
 
 using namespace std;
 
@@ -63,6 +66,7 @@ static void SolutionKeyHPressed()
         << "| h -  Displays help menu            |" << endl
         << "| i -  (De)refine elem. (NC shading) |" << endl
         << "| I -  Switch 'i' func. (NC shading) |" << endl
+        << "| o -  Adaptive subdiv. (NC shading) |" << endl
         << "| j -  Turn on/off perspective       |" << endl
         << "| k/K  Adjust the transparency level |" << endl
         << "| ,/<  Adjust color transparency     |" << endl
@@ -82,6 +86,7 @@ static void SolutionKeyHPressed()
         << "| z/Z  Move the clipping plane       |" << endl
         << "| \\ -  Set light source position     |" << endl
         << "| Ctrl+p - Print to a PDF file       |" << endl
+        << "| Ctrl+m - Level lines in the shader |" << endl
         << "+------------------------------------+" << endl
         << "| Function keys                      |" << endl
         << "+------------------------------------+" << endl
@@ -183,8 +188,7 @@ static void SwitchAttribute(int increment, int &attribute,
    }
    else
    {
-      vssol->PrepareLines();
-      vssol->Prepare();
+      vssol->UpdateAttributeVisibility();
    }
    SendExposeEvent();
 }
@@ -221,9 +225,16 @@ static void KeyBPressed()
    SendExposeEvent();
 }
 
-static void KeyMPressed()
+static void KeyMPressed(GLenum state)
 {
-   vssol -> ToggleDrawMesh();
+   if (state & KMOD_CTRL)
+   {
+      vssol -> ToggleShaderIsolines();
+   }
+   else
+   {
+      vssol -> ToggleDrawMesh();
+   }
    SendExposeEvent();
 }
 
@@ -318,6 +329,12 @@ void KeyIPressed()
    }
 }
 
+static void KeyoPressed()
+{
+   vssol -> ToggleAdaptiveRefinement();
+   SendExposeEvent();
+}
+
 static void KeywPressed()
 {
    vssol->ToggleDrawCP();
@@ -352,16 +369,29 @@ static void KeyZPressed()
    SendExposeEvent();
 }
 
-static void KeyF3Pressed()
+// Scale the shrink factors. They are applied in the vertex shader, so the
+// objects are only prepared again to record the shrink centers.
+static void ScaleShrink(double elem_scale, double attr_scale)
 {
-   if (vssol->shading == 2)
+   bool prepare = vssol->ShrinkNeedsPrepare();
+   vssol->shrink *= elem_scale;
+   vssol->shrinkmat *= attr_scale;
+   if (prepare)
    {
-      vssol->shrink *= 0.9;
       vssol->Prepare();
       vssol->PrepareLines();
+      vssol->PrepareBoundary();
       vssol->PrepareLevelCurves();
-      vssol->PrepareNumbering();
-      SendExposeEvent();
+   }
+   vssol->PrepareNumbering();
+   SendExposeEvent();
+}
+
+static void KeyF3Pressed()
+{
+   if (vssol->shading == 2)
+   {
+      ScaleShrink(0.9, 1.0);
    }
 }
 
@@ -369,12 +399,7 @@ static void KeyF4Pressed()
 {
    if (vssol->shading == 2)
    {
-      vssol->shrink *= 1.11111111111111111111111;
-      vssol->Prepare();
-      vssol->PrepareLines();
-      vssol->PrepareLevelCurves();
-      vssol->PrepareNumbering();
-      SendExposeEvent();
+      ScaleShrink(1.11111111111111111111111, 1.0);
    }
 }
 
@@ -386,13 +411,7 @@ static void KeyF11Pressed()
       {
          vssol->ComputeElemAttrCenter();
       }
-      vssol->shrinkmat *= 0.9;
-      vssol->Prepare();
-      vssol->PrepareLines();
-      vssol->PrepareBoundary();
-      vssol->PrepareLevelCurves();
-      vssol->PrepareNumbering();
-      SendExposeEvent();
+      ScaleShrink(1.0, 0.9);
    }
 }
 
@@ -404,13 +423,7 @@ static void KeyF12Pressed()
       {
          vssol->ComputeElemAttrCenter();
       }
-      vssol->shrinkmat *= 1.11111111111111111111111;
-      vssol->Prepare();
-      vssol->PrepareLines();
-      vssol->PrepareBoundary();
-      vssol->PrepareLevelCurves();
-      vssol->PrepareNumbering();
-      SendExposeEvent();
+      ScaleShrink(1.0, 1.11111111111111111111111);
    }
 }
 
@@ -439,7 +452,9 @@ void VisualizationSceneSolution::Init()
 
    drawelems = shading = 1;
    drawmesh  = 0;
+   lcurve_shader = false;
    drawnums  = 0;
+   e_nums_view = v_nums_view = glm::mat4(0.0);
 
    shrink = 1.0;
    shrinkmat = 1.0;
@@ -447,6 +462,8 @@ void VisualizationSceneSolution::Init()
    matc.SetSize(2,0);
 
    TimesToRefine = EdgeRefineFactor = 1;
+   adaptive_ref = 0;
+   adaptive_tol = 2e-3;
 
    attr_to_show = bdr_attr_to_show = -1;
    el_attr_to_show.SetSize(mesh->attributes.Max());
@@ -488,6 +505,8 @@ void VisualizationSceneSolution::Init()
       wnd->setOnKeyDown('i', KeyiPressed);
       wnd->setOnKeyDown('I', KeyIPressed);
 
+      wnd->setOnKeyDown('o', KeyoPressed);
+
       wnd->setOnKeyDown('w', KeywPressed);
       wnd->setOnKeyDown('y', KeyyPressed);
       wnd->setOnKeyDown('Y', KeyYPressed);
@@ -549,6 +568,10 @@ void VisualizationSceneSolution::ToggleDrawElems()
 void VisualizationSceneSolution::NewMeshAndSolution(
    Mesh *new_m, Vector *new_sol, GridFunction *new_u)
 {
+   // A script can show several solutions on the same mesh: then only the
+   // data that depends on the solution is updated.
+   const bool same_mesh = (new_m == mesh);
+
    // If the number of elements changes, recompute the refinement factor
    if (mesh->GetNE() != new_m->GetNE())
    {
@@ -564,6 +587,12 @@ void VisualizationSceneSolution::NewMeshAndSolution(
    mesh = new_m;
    sol = new_sol;
    rsol = new_u;
+   if (!same_mesh)
+   {
+      ResetAttributeTables();
+   }
+   ResetContentKey();
+   el_ref.SetSize(0);
 
    DoAutoscale(false);
 
@@ -579,17 +608,30 @@ void VisualizationSceneSolution::GetRefinedDetJ(
    int i, const IntegrationRule &ir, Vector &vals, DenseMatrix &tr)
 {
    int geom = mesh->GetElementBaseGeometry(i);
-   ElementTransformation *T = mesh->GetElementTransformation(i);
+   ElementTransformation *T = NULL;
    double Jd[4];
    DenseMatrix J(Jd, 2, 2);
+   DenseTensor jac;
 
-   T->Transform(ir, tr);
+   const bool tensor = tensor_eval.GetJacobians(*mesh, i, ir, tr, jac);
+   if (!tensor)
+   {
+      T = mesh->GetElementTransformation(i);
+      T->Transform(ir, tr);
+   }
 
    vals.SetSize(ir.GetNPoints());
    for (int j = 0; j < ir.GetNPoints(); j++)
    {
-      T->SetIntPoint(&ir.IntPoint(j));
-      Geometries.JacToPerfJac(geom, T->Jacobian(), J);
+      if (tensor)
+      {
+         Geometries.JacToPerfJac(geom, jac(j), J);
+      }
+      else
+      {
+         T->SetIntPoint(&ir.IntPoint(j));
+         Geometries.JacToPerfJac(geom, T->Jacobian(), J);
+      }
       if (drawelems == 6) // attribute
       {
          vals(j) = mesh->GetAttribute(i);
@@ -633,7 +675,10 @@ void VisualizationSceneSolution::GetRefinedValues(
 {
    if (drawelems < 2)
    {
-      rsol->GetValues(i, ir, vals, tr);
+      if (!tensor_eval.GetValues(*rsol, i, ir, vals, tr))
+      {
+         rsol->GetValues(i, ir, vals, tr);
+      }
    }
    else
    {
@@ -645,11 +690,6 @@ void VisualizationSceneSolution::GetRefinedValues(
       {
          vals(j) = _LogVal(vals(j));
       }
-
-   if (shrink != 1.0 || shrinkmat != 1.0)
-   {
-      ShrinkPoints(tr, i, 0, 0);
-   }
 }
 
 int VisualizationSceneSolution::GetRefinedValuesAndNormals(
@@ -660,7 +700,10 @@ int VisualizationSceneSolution::GetRefinedValuesAndNormals(
 
    if (drawelems < 2)
    {
-      rsol->GetGradients(i, ir, tr);
+      if (!tensor_eval.GetGradients(*rsol, i, ir, tr))
+      {
+         rsol->GetGradients(i, ir, tr);
+      }
       normals.SetSize(3, tr.Width());
       for (int j = 0; j < tr.Width(); j++)
       {
@@ -669,7 +712,10 @@ int VisualizationSceneSolution::GetRefinedValuesAndNormals(
          normals(2, j) = 1.;
       }
       have_normals = 1;
-      rsol->GetValues(i, ir, vals, tr);
+      if (!tensor_eval.GetValues(*rsol, i, ir, vals, tr))
+      {
+         rsol->GetValues(i, ir, vals, tr);
+      }
    }
    else
    {
@@ -691,19 +737,6 @@ int VisualizationSceneSolution::GetRefinedValuesAndNormals(
       }
    }
 
-   if (shrink != 1.0 || shrinkmat != 1.0)
-   {
-      ShrinkPoints(tr, i, 0, 0);
-      if (have_normals)
-      {
-         for (int j = 0; j < tr.Width(); j++)
-         {
-            normals(0, j) /= shrink;
-            normals(1, j) /= shrink;
-         }
-      }
-   }
-
    return have_normals;
 }
 
@@ -794,6 +827,11 @@ void VisualizationSceneSolution::SetRefineFactors(int tot, int bdr)
 
 int VisualizationSceneSolution::GetAutoRefineFactor()
 {
+   if (auto_ref_tri_budget > 0)
+   {
+      return GetBudgetRefineFactor();
+   }
+
    int ne = mesh->GetNE(), ref = 1;
 
    while (ref < auto_ref_max && ne*(ref+1)*(ref+1) <= auto_ref_max_surf_elem)
@@ -804,6 +842,272 @@ int VisualizationSceneSolution::GetAutoRefineFactor()
    return ref;
 }
 
+void VisualizationSceneSolution::ToggleAdaptiveRefinement()
+{
+   adaptive_ref = !adaptive_ref;
+   cout << "Adaptive subdivision : " << (adaptive_ref ? "on" : "off") << endl;
+
+   if (shading == 2)
+   {
+      PrepareLines();
+      Prepare();
+      PrepareLevelCurves();
+      PrepareCP();
+   }
+}
+
+int VisualizationSceneSolution::EstimateRefineFactor(int i, double vtol,
+                                                     double xtol)
+{
+   int geom = mesh->GetElementBaseGeometry(i);
+   int m = 2;
+   if (drawelems < 2 && rsol)
+   {
+      m = max(m, rsol->FESpace()->GetFE(i)->GetOrder());
+   }
+   const IntegrationRule &ir =
+      GLVisGeometryRefiner.Refine(geom, min(m, TimesToRefine))->RefPts;
+
+   // Estimated error of the piecewise linear surface with one subdivision;
+   // with n subdivisions it decreases like 1/n^2.
+   double err = 0.0;
+   if (vtol > 0.0)
+   {
+      Vector vals;
+      DenseMatrix tr, normals;
+      if (GetRefinedValuesAndNormals(i, ir, vals, tr, normals))
+      {
+         // variation of the gradient times the element size
+         double g[2][2], p[2][2];
+         for (int d = 0; d < 2; d++)
+         {
+            g[d][0] = p[d][0] = numeric_limits<double>::infinity();
+            g[d][1] = p[d][1] = -g[d][0];
+         }
+         for (int j = 0; j < tr.Width(); j++)
+            for (int d = 0; d < 2; d++)
+            {
+               g[d][0] = min(g[d][0], normals(d, j));
+               g[d][1] = max(g[d][1], normals(d, j));
+               p[d][0] = min(p[d][0], tr(d, j));
+               p[d][1] = max(p[d][1], tr(d, j));
+            }
+         err = (hypot(g[0][1] - g[0][0], g[1][1] - g[1][0]) *
+                hypot(p[0][1] - p[0][0], p[1][1] - p[1][0]) / 16.0);
+      }
+      else
+      {
+         err = (vals.Max() - vals.Min()) / 8.0;
+      }
+      err /= vtol;
+   }
+
+   if (mesh->GetNodes() && xtol > 0.0)
+   {
+      // distance between the curved element and the straight-sided one
+      ElementTransformation *T = mesh->GetElementTransformation(i);
+      DenseMatrix pm, vm;
+      T->Transform(ir, pm);
+      T->Transform(*Geometries.GetVertices(geom), vm);
+      double dev = 0.0;
+      for (int j = 0; j < ir.GetNPoints(); j++)
+      {
+         const IntegrationPoint &ip = ir.IntPoint(j);
+         double w[4];
+         if (geom == Geometry::TRIANGLE)
+         {
+            w[0] = 1.0 - ip.x - ip.y; w[1] = ip.x; w[2] = ip.y;
+         }
+         else
+         {
+            w[0] = (1.0 - ip.x)*(1.0 - ip.y); w[1] = ip.x*(1.0 - ip.y);
+            w[2] = ip.x*ip.y; w[3] = (1.0 - ip.x)*ip.y;
+         }
+         double d2 = 0.0;
+         for (int d = 0; d < pm.Height(); d++)
+         {
+            double lin = 0.0;
+            for (int k = 0; k < vm.Width(); k++)
+            {
+               lin += w[k]*vm(d, k);
+            }
+            d2 += (pm(d, j) - lin)*(pm(d, j) - lin);
+         }
+         dev = max(dev, d2);
+      }
+      err = max(err, sqrt(dev)/xtol);
+   }
+
+   int n = (err > 1.0) ? (int) ceil(sqrt(err)) : 1;
+   n = EdgeRefineFactor*((n + EdgeRefineFactor - 1)/EdgeRefineFactor);
+   return min(n, TimesToRefine);
+}
+
+void VisualizationSceneSolution::UpdateAdaptiveRefinement()
+{
+   if (!adaptive_ref)
+   {
+      return;
+   }
+
+   Fnv1aHash stamp;
+   stamp.Add(TimesToRefine);
+   stamp.Add(EdgeRefineFactor);
+   stamp.Add(drawelems);
+   stamp.Add(logscale);
+   stamp.Add(minv);
+   stamp.Add(maxv);
+   stamp.Add(shrink);
+   stamp.Add(shrinkmat);
+   stamp.Add(adaptive_tol);
+   int ne = mesh->GetNE();
+   if (el_ref.Size() == ne && el_ref_stamp == stamp.Get())
+   {
+      return;
+   }
+   el_ref_stamp = stamp.Get();
+   el_ref.SetSize(ne);
+
+   double vtol = adaptive_tol*(LogVal(maxv) - LogVal(minv));
+   double xtol = adaptive_tol*hypot(x[1] - x[0], y[1] - y[0]);
+   int min_ref = TimesToRefine, max_ref = 1;
+   long long tris = 0;
+   for (int i = 0; i < ne; i++)
+   {
+      el_ref[i] = EstimateRefineFactor(i, vtol, xtol);
+      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      min_ref = min(min_ref, el_ref[i]);
+      max_ref = max(max_ref, el_ref[i]);
+      int sides = mesh->GetElement(i)->GetNVertices();
+      tris += (long long)(sides - 2)*el_ref[i]*el_ref[i];
+   }
+
+   // The uniform subdivision with the same (maximal) estimated error uses
+   // the largest of the element factors everywhere.
+   long long uniform_tris = 0;
+   for (int i = 0; i < ne; i++)
+   {
+      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      int sides = mesh->GetElement(i)->GetNVertices();
+      uniform_tris += (long long)(sides - 2)*max_ref*max_ref;
+   }
+   if (shrink == 1.0 && shrinkmat == 1.0 && ContinuousRefinedValues())
+   {
+      for (int f = 0; f < mesh->GetNumFaces(); f++)
+      {
+         int e1, e2;
+         mesh->GetFaceElements(f, &e1, &e2);
+         if (e2 >= 0 && el_ref[e1] != el_ref[e2] &&
+             el_attr_to_show[mesh->GetAttribute(e1)-1] &&
+             el_attr_to_show[mesh->GetAttribute(e2)-1])
+         {
+            tris += el_ref[e1] + el_ref[e2];
+         }
+      }
+   }
+
+   cout << "Adaptive subdivision factors = " << min_ref << " - " << max_ref
+        << ", triangles: " << tris << " (uniform subdivision " << max_ref
+        << ": " << uniform_tris << ")" << endl;
+}
+
+void VisualizationSceneSolution::GetRefinedEdgeValues(
+   int i, const Array<int> &fv, int n, Vector &vals, DenseMatrix &tr)
+{
+   Array<int> ev;
+   mesh->GetElementVertices(i, ev);
+   const IntegrationRule &vir =
+      *Geometries.GetVertices(mesh->GetElementBaseGeometry(i));
+   const IntegrationPoint &a = vir.IntPoint(ev.Find(fv[0]));
+   const IntegrationPoint &b = vir.IntPoint(ev.Find(fv[1]));
+
+   // the 1D refined points are the ones on the edges of the refined element
+   const IntegrationRule &sir =
+      GLVisGeometryRefiner.Refine(Geometry::SEGMENT, n)->RefPts;
+   IntegrationRule eir(sir.GetNPoints());
+   for (int k = 0; k < sir.GetNPoints(); k++)
+   {
+      double t = sir.IntPoint(k).x;
+      eir.IntPoint(k).Set2(a.x + t*(b.x - a.x), a.y + t*(b.y - a.y));
+   }
+   GetRefinedValues(i, eir, vals, tr);
+}
+
+void VisualizationSceneSolution::DrawAdaptiveSeams()
+{
+   if (!adaptive_ref || shrink != 1.0 || shrinkmat != 1.0 ||
+       !ContinuousRefinedValues())
+   {
+      return;
+   }
+
+   Array<int> fv;
+   Vector cvals, fvals;
+   DenseMatrix ctr, ftr;
+   double pts[4][3], cv[4];
+   for (int f = 0; f < mesh->GetNumFaces(); f++)
+   {
+      int e1, e2;
+      mesh->GetFaceElements(f, &e1, &e2);
+      if (e2 < 0 || el_ref[e1] == el_ref[e2])
+      {
+         continue;
+      }
+      if (el_ref[e1] > el_ref[e2])
+      {
+         std::swap(e1, e2);
+      }
+      // the seam is shown with the coarser element
+      disp_buf.beginGroup(mesh->GetAttribute(e1)-1);
+      int nc = el_ref[e1], nf = el_ref[e2];
+      mesh->GetFaceVertices(f, fv);
+      GetRefinedEdgeValues(e1, fv, nc, cvals, ctr);
+      GetRefinedEdgeValues(e2, fv, nf, fvals, ftr);
+      const IntegrationRule &cir =
+         GLVisGeometryRefiner.Refine(Geometry::SEGMENT, nc)->RefPts;
+      const IntegrationRule &fir =
+         GLVisGeometryRefiner.Refine(Geometry::SEGMENT, nf)->RefPts;
+
+      // advance along the refined edge whose next point comes first
+      for (int a = 0, b = 0; a < nc || b < nf; )
+      {
+         bool fine = (a == nc || (b < nf && fir.IntPoint(b+1).x <=
+                                  cir.IntPoint(a+1).x));
+         int c[3][2] = {{0, a}, {1, b}, {fine ? 1 : 0, fine ? b+1 : a+1}};
+         for (int j = 0; j < 3; j++)
+         {
+            const DenseMatrix &tr = c[j][0] ? ftr : ctr;
+            const Vector &vals = c[j][0] ? fvals : cvals;
+            pts[j][0] = tr(0, c[j][1]);
+            pts[j][1] = tr(1, c[j][1]);
+            pts[j][2] = cv[j] = vals(c[j][1]);
+         }
+         DrawTriangle(disp_buf, pts, cv, minv, maxv);
+         if (fine) { b++; }
+         else { a++; }
+      }
+   }
+}
+
+double VisualizationSceneSolution::EstimateTriangleCount()
+{
+   // the level and cutting plane lines of 2D plots are not triangles
+   double tris = 0.0;
+   for (int i = 0; i < mesh->GetNE(); i++)
+   {
+      if (el_attr_to_show[mesh->GetAttribute(i)-1])
+      {
+         tris += mesh->GetElement(i)->GetNVertices() - 2;
+      }
+   }
+   return tris;
+}
+
+long long VisualizationSceneSolution::GetTriangleCount()
+{
+   return disp_buf.getTriangleCount();
+}
+
 void VisualizationSceneSolution::AutoRefine()
 {
    int ref = GetAutoRefineFactor();
@@ -835,8 +1139,18 @@ void VisualizationSceneSolution::ToggleAttributes(Array<int> &attr_list)
          attr_marker[attr-1] = !attr_marker[attr-1];
       }
    }
-   PrepareLines();
-   Prepare();
+   UpdateAttributeVisibility();
+}
+
+void VisualizationSceneSolution::UpdateAttributeVisibility()
+{
+   // the surface and the mesh lines are grouped by attribute, so they are
+   // not prepared again
+   for (int a = 0; a < el_attr_to_show.Size(); a++)
+   {
+      disp_buf.setGroupVisible(a, el_attr_to_show[a]);
+      line_buf.setGroupVisible(a, el_attr_to_show[a]);
+   }
 }
 
 void VisualizationSceneSolution::SetNewScalingFromBox()
@@ -861,31 +1175,18 @@ void VisualizationSceneSolution::SetNewScalingFromBox()
 void VisualizationSceneSolution::FindNewBox(double rx[], double ry[],
                                             double rval[])
 {
-   int i, j;
+   MinMaxBox box;
 
    if (shading != 2)
    {
-      int nv = mesh -> GetNV();
-
-      double *coord = mesh->GetVertex(0);
-
-      rval[0] = rval[1] = (*sol)(0);
-      for (i = 1; i < sol->Size(); i++)
-      {
-         if ((*sol)(i) < rval[0]) { rval[0] = (*sol)(i); }
-         if ((*sol)(i) > rval[1]) { rval[1] = (*sol)(i); }
-      }
-      rx[0] = rx[1] = coord[0];
-      ry[0] = ry[1] = coord[1];
-
-      for (i = 1; i < nv; i++)
+      // the mesh vertices are stored as consecutive (x,y,z) triples
+      static_assert(sizeof(Vertex) == 3*sizeof(double),
+                    "the mesh vertices are not packed (x,y,z) triples");
+      if (mesh->GetNV() > 0)
       {
-         coord = mesh->GetVertex(i);
-         if (coord[0] < rx[0]) { rx[0] = coord[0]; }
-         if (coord[1] < ry[0]) { ry[0] = coord[1]; }
-         if (coord[0] > rx[1]) { rx[1] = coord[0]; }
-         if (coord[1] > ry[1]) { ry[1] = coord[1]; }
+         MinMaxReduce(mesh->GetVertex(0), mesh->GetNV(), 2, 3, box);
       }
+      MinMaxReduce(sol->GetData(), sol->Size(), 1, 1, box, 2);
    }
    else
    {
@@ -895,35 +1196,26 @@ void VisualizationSceneSolution::FindNewBox(double rx[], double ry[],
       RefinedGeometry *RefG;
       bool log_scale = logscale;
 
+      // the box and the range are updated while evaluating each element
       logscale = false;
-      rx[0] = ry[0] = rval[0] = numeric_limits<double>::infinity();
-      rx[1] = ry[1] = rval[1] = -rx[0];
-      for (i = 0; i < ne; i++)
+      for (int i = 0; i < ne; i++)
       {
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
                                             TimesToRefine, EdgeRefineFactor);
          GetRefinedValues(i, RefG->RefPts, values, pointmat);
-         for (j = 0; j < values.Size(); j++)
-         {
-            if (isfinite(pointmat(0,j)))
-            {
-               if (pointmat(0,j) < rx[0]) { rx[0] = pointmat(0,j); }
-               if (pointmat(0,j) > rx[1]) { rx[1] = pointmat(0,j); }
-            }
-            if (isfinite(pointmat(1,j)))
-            {
-               if (pointmat(1,j) < ry[0]) { ry[0] = pointmat(1,j); }
-               if (pointmat(1,j) > ry[1]) { ry[1] = pointmat(1,j); }
-            }
-            if (isfinite(values(j)))
-            {
-               if (values(j) < rval[0]) { rval[0] = values(j); }
-               if (values(j) > rval[1]) { rval[1] = values(j); }
-            }
-         }
+         box.Add(pointmat.Data(), values.Size(), 2, pointmat.Height(), 0,
+                 true);
+         box.Add(values.GetData(), values.Size(), 1, 1, 2, true);
       }
       logscale = log_scale;
    }
+
+   rx[0] = box.min[0];
+   rx[1] = box.max[0];
+   ry[0] = box.min[1];
+   ry[1] = box.max[1];
+   rval[0] = box.min[2];
+   rval[1] = box.max[2];
 }
 
 void VisualizationSceneSolution::FindNewBox(bool prepare)
@@ -1104,6 +1396,11 @@ void DrawPatch(gl3::GlDrawable& drawable, const DenseMatrix &pts, Vector &vals,
    gl3::GlBuilder poly = drawable.createBuilder();
    double na[3];
 
+   // DrawPatch() is called for every element, keep the colors between calls
+   static std::vector<MappedColor> colors;
+   colors.resize(vals.Size());
+   MySetColors(vals.GetData(), vals.Size(), minv, maxv, colors.data());
+
    if (normals_opt == 1 || normals_opt == -2)
    {
       normals.SetSize(3, pts.Width());
@@ -1141,7 +1438,7 @@ void DrawPatch(gl3::GlDrawable& drawable, const DenseMatrix &pts, Vector &vals,
          for (int i = 0; i < ind.Size(); i++)
          {
             poly.glNormal3dv(&normals(0, ind[i]));
-            MySetColor(poly, vals(ind[i]), minv, maxv);
+            MySetColor(poly, colors[ind[i]]);
             poly.glVertex3dv(&pts(0, ind[i]));
          }
       }
@@ -1150,7 +1447,7 @@ void DrawPatch(gl3::GlDrawable& drawable, const DenseMatrix &pts, Vector &vals,
          for (int i = ind.Size()-1; i >= 0; i--)
          {
             poly.glNormal3dv(&normals(0, ind[i]));
-            MySetColor(poly, vals(ind[i]), minv, maxv);
+            MySetColor(poly, colors[ind[i]]);
             poly.glVertex3dv(&pts(0, ind[i]));
          }
       }
@@ -1173,7 +1470,7 @@ void DrawPatch(gl3::GlDrawable& drawable, const DenseMatrix &pts, Vector &vals,
                poly.glNormal3dv(na);
                for ( ; j < n; j++)
                {
-                  MySetColor(poly, vals(ind[i]), minv, maxv);
+                  MySetColor(poly, colors[ind[i]]);
                   poly.glVertex3dv(&pts(0, ind[i+j]));
                }
             }
@@ -1182,7 +1479,7 @@ void DrawPatch(gl3::GlDrawable& drawable, const DenseMatrix &pts, Vector &vals,
                poly.glNormal3d(-na[0], -na[1], -na[2]);
                for (j = n-1; j >= 0; j--)
                {
-                  MySetColor(poly, vals(ind[i]), minv, maxv);
+                  MySetColor(poly, colors[ind[i]]);
                   poly.glVertex3dv(&pts(0, ind[i+j]));
                }
             }
@@ -1201,9 +1498,11 @@ void VisualizationSceneSolution::PrepareWithNormals()
    Array<int> vertices;
    double *vtx, *nor, val, s;
 
-   for (int i = 0; i < mesh->GetNE(); i++)
+   const int *el_order = GetAttributeOrder(false);
+   for (int k = 0; k < mesh->GetNE(); k++)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      int i = el_order[k];
+      disp_buf.beginGroup(mesh->GetAttribute(i)-1);
 
       mesh->GetElementVertices(i, vertices);
       GLenum shape;
@@ -1248,9 +1547,11 @@ void VisualizationSceneSolution::PrepareFlat()
    Array<int> vertices;
    double pts[4][3], col[4];
 
-   for (i = 0; i < ne; i++)
+   const int *el_order = GetAttributeOrder(false);
+   for (int k = 0; k < ne; k++)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      i = el_order[k];
+      disp_buf.beginGroup(mesh->GetAttribute(i)-1);
 
       mesh->GetPointMatrix (i, pointmat);
       mesh->GetElementVertices (i, vertices);
@@ -1284,20 +1585,24 @@ void VisualizationSceneSolution::PrepareFlat2()
 {
    int i, j, k;
    disp_buf.clear();
+   UpdateAdaptiveRefinement();
    int ne = mesh -> GetNE();
    DenseMatrix pointmat, pts3d, normals;
    Vector values;
    RefinedGeometry *RefG;
    Array<int> fRG;
 
-   for (i = 0; i < ne; i++)
+   const int *el_order = GetAttributeOrder(false);
+   for (int l = 0; l < ne; l++)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      i = el_order[l];
+      disp_buf.beginGroup(mesh->GetAttribute(i)-1);
 
       RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                         TimesToRefine, EdgeRefineFactor);
+                                         GetRefineFactor(i), EdgeRefineFactor);
       j = GetRefinedValuesAndNormals(i, RefG->RefPts, values, pointmat,
                                      normals);
+      SetShrinkCenters(disp_buf, pointmat, i, 0, 0);
       Array<int> &RG = RefG->RefGeoms;
       int sides = mesh->GetElement(i)->GetNVertices();
 
@@ -1379,6 +1684,7 @@ void VisualizationSceneSolution::PrepareFlat2()
       }
 #endif
    }
+   DrawAdaptiveSeams();
    disp_buf.buffer();
 }
 
@@ -1386,18 +1692,28 @@ void VisualizationSceneSolution::Prepare()
 {
    MySetColorLogscale = 0;
 
+   TessCacheKey cache_key;
+   const bool cached = GetTessCacheKey("surface", cache_key);
+   if (cached && TessCacheLoad(cache_key, disp_buf))
+   {
+      return;
+   }
+
    switch (shading)
    {
       case 0:
          PrepareFlat();
+         if (cached) { TessCacheSave(cache_key, disp_buf); }
          return;
       case 2:
          PrepareFlat2();
+         if (cached) { TessCacheSave(cache_key, disp_buf); }
          return;
       default:
          if (v_normals)
          {
             PrepareWithNormals();
+            if (cached) { TessCacheSave(cache_key, disp_buf); }
             return;
          }
          break;
@@ -1407,91 +1723,131 @@ void VisualizationSceneSolution::Prepare()
 
    disp_buf.clear();
    gl3::GlBuilder poly = disp_buf.createBuilder();
-   int ne = mesh -> GetNE();
    int nv = mesh -> GetNV();
    DenseMatrix pointmat;
    Array<int> vertices;
-   double p[4][3], nor[3];
 
    Vector nx(nv);
    Vector ny(nv);
    Vector nz(nv);
+   nx = 0.;
+   ny = 0.;
+   nz = 0.;
+
+   Vector z(nv);
+   for (i = 0; i < nv; i++)
+   {
+      z(i) = LogVal((*sol)(i));
+   }
+   std::vector<MappedColor> colors(nv);
+   MySetColors(z.GetData(), nv, minv, maxv, colors.data());
 
+   // The unit normals of the elements, computed in parallel; degenerate
+   // elements get a zero normal, which adds nothing to the vertex normals.
+   const int ne = mesh->GetNE();
+   std::vector<double> el_nor(3*ne, 0.0);
+   ParallelFor(ne, NORMALS_GRAIN, [&](size_t begin, size_t end)
+   {
+      DenseMatrix pm;
+      Array<int> verts;
+      double q[4][3];
+      for (size_t e = begin; e < end; e++)
+      {
+         mesh->GetPointMatrix(e, pm);
+         mesh->GetElementVertices(e, verts);
+         for (int jj = 0; jj < pm.Width(); jj++)
+         {
+            q[jj][0] = pm(0, jj);
+            q[jj][1] = pm(1, jj);
+            q[jj][2] = z(verts[jj]);
+         }
+         double *en = &el_nor[3*e];
+         const int err = (pm.Width() == 3) ?
+                         Compute3DUnitNormal(q[0], q[1], q[2], en) :
+                         Compute3DUnitNormal(q[0], q[1], q[2], q[3], en);
+         if (err)
+         {
+            en[0] = en[1] = en[2] = 0.0;
+         }
+      }
+   });
+
+   // Normals are averaged over the elements of each attribute, so process the
+   // elements grouped by attribute and reset only the vertices of the group.
+   const Table &attr_el = GetAttributeElements(false);
    for (int d = 0; d < mesh -> attributes.Size(); d++)
    {
+      const int attr = mesh -> attributes[d]-1;
 
-      if (!el_attr_to_show[mesh -> attributes[d]-1]) { continue; }
+      disp_buf.beginGroup(attr);
 
-      nx = 0.;
-      ny = 0.;
-      nz = 0.;
+      const int nelem = attr_el.RowSize(attr);
+      const int *elem = attr_el.GetRow(attr);
 
-      for (i = 0; i < ne; i++)
-         if (mesh -> GetAttribute(i) == mesh -> attributes[d])
+      for (int k = 0; k < nelem; k++)
+      {
+         i = elem[k];
+         mesh->GetElementVertices (i, vertices);
+         const double *en = &el_nor[3*i];
+         for (j = 0; j < vertices.Size(); j++)
          {
-            mesh->GetPointMatrix (i, pointmat);
-            mesh->GetElementVertices (i, vertices);
+            nx(vertices[j]) += en[0];
+            ny(vertices[j]) += en[1];
+            nz(vertices[j]) += en[2];
+         }
+      }
 
-            for (j = 0; j < pointmat.Size(); j++)
-            {
-               p[j][0] = pointmat(0, j);
-               p[j][1] = pointmat(1, j);
-               p[j][2] = LogVal((*sol)(vertices[j]));
-            }
+      for (int k = 0; k < nelem; k++)
+      {
+         i = elem[k];
+         GLenum shape;
+         switch (mesh->GetElementType(i))
+         {
+            case Element::TRIANGLE:
+               shape = GL_TRIANGLES;
+               break;
 
-            if (pointmat.Width() == 3)
-            {
-               j = Compute3DUnitNormal(p[0], p[1], p[2], nor);
-            }
-            else
-            {
-               j = Compute3DUnitNormal(p[0], p[1], p[2], p[3], nor);
-            }
+            case Element::QUADRILATERAL:
+               shape = GL_QUADS;
+               break;
+         }
+         poly.glBegin(shape);
+         mesh->GetPointMatrix (i, pointmat);
+         mesh->GetElementVertices (i, vertices);
 
-            if (j == 0)
-               for (j = 0; j < pointmat.Size(); j++)
-               {
-                  nx(vertices[j]) += nor[0];
-                  ny(vertices[j]) += nor[1];
-                  nz(vertices[j]) += nor[2];
-               }
+         for (j = 0; j < pointmat.Size(); j++)
+         {
+            MySetColor(poly, colors[vertices[j]]);
+            poly.glNormal3d(nx(vertices[j]), ny(vertices[j]), nz(vertices[j]));
+            poly.glVertex3d(pointmat(0, j), pointmat(1, j), z(vertices[j]));
          }
+         poly.glEnd();
+      }
 
-      for (i = 0; i < ne; i++)
+      for (int k = 0; k < nelem; k++)
       {
-         if (mesh -> GetAttribute(i) == mesh -> attributes[d])
+         mesh->GetElementVertices (elem[k], vertices);
+         for (j = 0; j < vertices.Size(); j++)
          {
-            GLenum shape;
-            switch (mesh->GetElementType(i))
-            {
-               case Element::TRIANGLE:
-                  shape = GL_TRIANGLES;
-                  break;
-
-               case Element::QUADRILATERAL:
-                  shape = GL_QUADS;
-                  break;
-            }
-            poly.glBegin(shape);
-            mesh->GetPointMatrix (i, pointmat);
-            mesh->GetElementVertices (i, vertices);
-
-            for (j = 0; j < pointmat.Size(); j++)
-            {
-               double z = LogVal((*sol)(vertices[j]));
-               MySetColor(poly, z, minv, maxv);
-               poly.glNormal3d(nx(vertices[j]), ny(vertices[j]), nz(vertices[j]));
-               poly.glVertex3d(pointmat(0, j), pointmat(1, j), z);
-            }
-            poly.glEnd();
+            nx(vertices[j]) = ny(vertices[j]) = nz(vertices[j]) = 0.;
          }
       }
    }
    disp_buf.buffer();
+   if (cached) { TessCacheSave(cache_key, disp_buf); }
 }
 
 void VisualizationSceneSolution::PrepareLevelCurves()
 {
+   lcurve_shader = LevelCurvesInShader();
+   if (lcurve_shader)
+   {
+      // changing the levels only updates the isoline uniforms
+      lcurve_buf.clear();
+      lcurve_buf.buffer();
+      return;
+   }
+
    if (shading == 2)
    {
       PrepareLevelCurves2();
@@ -1607,13 +1963,15 @@ void VisualizationSceneSolution::PrepareLevelCurves2()
    DenseMatrix pointmat;
    RefinedGeometry *RefG;
 
+   UpdateAdaptiveRefinement();
    lcurve_buf.clear();
    gl3::GlBuilder build = lcurve_buf.createBuilder();
    for (i = 0; i < ne; i++)
    {
       RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                         TimesToRefine, EdgeRefineFactor);
+                                         GetRefineFactor(i), EdgeRefineFactor);
       GetRefinedValues (i, RefG->RefPts, values, pointmat);
+      SetShrinkCenters(lcurve_buf, pointmat, i, 0, 0);
       Array<int> &RG = RefG->RefGeoms;
       int sides = mesh->GetElement(i)->GetNVertices();
 
@@ -1624,35 +1982,93 @@ void VisualizationSceneSolution::PrepareLevelCurves2()
 
 void VisualizationSceneSolution::PrepareLines()
 {
+   TessCacheKey cache_key;
+   const bool cached = GetTessCacheKey("lines", cache_key);
+   if (cached && TessCacheLoad(cache_key, line_buf))
+   {
+      return;
+   }
+
    if (shading == 2)
    {
       // PrepareLines2();
       PrepareLines3();
+      if (cached) { TessCacheSave(cache_key, line_buf); }
       return;
    }
 
    int i, j, ne = mesh -> GetNE();
    DenseMatrix pointmat;
-   Array<int> vertices;
+   Array<int> vertices, edges, cor;
 
    line_buf.clear();
    gl3::GlBuilder lb = line_buf.createBuilder();
 
-   for (i = 0; i < ne; i++)
+   // The lines are grouped by element attribute. Each edge of the mesh is
+   // drawn once per attribute, by the first element containing it.
+   Array<int> edge_attr(mesh->GetNEdges());
+   edge_attr = -1;
+
+   const int *el_order = GetAttributeOrder(false);
+   for (int k = 0; k < ne; k++)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      i = el_order[k];
+      const int attr = mesh->GetAttribute(i)-1;
+      line_buf.beginGroup(attr);
 
-      lb.glBegin(GL_LINE_LOOP);
       mesh->GetPointMatrix (i, pointmat);
       mesh->GetElementVertices (i, vertices);
+      mesh->GetElementEdges (i, edges, cor);
+
+      // local edge j connects the vertices j and j+1
+      int nv = pointmat.Size();
+      lb.glBegin(GL_LINES);
+      for (j = 0; j < edges.Size(); j++)
+      {
+         if (edge_attr[edges[j]] == attr) { continue; }
+         edge_attr[edges[j]] = attr;
 
-      for (j = 0; j < pointmat.Size(); j++)
+         int j1 = (j+1) % nv;
          lb.glVertex3d(pointmat(0, j), pointmat(1, j),
-                    LogVal((*sol)(vertices[j])));
+                       LogVal((*sol)(vertices[j])));
+         lb.glVertex3d(pointmat(0, j1), pointmat(1, j1),
+                       LogVal((*sol)(vertices[j1])));
+      }
       lb.glEnd();
    }
 
    line_buf.buffer();
+   if (cached) { TessCacheSave(cache_key, line_buf); }
+}
+
+bool VisualizationSceneSolution::GetTessCacheKey(const char *name,
+                                                 TessCacheKey &key)
+{
+   if (!InitTessCacheKey(name, rsol, key))
+   {
+      return false;
+   }
+   key.Add(shading);
+   key.Add(TimesToRefine);
+   key.Add(EdgeRefineFactor);
+   key.Add(adaptive_ref);
+   if (adaptive_ref)
+   {
+      key.Add(adaptive_tol);
+   }
+   key.Add(drawelems);
+   key.Add(v_normals != NULL);
+   if (v_normals)
+   {
+      key.Add(v_normals->GetData(), v_normals->Size()*sizeof(double));
+   }
+   return true;
+}
+
+bool VisualizationSceneSolution::ContinuousRefinedValues()
+{
+   return (drawelems < 2 && rsol &&
+           dynamic_cast<const H1_FECollection*>(rsol->FESpace()->FEColl()));
 }
 
 double VisualizationSceneSolution::GetElementLengthScale(int k)
@@ -1688,16 +2104,6 @@ double VisualizationSceneSolution::GetElementLengthScale(int k)
 
 void VisualizationSceneSolution::PrepareElementNumbering()
 {
-   int ne = mesh -> GetNE();
-
-   if (ne > MAX_RENDER_NUMBERING)
-   {
-      cout << "Element numbering disabled when #elements > "
-           << MAX_RENDER_NUMBERING << endl;
-      cout << "Rendering the text would be very slow." << endl;
-      return;
-   }
-
    if (2 == shading)
    {
       PrepareElementNumbering2();
@@ -1706,11 +2112,12 @@ void VisualizationSceneSolution::PrepareElementNumbering()
    {
       PrepareElementNumbering1();
    }
+   e_nums_view = glm::mat4(0.0);
 }
 
 void VisualizationSceneSolution::PrepareElementNumbering1()
 {
-   e_nums_buf.clear();
+   e_nums.clear();
 
    DenseMatrix pointmat;
    Array<int> vertices;
@@ -1740,11 +2147,9 @@ void VisualizationSceneSolution::PrepareElementNumbering1()
       double ds = GetElementLengthScale(k);
       double dx = 0.05*ds;
 
-      double xx[3] = {xs,ys,us};
-      DrawNumberedMarker(e_nums_buf,xx,dx,k);
+      NumberingLabel label = {{xs,ys,us}, dx, k};
+      e_nums.push_back(label);
    }
-
-   e_nums_buf.buffer();
 }
 
 void VisualizationSceneSolution::PrepareElementNumbering2()
@@ -1753,7 +2158,7 @@ void VisualizationSceneSolution::PrepareElementNumbering2()
    DenseMatrix pointmat;
    Vector values;
 
-   e_nums_buf.clear();
+   e_nums.clear();
 
    int ne = mesh->GetNE();
    for (int i = 0; i < ne; i++)
@@ -1763,6 +2168,7 @@ void VisualizationSceneSolution::PrepareElementNumbering2()
       center_ir.IntPoint(0) =
          Geometries.GetCenter(mesh->GetElementBaseGeometry(i));
       GetRefinedValues (i, center_ir, values, pointmat);
+      ShrinkPoints(pointmat, i, 0, 0);
 
       double xc = pointmat(0,0);
       double yc = pointmat(1,0);
@@ -1771,25 +2177,13 @@ void VisualizationSceneSolution::PrepareElementNumbering2()
       double ds = GetElementLengthScale(i);
       double dx = 0.05*ds;
 
-      double xx[3] = {xc,yc,uc};
-      DrawNumberedMarker(e_nums_buf,xx,dx,i);
+      NumberingLabel label = {{xc,yc,uc}, dx, i};
+      e_nums.push_back(label);
    }
-
-   e_nums_buf.buffer();
 }
 
 void VisualizationSceneSolution::PrepareVertexNumbering()
 {
-   int nv = mesh->GetNV();
-
-   if (nv > MAX_RENDER_NUMBERING)
-   {
-      cout << "Vertex numbering disabled when #vertices > "
-           << MAX_RENDER_NUMBERING << endl;
-      cout << "Rendering the text would be very slow." << endl;
-      return;
-   }
-
    if (2 == shading)
    {
       PrepareVertexNumbering2();
@@ -1798,11 +2192,12 @@ void VisualizationSceneSolution::PrepareVertexNumbering()
    {
       PrepareVertexNumbering1();
    }
+   v_nums_view = glm::mat4(0.0);
 }
 
 void VisualizationSceneSolution::PrepareVertexNumbering1()
 {
-   v_nums_buf.clear();
+   v_nums.clear();
 
    DenseMatrix pointmat;
    Array<int> vertices;
@@ -1828,12 +2223,10 @@ void VisualizationSceneSolution::PrepareVertexNumbering1()
          double y = pointmat(1,j);
          double u = LogVal((*sol)(vertices[j]));
 
-         double xx[3] = {x,y,u};
-         DrawNumberedMarker(v_nums_buf,xx,xs,vertices[j]);
+         NumberingLabel label = {{x,y,u}, xs, vertices[j]};
+         v_nums.push_back(label);
       }
    }
-
-   v_nums_buf.buffer();
 }
 
 void VisualizationSceneSolution::PrepareVertexNumbering2()
@@ -1842,7 +2235,7 @@ void VisualizationSceneSolution::PrepareVertexNumbering2()
    Vector values;
    Array<int> vertices;
 
-   v_nums_buf.clear();
+   v_nums.clear();
 
    const int ne = mesh->GetNE();
    for (int i = 0; i < ne; i++)
@@ -1855,6 +2248,7 @@ void VisualizationSceneSolution::PrepareVertexNumbering2()
          *Geometries.GetVertices(mesh->GetElementBaseGeometry(i));
 
       GetRefinedValues (i, vert_ir, values, pointmat);
+      ShrinkPoints(pointmat, i, 0, 0);
 
       double ds = GetElementLengthScale(i);
       double xs = 0.05*ds;
@@ -1866,12 +2260,10 @@ void VisualizationSceneSolution::PrepareVertexNumbering2()
 
          double u = values[j];
 
-         double xx[3] = {xv,yv,u};
-         DrawNumberedMarker(v_nums_buf,xx,xs,vertices[j]);
+         NumberingLabel label = {{xv,yv,u}, xs, vertices[j]};
+         v_nums.push_back(label);
       }
    }
-
-   v_nums_buf.buffer();
 }
 
 void VisualizationSceneSolution::PrepareNumbering()
@@ -1880,36 +2272,136 @@ void VisualizationSceneSolution::PrepareNumbering()
    PrepareVertexNumbering();
 }
 
+void VisualizationSceneSolution::DeclutterNumbering(
+   const std::vector<NumberingLabel> &labels, gl3::GlDrawable &buf,
+   glm::mat4 &view)
+{
+   GLint vp[4];
+   gl->getViewport(vp);
+
+   // object coordinates -> window coordinates in [0,w]x[0,h]
+   glm::mat4 screen(1.0);
+   screen = glm::scale(screen, glm::vec3(0.5*vp[2], 0.5*vp[3], 1.0));
+   screen = glm::translate(screen, glm::vec3(1.0, 1.0, 0.0));
+   screen = screen * gl->projection.mtx * gl->modelView.mtx;
+   if (screen == view)
+   {
+      return;
+   }
+   // While the view is dragged or spinning, the labels of the last layout
+   // are drawn as they are; they are laid out again when the view stops.
+   if (view != glm::mat4(0.0) && (spinning || MouseDragging()))
+   {
+      return;
+   }
+   view = screen;
+
+   const int ntx = vp[2]/NUMBERING_TILE_SIZE + 1;
+   const int nty = vp[3]/NUMBERING_TILE_SIZE + 1;
+   std::vector<bool> tile_used(ntx*nty, false);
+
+   buf.clear();
+   for (size_t i = 0; i < labels.size(); i++)
+   {
+      const NumberingLabel &l = labels[i];
+      glm::vec4 p = screen * glm::vec4(l.x[0], l.x[1], l.x[2], 1.0);
+      if (p.w <= 0.0) { continue; }
+      double sx = p.x/p.w, sy = p.y/p.w;
+      if (sx < 0.0 || sy < 0.0 || sx >= vp[2] || sy >= vp[3]) { continue; }
+      int tile = int(sy/NUMBERING_TILE_SIZE)*ntx + int(sx/NUMBERING_TILE_SIZE);
+      if (tile_used[tile]) { continue; }
+      tile_used[tile] = true;
+      DrawNumberedMarker(buf, l.x, l.dx, l.n);
+   }
+   buf.buffer();
+}
+
+void VisualizationSceneSolution::DrawNumbering()
+{
+   if (1 == drawnums)
+   {
+      DeclutterNumbering(e_nums, e_nums_buf, e_nums_view);
+      e_nums_buf.draw();
+   }
+   else if (2 == drawnums)
+   {
+      DeclutterNumbering(v_nums, v_nums_buf, v_nums_view);
+      v_nums_buf.draw();
+   }
+}
+
 void VisualizationSceneSolution::PrepareLines2()
 {
    int i, j, k, ne = mesh -> GetNE();
    Vector values;
    DenseMatrix pointmat;
    RefinedGeometry *RefG;
+   Array<int> edges, cor;
 
+   UpdateAdaptiveRefinement();
    line_buf.clear();
    gl3::GlBuilder lb = line_buf.createBuilder();
 
-   for (i = 0; i < ne; i++)
+   // Refined edges shared by two sub-elements are drawn once; when the
+   // neighboring elements agree on their shared edges, each edge of the mesh
+   // is drawn once per attribute, by the first element containing it.
+   Array<int> edge_owner;
+   bool unique_edges = (shrink == 1.0 && shrinkmat == 1.0 &&
+                        ContinuousRefinedValues());
+   if (unique_edges)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      edge_owner.SetSize(mesh->GetNEdges());
+      edge_owner = -1;
+   }
+   std::set<std::pair<int,int> > ref_edges;
+
+   const int *el_order = GetAttributeOrder(false);
+   for (int l = 0; l < ne; l++)
+   {
+      i = el_order[l];
+      line_buf.beginGroup(mesh->GetAttribute(i)-1);
 
+      int geom = mesh->GetElementBaseGeometry(i);
       RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                         TimesToRefine, EdgeRefineFactor);
+                                         GetRefineFactor(i), EdgeRefineFactor);
       GetRefinedValues (i, RefG->RefPts, values, pointmat);
+      SetShrinkCenters(line_buf, pointmat, i, 0, 0);
       Array<int> &RG = RefG->RefGeoms;
       int sides = mesh->GetElement(i)->GetNVertices();
+      if (unique_edges)
+      {
+         mesh->GetElementEdges(i, edges, cor);
+      }
 
+      ref_edges.clear();
+      lb.glBegin(GL_LINES);
       for (k = 0; k < RG.Size()/sides; k++)
       {
-         lb.glBegin(GL_LINE_LOOP);
-
          for (j = 0; j < sides; j++)
-            lb.glVertex3d(pointmat(0, RG[sides*k+j]),
-                       pointmat(1, RG[sides*k+j]),
-                       values(RG[sides*k+j]));
-         lb.glEnd();
+         {
+            int v0 = RG[sides*k+j], v1 = RG[sides*k+(j+1)%sides];
+            if (!ref_edges.insert(std::make_pair(std::min(v0, v1),
+                                                 std::max(v0, v1))).second)
+            {
+               continue;
+            }
+            if (unique_edges)
+            {
+               int le = GetRefinedEdgeLocalIndex(geom,
+                                                 RefG->RefPts.IntPoint(v0),
+                                                 RefG->RefPts.IntPoint(v1));
+               if (le >= 0)
+               {
+                  int &owner = edge_owner[edges[le]];
+                  if (owner < 0 || !SameAttribute(owner, i)) { owner = i; }
+                  if (owner != i) { continue; }
+               }
+            }
+            lb.glVertex3d(pointmat(0, v0), pointmat(1, v0), values(v0));
+            lb.glVertex3d(pointmat(0, v1), pointmat(1, v1), values(v1));
+         }
       }
+      lb.glEnd();
    }
 
    line_buf.buffer();
@@ -1921,21 +2413,54 @@ void VisualizationSceneSolution::PrepareLines3()
    Vector values;
    DenseMatrix pointmat;
    RefinedGeometry *RefG;
+   Array<int> edges, cor;
 
+   UpdateAdaptiveRefinement();
    line_buf.clear();
    gl3::GlBuilder lb = line_buf.createBuilder();
 
-   for (i = 0; i < ne; i++)
+   // When neighboring elements agree on their shared edges, each edge of the
+   // mesh is drawn once per attribute, by the first element containing it.
+   Array<int> edge_owner;
+   bool unique_edges = (shrink == 1.0 && shrinkmat == 1.0 &&
+                        ContinuousRefinedValues());
+   if (unique_edges)
    {
-      if (!el_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
+      edge_owner.SetSize(mesh->GetNEdges());
+      edge_owner = -1;
+   }
+
+   const int *el_order = GetAttributeOrder(false);
+   for (int l = 0; l < ne; l++)
+   {
+      i = el_order[l];
+      line_buf.beginGroup(mesh->GetAttribute(i)-1);
+      int geom = mesh->GetElementBaseGeometry(i);
       RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                         TimesToRefine, EdgeRefineFactor);
+                                         GetRefineFactor(i), EdgeRefineFactor);
       GetRefinedValues (i, RefG->RefPts, values, pointmat);
+      SetShrinkCenters(line_buf, pointmat, i, 0, 0);
       Array<int> &RE = RefG->RefEdges;
+      if (unique_edges)
+      {
+         mesh->GetElementEdges(i, edges, cor);
+      }
 
       lb.glBegin (GL_LINES);
       for (k = 0; k < RE.Size()/2; k++)
       {
+         if (unique_edges)
+         {
+            int le = GetRefinedEdgeLocalIndex(geom,
+                                              RefG->RefPts.IntPoint(RE[2*k]),
+                                              RefG->RefPts.IntPoint(RE[2*k+1]));
+            if (le >= 0)
+            {
+               int &owner = edge_owner[edges[le]];
+               if (owner < 0 || !SameAttribute(owner, i)) { owner = i; }
+               if (owner != i) { continue; }
+            }
+         }
          lb.glVertex3d (pointmat(0, RE[2*k]),
                      pointmat(1, RE[2*k]),
                      values(RE[2*k]));
@@ -2005,8 +2530,6 @@ void VisualizationSceneSolution::PrepareBoundary()
       IntegrationRule &ir = RefG->RefPts;
       IntegrationRule eir(ir.GetNPoints());
       Vector vals;
-      double shr = shrink;
-      shrink = 1.0;
 
       for (i = 0; i < ne; i++)
       {
@@ -2015,6 +2538,8 @@ void VisualizationSceneSolution::PrepareBoundary()
          T = mesh->GetFaceElementTransformations(en, 4);
          T->Loc1.Transform(ir, eir);
          GetRefinedValues(T->Elem1No, eir, vals, pointmat);
+         // only the attributes are shrunk
+         SetShrinkCenters(bdr_buf, pointmat, T->Elem1No, 0, 0, false);
          bl.glBegin(GL_LINE_STRIP);
          for (j = 0; j < vals.Size(); j++)
          {
@@ -2027,6 +2552,7 @@ void VisualizationSceneSolution::PrepareBoundary()
             T = mesh->GetFaceElementTransformations(en, 8);
             T->Loc2.Transform(ir, eir);
             GetRefinedValues(T->Elem2No, eir, vals, pointmat);
+            SetShrinkCenters(bdr_buf, pointmat, T->Elem2No, 0, 0, false);
             bl.glBegin(GL_LINE_STRIP);
             for (j = 0; j < vals.Size(); j++)
             {
@@ -2035,7 +2561,6 @@ void VisualizationSceneSolution::PrepareBoundary()
             bl.glEnd();
          }
       }
-      shrink = shr;
    }
 
    bdr_buf.buffer();
@@ -2095,11 +2620,14 @@ void VisualizationSceneSolution::PrepareCP()
    {
       RefinedGeometry *RefG;
 
+      UpdateAdaptiveRefinement();
       for (int i = 0; i < mesh->GetNE(); i++)
       {
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                            TimesToRefine, EdgeRefineFactor);
+                                            GetRefineFactor(i),
+                                            EdgeRefineFactor);
          GetRefinedValues (i, RefG->RefPts, values, pointmat);
+         ShrinkPoints(pointmat, i, 0, 0);
          Array<int> &RG = RefG->RefGeoms;
          int sides = mesh->GetElement(i)->GetNVertices();
 
@@ -2173,6 +2701,34 @@ void VisualizationSceneSolution::DrawCPLine(
    }
 }
 
+void VisualizationSceneSolution::DrawSurface()
+{
+   if (!drawelems)
+   {
+      return;
+   }
+   if (drawmesh == 2 && LevelCurvesInShader())
+   {
+      EnableShaderIsolines();
+      disp_buf.draw();
+      gl->disableIsolines();
+   }
+   else
+   {
+      disp_buf.draw();
+   }
+}
+
+void VisualizationSceneSolution::DrawLevelCurveLines()
+{
+   // the shader isolines are not used when printing or without the surface
+   if (lcurve_shader != LevelCurvesInShader())
+   {
+      PrepareLevelCurves();
+   }
+   lcurve_buf.draw();
+}
+
 void VisualizationSceneSolution::Draw()
 {
    gl->enableDepthTest();
@@ -2182,6 +2738,7 @@ void VisualizationSceneSolution::Draw()
 
    // model transformation
    ModelView();
+   SetShrinkFactors();
 
    glPolygonOffset (1, 1);
    glEnable (GL_POLYGON_OFFSET_FILL);
@@ -2226,10 +2783,7 @@ void VisualizationSceneSolution::Draw()
    }
 
    // draw elements
-   if (drawelems)
-   {
-      disp_buf.draw();
-   }
+   DrawSurface();
 
    if (MatAlpha < 1.0)
    {
@@ -2266,20 +2820,13 @@ void VisualizationSceneSolution::Draw()
    }
    else if (drawmesh == 2)
    {
-      lcurve_buf.draw();
+      DrawLevelCurveLines();
    }
 
    // draw numberings
    if (drawnums)
    {
-      if (1 == drawnums)
-      {
-         e_nums_buf.draw();
-      }
-      else if (2 == drawnums)
-      {
-         v_nums_buf.draw();
-      }
+      DrawNumbering();
    }
 
    if (draw_cp)
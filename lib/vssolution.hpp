@@ -19,6 +19,7 @@ using namespace mfem;
 #include "aux_gl3.hpp"
 
 #include <map>
+#include <vector>
 
 // Visualization header file
 
@@ -35,14 +36,34 @@ protected:
 
    gl3::GlDrawable e_nums_buf;
    gl3::GlDrawable v_nums_buf;
-   
+
+   // Anchors of the element and vertex numbering labels. Only the labels
+   // that fall in distinct screen tiles are added to e_nums_buf/v_nums_buf.
+   struct NumberingLabel
+   {
+      double x[3], dx;
+      int n;
+   };
+   std::vector<NumberingLabel> e_nums, v_nums;
+   // Screen transformation used for the last label binning
+   glm::mat4 e_nums_view, v_nums_view;
+
    gl3::GlDrawable lcurve_buf;
+   // Set when lcurve_buf was left empty because the level lines are drawn
+   // by the fragment shader on the surface
+   bool lcurve_shader;
+   bool LevelCurvesInShader() { return drawelems && ShaderIsolines(); }
+   // Draw the surface, and the level lines with drawmesh == 2
+   void DrawSurface();
+   void DrawLevelCurveLines();
    gl3::GlDrawable line_buf;
    gl3::GlDrawable bdr_buf;
    gl3::GlDrawable cp_buf;
 
    void Init();
 
+   virtual bool GetTessCacheKey(const char *name, TessCacheKey &key);
+
    void FindNewBox(double rx[], double ry[], double rval[]);
 
    void DrawCPLine(gl3::GlBuilder& bld,
@@ -63,13 +84,48 @@ protected:
                         int flat = 0);
 
    int GetAutoRefineFactor();
+   virtual double EstimateTriangleCount();
+   virtual long long GetTriangleCount();
+
+   // Adaptive subdivision (shading == 2): each element gets its own factor,
+   // a multiple of EdgeRefineFactor up to TimesToRefine, chosen so that the
+   // estimated interpolation error of the surface stays below adaptive_tol
+   // times the value range (and the bounding box size for curved elements).
+   int adaptive_ref;
+   double adaptive_tol;
+   Array<int> el_ref;
+   uint64_t el_ref_stamp;
+
+   void UpdateAdaptiveRefinement();
+   int EstimateRefineFactor(int i, double vtol, double xtol);
+   int GetRefineFactor(int i) const
+   { return adaptive_ref ? el_ref[i] : TimesToRefine; }
+
+   // Values and coordinates at the refined points of element i along the
+   // mesh edge with vertices fv, ordered from fv[0] to fv[1].
+   void GetRefinedEdgeValues(int i, const Array<int> &fv, int n,
+                             Vector &vals, DenseMatrix &tr);
+   // Close the cracks along the edges shared by elements with different
+   // subdivision factors by zipping the two refined edges with triangles.
+   void DrawAdaptiveSeams();
+
+   // True if the refined values agree on the edges shared by two elements, so
+   // that each edge can be drawn only once.
+   virtual bool ContinuousRefinedValues();
 
    // Used for drawing markers for element and vertex numbering
    double GetElementLengthScale(int k);
 
-   // Rendering large numbers of text objects for element or vertex numbering is
-   // slow.  Turn it off above some entity count.
-   static const int MAX_RENDER_NUMBERING = 1000;
+   // Size in pixels of the screen tiles used to declutter element and vertex
+   // numbering: at most one label is drawn per tile.
+   static const int NUMBERING_TILE_SIZE = 48;
+
+   // Bin the label anchors into screen tiles and rebuild the drawable if the
+   // view changed since the last call, except while the view is dragged or
+   // spinning.
+   void DeclutterNumbering(const std::vector<NumberingLabel> &labels,
+                           gl3::GlDrawable &buf, glm::mat4 &view);
+   void DrawNumbering();
 
 public:
    int shading, TimesToRefine, EdgeRefineFactor;
@@ -139,8 +195,12 @@ public:
    void ToggleDrawCP() { draw_cp = !draw_cp; PrepareCP(); }
 
    virtual void SetRefineFactors(int, int);
+   void ToggleAdaptiveRefinement();
    virtual void AutoRefine();
    virtual void ToggleAttributes(Array<int> &attr_list);
+   // Show the surface and mesh line groups of the attributes in
+   // el_attr_to_show
+   void UpdateAttributeVisibility();
 
    virtual void SetDrawMesh(int i) { drawmesh = i % 3; }
    virtual int GetShading() { return shading; }
@@ -13,10 +13,12 @@
 #include <iostream>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 #include "mfem.hpp"
 using namespace mfem;
 #include "visual.hpp"
+#include "minmax.hpp"
 #include "palettes.hpp"
 using namespace std;
 
@@ -65,6 +67,7 @@ static void Solution3dKeyHPressed()
         << "| y/Y  Rotate clipping plane (theta) |" << endl
         << "| z/Z  Translate clipping plane      |" << endl
         << "| Ctrl+p - Print to a PDF file       |" << endl
+        << "| Ctrl+m - Level lines in the shader |" << endl
         << "+------------------------------------+" << endl
         << "| Function keys                      |" << endl
         << "+------------------------------------+" << endl
@@ -171,9 +174,16 @@ static void KeyZPressed()
    SendExposeEvent();
 }
 
-static void KeymPressed()
+static void KeymPressed(GLenum state)
 {
-   vssol3d -> ToggleDrawMesh();
+   if (state & KMOD_CTRL)
+   {
+      vssol3d -> ToggleShaderIsolines();
+   }
+   else
+   {
+      vssol3d -> ToggleDrawMesh();
+   }
    SendExposeEvent();
 }
 
@@ -299,6 +309,27 @@ void ToggleMagicKey()
    magic_key_pressed = 1-magic_key_pressed;
 }
 
+// Scale the shrink factors. They are applied in the vertex shader, so the
+// objects are only prepared again to record the shrink centers, or to shrink
+// shifted faces.
+static void ScaleShrink(double elem_scale, double attr_scale)
+{
+   bool prepare = (vssol3d->ShrinkNeedsPrepare() ||
+                   vssol3d->FaceShiftScale != 0.0);
+   vssol3d->shrink *= elem_scale;
+   vssol3d->shrinkmat *= attr_scale;
+   if (magic_key_pressed)
+   {
+      vssol3d -> Scale(1.0/(elem_scale*attr_scale));
+   }
+   if (prepare)
+   {
+      vssol3d->Prepare();
+      vssol3d->PrepareLines();
+   }
+   SendExposeEvent();
+}
+
 static void KeyF3Pressed()
 {
    if (vssol3d->GetShading() == 2)
@@ -311,14 +342,7 @@ static void KeyF3Pressed()
       {
          vssol3d->ComputeElemAttrCenter();
       }
-      vssol3d->shrink *= 0.9;
-      if (magic_key_pressed)
-      {
-         vssol3d -> Scale(1.11111111111111111111111);
-      }
-      vssol3d->Prepare();
-      vssol3d->PrepareLines();
-      SendExposeEvent();
+      ScaleShrink(0.9, 1.0);
    }
 }
 
@@ -334,14 +358,7 @@ static void KeyF4Pressed()
       {
          vssol3d->ComputeElemAttrCenter();
       }
-      vssol3d->shrink *= 1.11111111111111111111111;
-      if (magic_key_pressed)
-      {
-         vssol3d -> Scale(0.9);
-      }
-      vssol3d->Prepare();
-      vssol3d->PrepareLines();
-      SendExposeEvent();
+      ScaleShrink(1.11111111111111111111111, 1.0);
    }
 }
 
@@ -353,14 +370,7 @@ static void KeyF11Pressed()
       {
          vssol3d->ComputeElemAttrCenter();
       }
-      vssol3d->shrinkmat *= 0.9;
-      if (magic_key_pressed)
-      {
-         vssol3d -> Scale(1.11111111111111111111111);
-      }
-      vssol3d->Prepare();
-      vssol3d->PrepareLines();
-      SendExposeEvent();
+      ScaleShrink(1.0, 0.9);
    }
 }
 
@@ -372,14 +382,7 @@ static void KeyF12Pressed()
       {
          vssol3d->ComputeElemAttrCenter();
       }
-      vssol3d->shrinkmat *= 1.11111111111111111111111;
-      if (magic_key_pressed)
-      {
-         vssol3d -> Scale(0.9);
-      }
-      vssol3d->Prepare();
-      vssol3d->PrepareLines();
-      SendExposeEvent();
+      ScaleShrink(1.0, 1.11111111111111111111111);
    }
 }
 
@@ -447,8 +450,7 @@ static void KeyF9Pressed()
       cout << "Showing " << ((dim == 3) ? "bdr " : "") << "attribute "
            << attr << endl;
    }
-   vssol3d -> PrepareLines();
-   vssol3d -> Prepare();
+   vssol3d -> UpdateAttributeVisibility();
    SendExposeEvent();
 }
 
@@ -493,8 +495,7 @@ static void KeyF10Pressed()
       cout << "Showing " << ((dim == 3) ? "bdr " : "") << "attribute "
            << attr << endl;
    }
-   vssol3d -> PrepareLines();
-   vssol3d -> Prepare();
+   vssol3d -> UpdateAttributeVisibility();
    SendExposeEvent();
 }
 
@@ -600,6 +601,7 @@ void VisualizationSceneSolution3d::Init()
 
    drawelems = shading = 1;
    drawmesh = 0;
+   lines_shader = false;
    scaling = 0;
 
    shrink = 1.0;
@@ -703,12 +705,130 @@ void VisualizationSceneSolution3d::Init()
 
 VisualizationSceneSolution3d::~VisualizationSceneSolution3d()
 {
+   ClearRefinedFaces();
    delete [] node_pos;
 }
 
+void VisualizationSceneSolution3d::ClearRefinedFaces()
+{
+   for (int i = 0; i < ref_faces.Size(); i++)
+   {
+      delete ref_faces[i];
+   }
+   ref_faces.SetSize(0);
+   ref_faces_times = -1;
+}
+
+void VisualizationSceneSolution3d::UpdateRefinedFaces()
+{
+   if (ref_faces_times == TimesToRefine)
+   {
+      return;
+   }
+   ClearRefinedFaces();
+
+   int dim = mesh->Dimension();
+   int nbe = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
+   RefinedGeometry *RefG;
+   IsoparametricTransformation T;
+   Vector normal;
+
+   ref_faces.SetSize(nbe);
+   for (int i = 0; i < nbe; i++)
+   {
+      RefinedFace *rf = new RefinedFace;
+      if (dim == 3)
+      {
+         int fn, fo;
+         mesh->GetBdrElementFace(i, &fn, &fo);
+         RefG = GLVisGeometryRefiner.Refine(mesh->GetFaceBaseGeometry(fn),
+                                            TimesToRefine);
+         // this assumes the interior boundary faces are properly oriented ...
+         rf->side = fo % 2;
+         if (rf->side == 1 && !mesh->FaceIsInterior(fn))
+         {
+            rf->side = 0;
+         }
+         // match the way GridFunction::GetFaceValues works
+         FaceElementTransformations *Tr;
+         rf->eir.SetSize(RefG->RefPts.GetNPoints());
+         if (rf->side == 0)
+         {
+            Tr = mesh->GetFaceElementTransformations(fn, 5);
+            rf->elem = Tr->Elem1No;
+            Tr->Loc1.Transform(RefG->RefPts, rf->eir);
+            Tr->Elem1->Transform(rf->eir, rf->points);
+         }
+         else
+         {
+            Tr = mesh->GetFaceElementTransformations(fn, 10);
+            rf->elem = Tr->Elem2No;
+            Tr->Loc2.Transform(RefG->RefPts, rf->eir);
+            Tr->Elem2->Transform(rf->eir, rf->points);
+         }
+         GetFaceNormals(fn, rf->side, RefG->RefPts, rf->normals);
+      }
+      else
+      {
+         RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
+                                            TimesToRefine);
+         const IntegrationRule &ir = RefG->RefPts;
+         rf->elem = i;
+         rf->side = 0;
+         rf->eir.SetSize(ir.GetNPoints());
+         for (int j = 0; j < ir.GetNPoints(); j++)
+         {
+            rf->eir.IntPoint(j) = ir.IntPoint(j);
+         }
+         mesh->GetElementTransformation(i, &T);
+         T.Transform(ir, rf->points);
+         rf->normals.SetSize(3, ir.GetNPoints());
+         for (int j = 0; j < ir.GetNPoints(); j++)
+         {
+            T.SetIntPoint(&ir.IntPoint(j));
+            const DenseMatrix &J = T.Jacobian();
+            rf->normals.GetColumnReference(j, normal);
+            CalcOrtho(J, normal);
+            normal /= normal.Norml2();
+         }
+      }
+      ref_faces[i] = rf;
+   }
+   ref_faces_times = TimesToRefine;
+}
+
+bool VisualizationSceneSolution3d::GetTessCacheKey(const char *name,
+                                                   TessCacheKey &key)
+{
+   if (!InitTessCacheKey(name, GridF, key))
+   {
+      return false;
+   }
+   key.Add(shading);
+   key.Add(TimesToRefine);
+   key.Add(FaceShiftScale);
+   key.Add(drawmesh);
+   if (drawmesh == 2)
+   {
+      // the level lines are built on the CPU
+      key.Add(levels.Size());
+      key.Add(levels.GetData(), levels.Size()*sizeof(double));
+   }
+   key.Add(cplane);
+   if (cplane == 2)
+   {
+      key.Add(CuttingPlane->Equation(), 4*sizeof(double));
+   }
+   return true;
+}
+
 void VisualizationSceneSolution3d::NewMeshAndSolution(
    Mesh *new_m, Vector *new_sol, GridFunction *new_u)
 {
+   // A script can show several solutions on the same mesh: then only the
+   // data that depends on the solution is updated.
+   const bool same_mesh = (new_m == mesh);
+
    if (mesh->GetNV() != new_m->GetNV())
    {
       delete [] node_pos;
@@ -730,9 +850,19 @@ void VisualizationSceneSolution3d::NewMeshAndSolution(
    mesh = new_m;
    sol = new_sol;
    GridF = new_u;
-   FindNodePos();
-
-   DoAutoscale(false);
+   ResetContentKey();
+   if (!same_mesh)
+   {
+      ResetAttributeTables();
+      ClearRefinedFaces();
+      FindNodePos();
+      DoAutoscale(false);
+   }
+   else if (autoscale == 1 || autoscale == 2)
+   {
+      // the bounding box depends only on the mesh
+      FindNewValueRange(false);
+   }
 
    Prepare();
    PrepareLines();
@@ -802,6 +932,11 @@ void VisualizationSceneSolution3d::SetRefineFactors(int f, int ignored)
 
 int VisualizationSceneSolution3d::GetAutoRefineFactor()
 {
+   if (auto_ref_tri_budget > 0)
+   {
+      return GetBudgetRefineFactor();
+   }
+
    int ne = mesh->GetNBE(), ref = 1;
    if (mesh->Dimension() == 2)
    {
@@ -816,6 +951,87 @@ int VisualizationSceneSolution3d::GetAutoRefineFactor()
    return ref;
 }
 
+double VisualizationSceneSolution3d::EstimateTriangleCount()
+{
+   int dim = mesh->Dimension();
+   double tris = 0.0;
+
+   if (drawelems)
+   {
+      int nf = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
+      for (int i = 0; i < nf; i++)
+      {
+         int attr = (dim == 3) ? mesh->GetBdrAttribute(i) :
+                    mesh->GetAttribute(i);
+         if (!bdr_attr_to_show[attr-1]) { continue; }
+         tris += ((dim == 3) ? mesh->GetBdrElement(i)->GetNVertices() :
+                  mesh->GetElement(i)->GetNVertices()) - 2;
+      }
+   }
+   if (dim != 3)
+   {
+      return tris;
+   }
+
+   // Level surfaces and cutting plane: a planar cut through a refined tet
+   // gives about 2 triangles per factor^2, through a refined hex (split into
+   // 6 tets) about 4.
+   Array<int> vertices;
+   Array<int> partition(mesh->GetNE());
+   for (int i = 0; i < mesh->GetNE(); i++)
+   {
+      mesh->GetElementVertices(i, vertices);
+      double cut_tris = (vertices.Size() == 4) ? 2.0 : 4.0;
+      if (drawlsurf)
+      {
+         double vmin = numeric_limits<double>::infinity(), vmax = -vmin;
+         for (int j = 0; j < vertices.Size(); j++)
+         {
+            vmin = fmin(vmin, (*sol)(vertices[j]));
+            vmax = fmax(vmax, (*sol)(vertices[j]));
+         }
+         for (int l = 0; l < nlevels; l++)
+         {
+            double lvl = ULogVal((double)(50*l+drawlsurf) / (nlevels*50));
+            if (vmin <= lvl && lvl <= vmax) { tris += cut_tris; }
+         }
+      }
+      int n = 0;
+      for (int j = 0; j < vertices.Size(); j++)
+      {
+         if (CuttingPlane->Transform(mesh->GetVertex(vertices[j])) >= 0.0)
+         {
+            n++;
+         }
+      }
+      partition[i] = (n == vertices.Size()) ? 0 : 1;
+      if (cplane == 1 && cp_drawelems && n > 0 && n < vertices.Size())
+      {
+         tris += cut_tris;
+      }
+   }
+   if (cplane == 2 && cp_drawelems)
+   {
+      for (int f = 0; f < mesh->GetNFaces(); f++)
+      {
+         int e1, e2;
+         mesh->GetFaceElements(f, &e1, &e2);
+         if (e2 >= 0 && partition[e1] != partition[e2])
+         {
+            mesh->GetFaceVertices(f, vertices);
+            tris += vertices.Size() - 2;
+         }
+      }
+   }
+   return tris;
+}
+
+long long VisualizationSceneSolution3d::GetTriangleCount()
+{
+   return (disp_buf.getTriangleCount() + lsurf_buf.getTriangleCount() +
+           cplane_buf.getTriangleCount());
+}
+
 void VisualizationSceneSolution3d::AutoRefine()
 {
    int ref = GetAutoRefineFactor();
@@ -850,88 +1066,65 @@ void VisualizationSceneSolution3d::ToggleAttributes(Array<int> &attr_list)
          attr_marker[attr-1] = !attr_marker[attr-1];
       }
    }
-   PrepareLines();
-   Prepare();
+   UpdateAttributeVisibility();
 }
 
-void VisualizationSceneSolution3d::FindNewBox(bool prepare)
+void VisualizationSceneSolution3d::UpdateAttributeVisibility()
 {
-   int nv = mesh -> GetNV();
-
-   double *coord = mesh->GetVertex(0);
+   // the surface and the mesh lines are grouped by attribute, so they are
+   // not prepared again
+   for (int a = 0; a < bdr_attr_to_show.Size(); a++)
+   {
+      disp_buf.setGroupVisible(a, bdr_attr_to_show[a]);
+      line_buf.setGroupVisible(a, bdr_attr_to_show[a]);
+   }
+}
 
-   x[0] = x[1] = coord[0];
-   y[0] = y[1] = coord[1];
-   z[0] = z[1] = coord[2];
+void VisualizationSceneSolution3d::FindNewBox(bool prepare)
+{
+   MinMaxBox box;
 
-   for (int i = 1; i < nv; i++)
+   // the mesh vertices are stored as consecutive (x,y,z) triples
+   static_assert(sizeof(Vertex) == 3*sizeof(double),
+                 "the mesh vertices are not packed (x,y,z) triples");
+   if (mesh->GetNV() > 0)
    {
-      coord = mesh->GetVertex(i);
-      if (coord[0] < x[0]) { x[0] = coord[0]; }
-      if (coord[1] < y[0]) { y[0] = coord[1]; }
-      if (coord[2] < z[0]) { z[0] = coord[2]; }
-      if (coord[0] > x[1]) { x[1] = coord[0]; }
-      if (coord[1] > y[1]) { y[1] = coord[1]; }
-      if (coord[2] > z[1]) { z[1] = coord[2]; }
+      MinMaxReduce(mesh->GetVertex(0), mesh->GetNV(), 3, 3, box);
    }
 
    if (shading == 2)
    {
-      int dim = mesh->Dimension();
-      int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
-      int fn, fo;
-      DenseMatrix pointmat;
-      RefinedGeometry *RefG;
-      IntegrationRule eir;
-      FaceElementTransformations *Tr;
-      ElementTransformation *T;
-
-      for (int i = 0; i < ne; i++)
+      UpdateRefinedFaces();
+      // the refined faces are only read, so they are split between threads
+      ParallelMinMax(ref_faces.Size(), 1024, box,
+                     [this](size_t begin, size_t end, MinMaxBox &b)
       {
-         if (dim == 3)
+         for (int i = (int) begin; i < (int) end; i++)
          {
-            mesh->GetBdrElementFace(i, &fn, &fo);
-            RefG = GLVisGeometryRefiner.Refine(mesh->GetFaceBaseGeometry(fn),
-                                               TimesToRefine);
-            Tr = mesh->GetFaceElementTransformations(fn, 5);
-            eir.SetSize(RefG->RefPts.GetNPoints());
-            Tr->Loc1.Transform(RefG->RefPts, eir);
-            Tr->Elem1->Transform(eir, pointmat);
-         }
-         else
-         {
-            T = mesh->GetElementTransformation(i);
-            RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
-                                               TimesToRefine);
-            T->Transform(RefG->RefPts, pointmat);
-         }
-         for (int j = 0; j < pointmat.Width(); j++)
-         {
-            if (pointmat(0,j) < x[0]) { x[0] = pointmat(0,j); }
-            if (pointmat(1,j) < y[0]) { y[0] = pointmat(1,j); }
-            if (pointmat(2,j) < z[0]) { z[0] = pointmat(2,j); }
-            if (pointmat(0,j) > x[1]) { x[1] = pointmat(0,j); }
-            if (pointmat(1,j) > y[1]) { y[1] = pointmat(1,j); }
-            if (pointmat(2,j) > z[1]) { z[1] = pointmat(2,j); }
+            const DenseMatrix &pointmat = ref_faces[i]->points;
+            b.Add(pointmat.Data(), pointmat.Width(), 3, pointmat.Height());
          }
-      }
+      });
    }
 
+   x[0] = box.min[0];
+   x[1] = box.max[0];
+   y[0] = box.min[1];
+   y[1] = box.max[1];
+   z[0] = box.min[2];
+   z[1] = box.max[2];
+
    UpdateBoundingBox();
 }
 
 void VisualizationSceneSolution3d::FindNewValueRange(bool prepare)
 {
-   if (shading < 2)
-   {
-      minv = sol->Min();
-      maxv = sol->Max();
-   }
-   else
-   {
-      minv = GridF->Min();
-      maxv = GridF->Max();
-   }
+   // a single pass over the data for both ends of the range
+   const Vector &data = (shading < 2) ? *sol : *GridF;
+   MinMaxBox box;
+   MinMaxReduce(data.GetData(), data.Size(), 1, 1, box);
+   minv = box.min[0];
+   maxv = box.max[0];
    FixValueRange();
    UpdateValueRange(prepare);
 }
@@ -1223,6 +1416,12 @@ void VisualizationSceneSolution3d::DrawRefinedSurf(
    double norm[3], pts[4][3];
    gl3::GlBuilder draw = cplane_buf.createBuilder();
 
+   // DrawRefinedSurf() is called for every face, keep the colors between
+   // calls
+   static std::vector<MappedColor> colors;
+   colors.resize(values.Size());
+   MySetColors(values.GetData(), values.Size(), minv, maxv, colors.data());
+
    for (int i = 0; i < RefGeoms.Size()/n; i++)
    {
       int *RG = &(RefGeoms[i*n]);
@@ -1246,7 +1445,7 @@ void VisualizationSceneSolution3d::DrawRefinedSurf(
          draw.glNormal3dv (norm);
          for (j = 0; j < n; j++)
          {
-            MySetColor (draw, values(RG[j]), minv, maxv);
+            MySetColor (draw, colors[RG[j]]);
             draw.glVertex3dv (pts[j]);
          }
          draw.glEnd();
@@ -1323,12 +1522,14 @@ void VisualizationSceneSolution3d::PrepareFlat()
    Array<int> vertices;
    double p[4][3], c[4];
 
-   for (i = 0; i < ne; i++)
+   const int *el_order = GetAttributeOrder(dim == 3);
+   for (int io = 0; io < ne; io++)
    {
+      i = el_order[io];
+      disp_buf.beginGroup(GetSurfaceAttribute(i)-1);
+
       if (dim == 3)
       {
-         if (!bdr_attr_to_show[mesh->GetBdrAttribute(i)-1]) { continue; }
-
          if (cplane == 2)
          {
             // for cplane == 2, get vertices of the volume element, not bdr
@@ -1344,8 +1545,6 @@ void VisualizationSceneSolution3d::PrepareFlat()
       }
       else
       {
-         if (!bdr_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
-
          mesh->GetElementVertices(i, vertices);
       }
 
@@ -1388,23 +1587,25 @@ void VisualizationSceneSolution3d::PrepareFlat2()
    int dim = mesh->Dimension();
    int nbe = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
    DenseMatrix pointmat, normals;
-   Vector values, normal;
+   Vector values;
    RefinedGeometry * RefG;
    Array<int> vertices;
    double norm[3];
-   IsoparametricTransformation T;
 
    bbox_diam = sqrt ( (x[1]-x[0])*(x[1]-x[0]) +
                       (y[1]-y[0])*(y[1]-y[0]) +
                       (z[1]-z[0])*(z[1]-z[0]) );
    double sc = FaceShiftScale * bbox_diam;
 
+   UpdateRefinedFaces();
+
    vmin = numeric_limits<double>::infinity();
    vmax = -vmin;
-   for (i = 0; i < nbe; i++) {
+   const int *el_order = GetAttributeOrder(dim == 3);
+   for (int io = 0; io < nbe; io++) {
+      i = el_order[io];
+      disp_buf.beginGroup(GetSurfaceAttribute(i)-1);
       if (dim == 3) {
-         if (!bdr_attr_to_show[mesh->GetBdrAttribute(i)-1]) { continue; }
-
          if (cplane == 2) {
             // for cplane == 2, get vertices of the volume element, not bdr
             int f, o, e1, e2;
@@ -1415,42 +1616,29 @@ void VisualizationSceneSolution3d::PrepareFlat2()
             mesh->GetBdrElementVertices(i, vertices);
          }
       } else {
-         if (!bdr_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
          mesh->GetElementVertices(i, vertices);
       }
       if (cplane == 2 && CheckPositions(vertices)) { continue; }
+      const RefinedFace &rf = *ref_faces[i];
+      GridF->GetValues(rf.elem, rf.eir, values);
+      pointmat = rf.points;
+      normals = rf.normals;
+      have_normals = 1;
+      di = rf.side;
       if (dim == 3) {
          mesh -> GetBdrElementFace (i, &fn, &fo);
          RefG = GLVisGeometryRefiner.Refine(mesh -> GetFaceBaseGeometry (fn),
                                             TimesToRefine);
-         // di = GridF -> GetFaceValues (fn, 2, RefG->RefPts, values, pointmat);
-
-         // this assumes the interior boundary faces are properly oriented ...
-         di = fo % 2;
-         if (di == 1 && !mesh->FaceIsInterior(fn)) {
-            di = 0;
-         }
-         GridF -> GetFaceValues (fn, di, RefG->RefPts, values, pointmat);
-         GetFaceNormals(fn, di, RefG->RefPts, normals);
-         have_normals = 1;
-         ShrinkPoints(pointmat, i, fn, di);
       } else {
+         fn = 0;
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
                                             TimesToRefine);
-         const IntegrationRule &ir = RefG->RefPts;
-         GridF->GetValues(i, ir, values, pointmat);
-         normals.SetSize(3, values.Size());
-         mesh->GetElementTransformation(i, &T);
-         for (int j = 0; j < values.Size(); j++) {
-            T.SetIntPoint(&ir.IntPoint(j));
-            const DenseMatrix &J = T.Jacobian();
-            normals.GetColumnReference(j, normal);
-            CalcOrtho(J, normal);
-            normal /= normal.Norml2();
-         }
-         have_normals = 1;
-         di = 0;
-         ShrinkPoints(pointmat, i, 0, 0);
+      }
+      // the shift of the faces is applied after shrinking them, on the CPU
+      if (sc != 0.0) {
+         ShrinkPoints(pointmat, i, fn, (dim == 3) ? di : 0);
+      } else {
+         SetShrinkCenters(disp_buf, pointmat, i, fn, (dim == 3) ? di : 0);
       }
 
       vmin = fmin(vmin, values.Min());
@@ -1520,13 +1708,22 @@ void VisualizationSceneSolution3d::Prepare()
       return;
    }
 
+   TessCacheKey cache_key;
+   const bool cached = GetTessCacheKey("surface", cache_key);
+   if (cached && TessCacheLoad(cache_key, disp_buf))
+   {
+      return;
+   }
+
    switch (shading)
    {
        case 0:
            PrepareFlat();
+           if (cached) { TessCacheSave(cache_key, disp_buf); }
            return;
        case 2:
            PrepareFlat2();
+           if (cached) { TessCacheSave(cache_key, disp_buf); }
            return;
        default:
            break;
@@ -1536,43 +1733,48 @@ void VisualizationSceneSolution3d::Prepare()
    gl3::GlBuilder poly = disp_buf.createBuilder();
    
    int dim = mesh->Dimension();
-   int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
    int nv = mesh -> GetNV();
    DenseMatrix pointmat;
    Array<int> vertices;
-   double nor[3];
 
    Vector nx(nv);
    Vector ny(nv);
    Vector nz(nv);
 
-   Table ba_to_be; // boundary_attribute--to--boundary_element
+   std::vector<MappedColor> colors(sol->Size());
+   MySetColors(sol->GetData(), sol->Size(), minv, maxv, colors.data());
+
+   // The unit normals of the (boundary) elements, computed in parallel;
+   // degenerate elements get a zero normal.
+   const int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
+   std::vector<double> el_nor(3*ne, 0.0);
+   ParallelFor(ne, NORMALS_GRAIN, [&](size_t begin, size_t end)
    {
-      Table be_to_ba;
-      be_to_ba.MakeI(ne);
-      for (int i = 0; i < ne; i++)
+      DenseMatrix pm;
+      for (size_t e = begin; e < end; e++)
       {
-         be_to_ba.AddAColumnInRow(i);
-      }
-      be_to_ba.MakeJ();
-      if (dim == 3)
-      {
-         for (int i = 0; i < ne; i++)
+         if (dim == 3)
          {
-            be_to_ba.AddConnection(i, mesh->GetBdrAttribute(i)-1);
+            mesh->GetBdrPointMatrix(e, pm);
          }
-      }
-      else
-      {
-         for (int i = 0; i < ne; i++)
+         else
+         {
+            mesh->GetPointMatrix(e, pm);
+         }
+         double *en = &el_nor[3*e];
+         const int err = (pm.Width() == 3) ?
+                         Compute3DUnitNormal(&pm(0,0), &pm(0,1), &pm(0,2), en) :
+                         Compute3DUnitNormal(&pm(0,0), &pm(0,1), &pm(0,2),
+                                             &pm(0,3), en);
+         if (err)
          {
-            be_to_ba.AddConnection(i, mesh->GetAttribute(i)-1);
+            en[0] = en[1] = en[2] = 0.0;
          }
       }
-      be_to_ba.ShiftUpI();
+   });
 
-      Transpose(be_to_ba, ba_to_be);
-   }
+   // boundary_attribute--to--boundary_element
+   const Table &ba_to_be = GetAttributeElements(dim == 3);
 
    const Array<int> &attributes =
       ((dim == 3) ? mesh->bdr_attributes : mesh->attributes);
@@ -1580,7 +1782,7 @@ void VisualizationSceneSolution3d::Prepare()
    {
       const int attr = attributes[d]-1;
 
-      if (!bdr_attr_to_show[attr]) { continue; }
+      disp_buf.beginGroup(attr);
 
       const int nelem = ba_to_be.RowSize(attr);
       const int *elem = ba_to_be.GetRow(attr);
@@ -1604,28 +1806,19 @@ void VisualizationSceneSolution3d::Prepare()
       {
          if (dim == 3)
          {
-            mesh->GetBdrPointMatrix(elem[i], pointmat);
             mesh->GetBdrElementVertices(elem[i], vertices);
          }
          else
          {
-            mesh->GetPointMatrix(elem[i], pointmat);
             mesh->GetElementVertices(elem[i], vertices);
          }
-
-         if (pointmat.Width() == 3)
-            j = Compute3DUnitNormal(&pointmat(0,0), &pointmat(0,1),
-                                    &pointmat(0,2), nor);
-         else
-            j = Compute3DUnitNormal(&pointmat(0,0), &pointmat(0,1),
-                                    &pointmat(0,2), &pointmat(0,3), nor);
-         if (j == 0)
-            for (j = 0; j < pointmat.Size(); j++)
-            {
-               nx(vertices[j]) += nor[0];
-               ny(vertices[j]) += nor[1];
-               nz(vertices[j]) += nor[2];
-            }
+         const double *en = &el_nor[3*elem[i]];
+         for (j = 0; j < vertices.Size(); j++)
+         {
+            nx(vertices[j]) += en[0];
+            ny(vertices[j]) += en[1];
+            nz(vertices[j]) += en[2];
+         }
       }
 
       for (i = 0; i < nelem; i++)
@@ -1636,7 +1829,7 @@ void VisualizationSceneSolution3d::Prepare()
             {
                // for cplane == 2, get vertices of the volume element, not bdr
                int f, o, e1, e2;
-               mesh->GetBdrElementFace(i, &f, &o);
+               mesh->GetBdrElementFace(elem[i], &f, &o);
                mesh->GetFaceElements(f, &e1, &e2);
                mesh->GetElementVertices(e1, vertices);
 
@@ -1676,7 +1869,7 @@ void VisualizationSceneSolution3d::Prepare()
 
          for (j = 0; j < pointmat.Size(); j++)
          {
-            MySetColor(poly, (*sol)(vertices[j]), minv, maxv);
+            MySetColor(poly, colors[vertices[j]]);
             poly.glNormal3d(nx(vertices[j]), ny(vertices[j]), nz(vertices[j]));
             poly.glVertex3dv(&pointmat(0, j));
          }
@@ -1684,6 +1877,7 @@ void VisualizationSceneSolution3d::Prepare()
       }
    }
    disp_buf.buffer();
+   if (cached) { TessCacheSave(cache_key, disp_buf); }
 }
 
 void VisualizationSceneSolution3d::PrepareLines()
@@ -1693,27 +1887,55 @@ void VisualizationSceneSolution3d::PrepareLines()
       return;
    }
 
+   lines_shader = LevelCurvesInShader();
+   if (lines_shader)
+   {
+      // changing the levels only updates the isoline uniforms
+      line_buf.clear();
+      line_buf.buffer();
+      return;
+   }
+
+   TessCacheKey cache_key;
+   const bool cached = GetTessCacheKey("lines", cache_key);
+   if (cached && TessCacheLoad(cache_key, line_buf))
+   {
+      return;
+   }
+
    if (shading == 2)
    {
       PrepareLines2();
+      if (cached) { TessCacheSave(cache_key, line_buf); }
       return;
    }
 
    int dim = mesh->Dimension();
    int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
-   int i, j, k;
+   int i, j, k, attr;
    DenseMatrix pointmat;
 
    line_buf.clear();
 
-   Array<int> vertices;
+   Array<int> vertices, edges, cor;
 
-   for (i = 0; i < ne; i++)
+   // The lines are grouped by attribute. Each edge of the mesh is drawn once
+   // per attribute, by the first (boundary) element containing it.
+   Array<int> edge_attr;
+   if (drawmesh == 1)
    {
+      edge_attr.SetSize(mesh->GetNEdges());
+      edge_attr = -1;
+   }
+
+   const int *el_order = GetAttributeOrder(dim == 3);
+   for (int io = 0; io < ne; io++)
+   {
+      i = el_order[io];
+      line_buf.beginGroup(GetSurfaceAttribute(i)-1);
+
       if (dim == 3)
       {
-         if (!bdr_attr_to_show[mesh->GetBdrAttribute(i)-1]) { continue; }
-
          if (cplane == 2)
          {
             // for cplane == 2, get vertices of the volume element, not bdr
@@ -1729,8 +1951,6 @@ void VisualizationSceneSolution3d::PrepareLines()
       }
       else
       {
-         if (!bdr_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
-
          mesh->GetElementVertices(i, vertices);
       }
 
@@ -1750,11 +1970,25 @@ void VisualizationSceneSolution3d::PrepareLines()
       switch (drawmesh)
       {
          case 1:
-            line.glBegin(GL_LINE_LOOP);
-
-            for (j = 0; j < pointmat.Size(); j++)
+            if (dim == 3)
             {
+               mesh->GetBdrElementEdges(i, edges, cor);
+            }
+            else
+            {
+               mesh->GetElementEdges(i, edges, cor);
+            }
+            attr = GetSurfaceAttribute(i);
+            // local edge j connects the vertices j and j+1
+            line.glBegin(GL_LINES);
+            for (j = 0; j < edges.Size(); j++)
+            {
+               if (edge_attr[edges[j]] == attr) { continue; }
+               edge_attr[edges[j]] = attr;
+
+               int j1 = (j+1) % pointmat.Size();
                line.glVertex3d (pointmat(0, j), pointmat(1, j), pointmat(2, j));
+               line.glVertex3d (pointmat(0, j1), pointmat(1, j1), pointmat(2, j1));
             }
             line.glEnd();
             break;
@@ -1773,6 +2007,7 @@ void VisualizationSceneSolution3d::PrepareLines()
       }
    }
    line_buf.buffer();
+   if (cached) { TessCacheSave(cache_key, line_buf); }
 }
 
 void VisualizationSceneSolution3d::PrepareLines2()
@@ -1784,23 +2019,37 @@ void VisualizationSceneSolution3d::PrepareLines2()
 
    int dim = mesh->Dimension();
    int nbe = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
-   DenseMatrix pointmat, normals;
-   Vector values, normal;
+   DenseMatrix pointmat;
+   Vector values;
    RefinedGeometry * RefG;
    Array<int> vertices;
-   IsoparametricTransformation T;
 
    bbox_diam = sqrt ( (x[1]-x[0])*(x[1]-x[0]) +
                       (y[1]-y[0])*(y[1]-y[0]) +
                       (z[1]-z[0])*(z[1]-z[0]) );
    double sc = FaceShiftScale * bbox_diam;
 
-   for (i = 0; i < nbe; i++)
+   // Without shrinking or shifting of the faces, each edge of the mesh is
+   // drawn once per attribute, by the first face containing it.
+   Array<int> edges, cor, edge_owner;
+   bool unique_edges = (drawmesh == 1 && sc == 0.0 &&
+                        shrink == 1.0 && shrinkmat == 1.0);
+   if (unique_edges)
    {
+      edge_owner.SetSize(mesh->GetNEdges());
+      edge_owner = -1;
+   }
+
+   UpdateRefinedFaces();
+
+   const int *el_order = GetAttributeOrder(dim == 3);
+   for (int io = 0; io < nbe; io++)
+   {
+      i = el_order[io];
+      line_buf.beginGroup(GetSurfaceAttribute(i)-1);
+
       if (dim == 3)
       {
-         if (!bdr_attr_to_show[mesh->GetBdrAttribute(i)-1]) { continue; }
-
          if (cplane == 2)
          {
             // for cplane == 2, get vertices of the volume element, not bdr
@@ -1816,54 +2065,40 @@ void VisualizationSceneSolution3d::PrepareLines2()
       }
       else
       {
-         if (!bdr_attr_to_show[mesh->GetAttribute(i)-1]) { continue; }
-
          mesh->GetElementVertices(i, vertices);
       }
 
       if (cplane == 2 && CheckPositions(vertices)) { continue; }
 
+      const RefinedFace &rf = *ref_faces[i];
+      GridF->GetValues(rf.elem, rf.eir, values);
+      pointmat = rf.points;
+      di = rf.side;
       if (dim == 3)
       {
          mesh -> GetBdrElementFace (i, &fn, &fo);
          RefG = GLVisGeometryRefiner.Refine(mesh -> GetFaceBaseGeometry (fn),
                                             TimesToRefine);
-         // di = GridF -> GetFaceValues (fn, 2, RefG->RefPts, values, pointmat);
-         di = fo % 2;
-         if (di == 1 && !mesh->FaceIsInterior(fn))
-         {
-            di = 0;
-         }
-         GridF -> GetFaceValues (fn, di, RefG->RefPts, values, pointmat);
-         ShrinkPoints(pointmat, i, fn, di);
       }
       else
       {
+         fn = 0;
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
                                             TimesToRefine);
-         GridF->GetValues(i, RefG->RefPts, values, pointmat);
-         ShrinkPoints(pointmat, i, 0, 0);
+      }
+      // the shift of the faces is applied after shrinking them, on the CPU
+      if (sc != 0.0)
+      {
+         ShrinkPoints(pointmat, i, fn, (dim == 3) ? di : 0);
+      }
+      else
+      {
+         SetShrinkCenters(line_buf, pointmat, i, fn, (dim == 3) ? di : 0);
       }
 
       if (sc != 0.0)
       {
-         if (dim == 3)
-         {
-            GetFaceNormals(fn, di, RefG->RefPts, normals);
-         }
-         else
-         {
-            normals.SetSize(3, values.Size());
-            mesh->GetElementTransformation(i, &T);
-            for (int j = 0; j < values.Size(); j++)
-            {
-               T.SetIntPoint(&RefG->RefPts.IntPoint(j));
-               const DenseMatrix &J = T.Jacobian();
-               normals.GetColumnReference(j, normal);
-               CalcOrtho(J, normal);
-               normal /= normal.Norml2();
-            }
-         }
+         const DenseMatrix &normals = rf.normals;
          double norm[3];
          for (int i = 0; i < 3; i++)
          {
@@ -1898,11 +2133,42 @@ void VisualizationSceneSolution3d::PrepareLines2()
       if (drawmesh == 1)
       {
          Array<int> &REdges = RefG->RefEdges;
+         int geom = 0;
+         if (unique_edges)
+         {
+            if (dim == 3)
+            {
+               geom = mesh->GetFaceBaseGeometry(fn);
+               mesh->GetFaceEdges(fn, edges, cor);
+            }
+            else
+            {
+               geom = mesh->GetElementBaseGeometry(i);
+               mesh->GetElementEdges(i, edges, cor);
+            }
+         }
 
          line.glBegin(GL_LINES);
-         for (k = 0; k < REdges.Size(); k++)
+         for (k = 0; k < REdges.Size()/2; k++)
          {
-            line.glVertex3dv(&pointmat(0, REdges[k]));
+            if (unique_edges)
+            {
+               int le = GetRefinedEdgeLocalIndex(
+                           geom, RefG->RefPts.IntPoint(REdges[2*k]),
+                           RefG->RefPts.IntPoint(REdges[2*k+1]));
+               if (le >= 0)
+               {
+                  int &owner = edge_owner[edges[le]];
+                  if (owner < 0 ||
+                      GetSurfaceAttribute(owner) != GetSurfaceAttribute(i))
+                  {
+                     owner = i;
+                  }
+                  if (owner != i) { continue; }
+               }
+            }
+            line.glVertex3dv(&pointmat(0, REdges[2*k]));
+            line.glVertex3dv(&pointmat(0, REdges[2*k+1]));
          }
          line.glEnd();
       }
@@ -2601,10 +2867,16 @@ void VisualizationSceneSolution3d::PrepareLevelSurf()
       {
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(ie),
                                             TimesToRefine);
-         GridF->GetValues(ie, RefG->RefPts, vals, pointmat);
+         if (!tensor_eval.GetValues(*GridF, ie, RefG->RefPts, vals, pointmat))
+         {
+            GridF->GetValues(ie, RefG->RefPts, vals, pointmat);
+         }
 #define GLVIS_SMOOTH_LEVELSURF_NORMALS
 #ifdef GLVIS_SMOOTH_LEVELSURF_NORMALS
-         GridF->GetGradients(ie, RefG->RefPts, grad);
+         if (!tensor_eval.GetGradients(*GridF, ie, RefG->RefPts, grad))
+         {
+            GridF->GetGradients(ie, RefG->RefPts, grad);
+         }
 #endif
 
          Array<int> &RG = RefG->RefGeoms;
@@ -2649,6 +2921,38 @@ void VisualizationSceneSolution3d::PrepareLevelSurf()
 #endif
 }
 
+void VisualizationSceneSolution3d::DrawSurface()
+{
+   if (!drawelems)
+   {
+      return;
+   }
+   if (LevelCurvesInShader())
+   {
+      EnableShaderIsolines();
+      disp_buf.draw();
+      gl->disableIsolines();
+   }
+   else
+   {
+      disp_buf.draw();
+   }
+}
+
+void VisualizationSceneSolution3d::DrawLines()
+{
+   if (!drawmesh)
+   {
+      return;
+   }
+   // the shader isolines are not used when printing or without the surface
+   if (drawmesh == 2 && lines_shader != LevelCurvesInShader())
+   {
+      PrepareLines();
+   }
+   line_buf.draw();
+}
+
 void VisualizationSceneSolution3d::Draw()
 {
    gl->enableDepthTest();
@@ -2658,6 +2962,7 @@ void VisualizationSceneSolution3d::Draw()
 
    // model transformation
    ModelView();
+   SetShrinkFactors();
 
    // draw colored faces
    glPolygonOffset (1, 1);
@@ -2728,10 +3033,7 @@ void VisualizationSceneSolution3d::Draw()
    }
 
    // draw elements
-   if (drawelems)
-   {
-       disp_buf.draw();
-   }
+   DrawSurface();
 
    if (cplane && cp_drawelems)
    {
@@ -2767,10 +3069,7 @@ void VisualizationSceneSolution3d::Draw()
       DrawRuler();
    }
    // draw lines
-   if (drawmesh)
-   {
-      line_buf.draw();
-   }
+   DrawLines();
 
    if (cplane)
    {
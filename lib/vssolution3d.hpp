@@ -32,6 +32,15 @@ protected:
    gl3::GlDrawable lsurf_buf;
    gl3::GlDrawable other_buf;
 
+   // Set when the level lines of drawmesh == 2 are left out of line_buf
+   // because they are drawn by the fragment shader on the surface
+   bool lines_shader;
+   bool LevelCurvesInShader()
+   { return drawmesh == 2 && drawelems && ShaderIsolines(); }
+   // Draw the surface, and its level lines with drawmesh == 2
+   void DrawSurface();
+   void DrawLines();
+
    double *node_pos;
 
    int nlevels;
@@ -39,8 +48,27 @@ protected:
 
    GridFunction *GridF;
 
+   // Refined geometry of the boundary faces (of the elements for 2D meshes)
+   // used with shading == 2: the refined points in the reference coordinates
+   // of the adjacent element, their physical coordinates and the normals.
+   // Shared by FindNewBox(), PrepareFlat2() and PrepareLines2(); rebuilt when
+   // TimesToRefine changes and cleared for a new mesh.
+   struct RefinedFace
+   {
+      int elem, side;
+      IntegrationRule eir;
+      DenseMatrix points, normals;
+   };
+   Array<RefinedFace *> ref_faces;
+   int ref_faces_times = -1;
+
+   void UpdateRefinedFaces();
+   void ClearRefinedFaces();
+
    void Init();
 
+   virtual bool GetTessCacheKey(const char *name, TessCacheKey &key);
+
    void GetFaceNormals(const int FaceNo, const int side,
                        const IntegrationRule &ir, DenseMatrix &normals);
 
@@ -59,7 +87,17 @@ protected:
                          const int *ind, const Array<double> &levels,
                          const DenseMatrix *grad = NULL);
 
+   // Attribute of the surface element i: a boundary element of 3D meshes or
+   // an element of 2D meshes
+   int GetSurfaceAttribute(int i)
+   {
+      return ((mesh->Dimension() == 3) ? mesh->GetBdrAttribute(i) :
+              mesh->GetAttribute(i));
+   }
+
    int GetAutoRefineFactor();
+   virtual double EstimateTriangleCount();
+   virtual long long GetTriangleCount();
 
    bool CheckPositions(Array<int> &vertices) const
    {
@@ -106,6 +144,9 @@ public:
    virtual void SetRefineFactors(int, int);
    virtual void AutoRefine();
    virtual void ToggleAttributes(Array<int> &attr_list);
+   // Show the surface and mesh line groups of the attributes in
+   // bdr_attr_to_show
+   virtual void UpdateAttributeVisibility();
 
    void FindNodePos();
 
@@ -40,6 +40,7 @@ static void VectorKeyHPressed()
         << "| i -  (De)refine elem. (NC shading) |" << endl
         << "| I -  Switch 'i' func. (NC shading) |" << endl
         << "| j -  Turn on/off perspective       |" << endl
+        << "| J -  Set the arrow decimation      |" << endl
         << "| k/K  Adjust the transparency level |" << endl
         << "| ,/<  Adjust color transparency     |" << endl
         << "| l -  Turns on/off the light        |" << endl
@@ -58,6 +59,7 @@ static void VectorKeyHPressed()
         << "| v -  Cycle through vector fields   |" << endl
         << "| V -  Change the arrows scaling     |" << endl
         << "| Ctrl+p - Print to a PDF file       |" << endl
+        << "| Ctrl+m - Level lines in the shader |" << endl
         << "+------------------------------------+" << endl
         << "| Function keys                      |" << endl
         << "+------------------------------------+" << endl
@@ -126,9 +128,13 @@ void VisualizationSceneVector::NPressed()
    {
       drawdisp = 1;
       ianim = 0;
+      PrepareDisplacedMesh();
+   }
+   else if (drawdisp >= 2)
+   {
+      // the level curves are computed from the displaced positions
+      PrepareDisplacedMesh();
    }
-
-   PrepareDisplacedMesh();
 
    SendExposeEvent();
 }
@@ -139,12 +145,22 @@ void KeyvPressed()
    SendExposeEvent();
 }
 
+static void VectorKeyJPressed()
+{
+   vsvector -> SetArrowDecimation();
+   vsvector -> PrepareVectorField();
+   SendExposeEvent();
+}
+
 void KeyVPressed()
 {
    cout << "New arrow scale: " << flush;
    cin >> vsvector -> ArrowScale;
    cout << "New arrow scale = " << vsvector -> ArrowScale << endl;
-   vsvector -> PrepareVectorField();
+   if (!vsvector -> UseArrowGlyphs())
+   {
+      vsvector -> PrepareVectorField();
+   }
    SendExposeEvent();
 }
 
@@ -238,7 +254,12 @@ void VisualizationSceneVector::ToggleDrawElems()
 void VisualizationSceneVector::ToggleVectorField()
 {
    drawvector = (drawvector+1)%4;
-   PrepareVectorField();
+   // all modes place the arrows at the same points, so the instanced arrows
+   // only need new glyph parameters, set in Draw()
+   if (!vector_instanced || drawvector <= 1)
+   {
+      PrepareVectorField();
+   }
 }
 
 const char *Vec2ScalarNames[7] =
@@ -411,6 +432,7 @@ void VisualizationSceneVector::NewMeshAndSolution(GridFunction &vgf)
    VecGridF = &vgf;
 
    // If the number of elements changes, recompute the refinement factor
+   Mesh *old_mesh = mesh;
    Mesh *new_mesh = vgf.FESpace()->GetMesh();
    if (mesh->GetNE() != new_mesh->GetNE())
    {
@@ -452,7 +474,9 @@ void VisualizationSceneVector::NewMeshAndSolution(GridFunction &vgf)
       (*sol)(i) = Vec2Scalar((*solx)(i), (*soly)(i));
    }
 
-   VisualizationSceneSolution::NewMeshAndSolution(mesh, sol, &vgf);
+   // let the base class compare the old and the new mesh
+   mesh = old_mesh;
+   VisualizationSceneSolution::NewMeshAndSolution(new_mesh, sol, &vgf);
 
    if (autoscale)
    {
@@ -474,6 +498,7 @@ void VisualizationSceneVector::Init()
 {
    drawdisp = 0;
    drawvector = 0;
+   vector_instanced = false;
    ArrowScale = 1.0;
    RefineFactor = 1;
    Vec2Scalar = VecLength;
@@ -501,6 +526,8 @@ void VisualizationSceneVector::Init()
 
       wnd->setOnKeyDown('d', KeyDPressed);
       wnd->setOnKeyDown('D', KeyDPressed);
+
+      wnd->setOnKeyDown('J', VectorKeyJPressed);
       wnd->setOnKeyDown('n', KeyNPressed);
       wnd->setOnKeyDown('b', KeyBPressed);
       wnd->setOnKeyDown('v', KeyvPressed);
@@ -629,11 +656,6 @@ void VisualizationSceneVector::GetRefinedValues(
       {
          vals(j) = _LogVal(vals(j));
       }
-
-   if (shrink != 1.0 || shrinkmat != 1.0)
-   {
-      ShrinkPoints(tr, i, 0, 0);
-   }
 }
 
 int VisualizationSceneVector::GetRefinedValuesAndNormals(
@@ -647,6 +669,15 @@ int VisualizationSceneVector::GetRefinedValuesAndNormals(
    return have_normals;
 }
 
+bool VisualizationSceneVector::ContinuousRefinedValues()
+{
+   // the derivative-based scalar functions are discontinuous
+   return (drawelems < 2 && VecGridF &&
+           Vec2Scalar != VecDivSubst && Vec2Scalar != VecCurlSubst &&
+           Vec2Scalar != VecAnisotrSubst &&
+           dynamic_cast<const H1_FECollection*>(VecGridF->FESpace()->FEColl()));
+}
+
 void VisualizationSceneVector::PrepareDisplacedMesh()
 {
    int i, j, ne = mesh -> GetNE();
@@ -654,31 +685,33 @@ void VisualizationSceneVector::PrepareDisplacedMesh()
    Array<int> vertices;
    double zc = 0.5*(z[0]+z[1]);
 
-   // prepare the displaced mesh
+   // prepare the displaced mesh; except for the level curves of drawdisp
+   // 2 and 3, the displacement scale is applied by the vertex shader, see
+   // gl3::VertexDisp, so changing it does not require a rebuild
    displine_buf.clear();
    gl3::GlBuilder build = displine_buf.createBuilder();
    if (shading != 2)
    {
       for (i = 0; i < ne; i++)
       {
-         build.glBegin(GL_LINE_LOOP);
          mesh->GetPointMatrix (i, pointmat);
          mesh->GetElementVertices (i, vertices);
 
-         for (j = 0; j < pointmat.Size(); j++) {
-            build.glVertex3d (
-                        pointmat.Elem(0, j)+
-                        (*solx)(vertices[j])*(ianim)/ianimmax,
-                        pointmat.Elem(1, j)+
-                        (*soly)(vertices[j])*(ianim)/ianimmax,
-                        zc);
-        }
-        build.glEnd();
+         int nv = pointmat.Width();
+         for (j = 0; j < nv; j++)
+         {
+            int a = j, b = (j + 1) % nv;
+            int va = vertices[a], vb = vertices[b];
+            displine_buf.addLine<gl3::VertexDisp>(
+               {{(float) pointmat(0, a), (float) pointmat(1, a), (float) zc},
+                {(float) (*solx)(va), (float) (*soly)(va), 0.f}},
+               {{(float) pointmat(0, b), (float) pointmat(1, b), (float) zc},
+                {(float) (*solx)(vb), (float) (*soly)(vb), 0.f}});
+         }
       }
    }
    else if (drawdisp < 2)
    {
-      double sc = double(ianim)/ianimmax;
       DenseMatrix vvals, pm;
 
       for (i = 0; i < ne; i++)
@@ -689,19 +722,16 @@ void VisualizationSceneVector::PrepareDisplacedMesh()
          VecGridF->GetVectorValues(i, RefG->RefPts, vvals, pm);
 
          Array<int> &RE = RefG->RefEdges;
-         build.glBegin (GL_LINES);
-         for (int k = 0; k+1 < RE.Size(); k++)
+         for (int k = 0; k+1 < RE.Size(); k += 2)
          {
-            build.glVertex3d (
-                        pm(0, RE[k]) + sc * vvals(0, RE[k]),
-                        pm(1, RE[k]) + sc * vvals(1, RE[k]), zc);
-            k++;
-            build.glVertex3d (
-                        pm(0, RE[k]) + sc * vvals(0, RE[k]),
-                        pm(1, RE[k]) + sc * vvals(1, RE[k]), zc);
+            int a = RE[k], b = RE[k+1];
+            displine_buf.addLine<gl3::VertexDisp>(
+               {{(float) pm(0, a), (float) pm(1, a), (float) zc},
+                {(float) vvals(0, a), (float) vvals(1, a), 0.f}},
+               {{(float) pm(0, b), (float) pm(1, b), (float) zc},
+                {(float) vvals(0, b), (float) vvals(1, b), 0.f}});
          }
-        build.glEnd();
-        }
+      }
    }
    else
    {
@@ -843,6 +873,13 @@ void VisualizationSceneVector::DrawVector(double px, double py, double vx,
 {
    double zc = 0.5*(z[0]+z[1]);
 
+   if (vector_instanced)
+   {
+      vector_arrows.addArrow(px, py, zc, vx, vy, 0.0, cval);
+      new_maxlen = max(new_maxlen, VecLength(vx, vy));
+      return;
+   }
+
    gl3::GlBuilder builder = vector_buf.createBuilder();
 
    if (drawvector == 1)
@@ -880,6 +917,61 @@ void VisualizationSceneVector::DrawVector(double px, double py, double vx,
 
 void VisualizationSceneVector::PrepareVectorField()
 {
+   // the points, vectors and values of the arrows
+   vector<ArrowSample> arrows;
+   if (drawvector > 0)
+   {
+      int i;
+
+      for (i = 0; i < mesh->GetNV(); i++)
+      {
+         double *v = mesh->GetVertex(i);
+         arrows.push_back({ { v[0], v[1], 0.0 },
+                            { (*solx)(i), (*soly)(i), 0.0 }, (*sol)(i) });
+      }
+
+      if (shading == 2 && RefineFactor > 1)
+      {
+         DenseMatrix vvals, pm;
+         for (i = 0; i < mesh->GetNE(); i++)
+         {
+            const IntegrationRule *ir =
+               GLVisGeometryRefiner.RefineInterior(
+                  mesh->GetElementBaseGeometry(i), RefineFactor);
+            if (ir == NULL)
+            {
+               continue;
+            }
+            VecGridF->GetVectorValues(i, *ir, vvals, pm);
+            for (int j = 0; j < vvals.Width(); j++)
+            {
+               arrows.push_back({ { pm(0, j), pm(1, j), 0.0 },
+                                  { vvals(0, j), vvals(1, j), 0.0 },
+                                  Vec2Scalar(vvals(0, j), vvals(1, j)) });
+            }
+         }
+         for (i = 0; i < mesh->GetNEdges(); i++)
+         {
+            const IntegrationRule *ir =
+               GLVisGeometryRefiner.RefineInterior(
+                  mesh->GetFaceBaseGeometry(i), RefineFactor);
+            if (ir == NULL)
+            {
+               continue;
+            }
+            VecGridF->GetFaceVectorValues(i, 0, *ir, vvals, pm);
+            for (int j = 0; j < vvals.Width(); j++)
+            {
+               arrows.push_back({ { pm(0, j), pm(1, j), 0.0 },
+                                  { vvals(0, j), vvals(1, j), 0.0 },
+                                  Vec2Scalar(vvals(0, j), vvals(1, j)) });
+            }
+         }
+      }
+
+      DecimateArrows(arrows, 2);
+   }
+
    int rerun;
    do
    {
@@ -887,60 +979,28 @@ void VisualizationSceneVector::PrepareVectorField()
 
       //glNewList(vectorlist, GL_COMPILE);
       vector_buf.clear();
+      vector_arrows.clear();
+      vector_instanced = UseArrowGlyphs();
 
       if (drawvector > 0)
       {
-         int i;
-
          MySetColorLogscale = logscale;
-         if (drawvector == 3)
+         if (drawvector == 3 || vector_instanced)
          {
             new_maxlen = 0.0;
          }
-         for (i = 0; i < mesh->GetNV(); i++)
+         for (size_t k = 0; k < arrows.size(); k++)
          {
-            double *v = mesh->GetVertex(i);
-            DrawVector(v[0], v[1], (*solx)(i), (*soly)(i), (*sol)(i));
+            const ArrowSample &a = arrows[k];
+            DrawVector(a.pos[0], a.pos[1], a.vec[0], a.vec[1], a.val);
          }
 
-         if (shading == 2 && RefineFactor > 1)
+         if (vector_instanced)
          {
-            DenseMatrix vvals, pm;
-            for (i = 0; i < mesh->GetNE(); i++)
-            {
-               const IntegrationRule *ir =
-                  GLVisGeometryRefiner.RefineInterior(
-                     mesh->GetElementBaseGeometry(i), RefineFactor);
-               if (ir == NULL)
-               {
-                  continue;
-               }
-               VecGridF->GetVectorValues(i, *ir, vvals, pm);
-               for (int j = 0; j < vvals.Width(); j++)
-               {
-                  DrawVector(pm(0, j), pm(1,j), vvals(0, j), vvals(1, j),
-                             Vec2Scalar(vvals(0, j), vvals(1, j)));
-               }
-            }
-            for (i = 0; i < mesh->GetNEdges(); i++)
-            {
-               const IntegrationRule *ir =
-                  GLVisGeometryRefiner.RefineInterior(
-                     mesh->GetFaceBaseGeometry(i), RefineFactor);
-               if (ir == NULL)
-               {
-                  continue;
-               }
-               VecGridF->GetFaceVectorValues(i, 0, *ir, vvals, pm);
-               for (int j = 0; j < vvals.Width(); j++)
-               {
-                  DrawVector(pm(0, j), pm(1,j), vvals(0, j), vvals(1, j),
-                             Vec2Scalar(vvals(0, j), vvals(1, j)));
-               }
-            }
+            // the arrow lengths are set at draw time
+            maxlen = new_maxlen;
          }
-
-         if (drawvector == 3 && new_maxlen != maxlen)
+         else if (drawvector == 3 && new_maxlen != maxlen)
          {
             maxlen = new_maxlen;
             rerun = 1;
@@ -951,9 +1011,57 @@ void VisualizationSceneVector::PrepareVectorField()
 
    }
    while (rerun);
+   if (vector_instanced)
+   {
+      vector_arrows.buffer();
+   }
    vector_buf.buffer();
 }
 
+void VisualizationSceneVector::SetArrowGlyphs()
+{
+   // same lengths and colors as in DrawVector()
+   double area = (x[1]-x[0])*(y[1]-y[0]);
+   double h = sqrt(area/mesh->GetNV()) * ArrowScale;
+
+   vector_arrows.setAxisScale(xscale, yscale, zscale);
+   if (drawvector == 1)
+   {
+      vector_arrows.setShape(1./4./3., false);
+      vector_arrows.setLength(1.0, 0.0, 0.0);
+      vector_arrows.useStaticColor();
+   }
+   else
+   {
+      vector_arrows.setShape(0.125, true);
+      if (drawvector == 2)
+      {
+         vector_arrows.setLength(0.0, 0.0, h);
+      }
+      else
+      {
+         vector_arrows.setLength(h/maxlen, 0.0, 0.0, 0.01*h);
+      }
+      vector_arrows.setColorMap(minv, maxv, logscale);
+   }
+}
+
+void VisualizationSceneVector::DrawVectorField()
+{
+   // printing needs the arrows built on the CPU, and restoring the instanced
+   // arrows afterwards rebuilds them again
+   if (vector_instanced != UseArrowGlyphs())
+   {
+      PrepareVectorField();
+   }
+   if (vector_instanced)
+   {
+      SetArrowGlyphs();
+      vector_arrows.draw();
+   }
+   vector_buf.draw();
+}
+
 void VisualizationSceneVector::Draw()
 {
    gl->enableDepthTest();
@@ -963,6 +1071,7 @@ void VisualizationSceneVector::Draw()
 
    // model transformation
    ModelView();
+   SetShrinkFactors();
 
    // draw colored faces
    glPolygonOffset (1, 1);
@@ -999,7 +1108,7 @@ void VisualizationSceneVector::Draw()
    // draw vector field
    if (drawvector > 1)
    {
-       vector_buf.draw();
+       DrawVectorField();
    }
 
    if (MatAlpha < 1.0)
@@ -1008,10 +1117,7 @@ void VisualizationSceneVector::Draw()
    }
 
    // draw elements
-   if (drawelems)
-   {
-      disp_buf.draw();
-   }
+   DrawSurface();
 
    if (MatAlpha < 1.0)
    {
@@ -1049,25 +1155,18 @@ void VisualizationSceneVector::Draw()
    }
    else if (drawmesh == 2)
    {
-      lcurve_buf.draw();
+      DrawLevelCurveLines();
    }
 
    // draw numberings
    if (drawnums)
    {
-      if (1 == drawnums)
-      {
-         e_nums_buf.draw();
-      }
-      else if (2 == drawnums)
-      {
-         v_nums_buf.draw();
-      }
+      DrawNumbering();
    }
 
    if (drawvector == 1)
    {
-      vector_buf.draw();
+      DrawVectorField();
    }
 
    if (drawdisp > 0)
@@ -1076,6 +1175,7 @@ void VisualizationSceneVector::Draw()
       {
          gl->setStaticColor(1, 0, 0);
       }
+      gl->setDisplacementScale(float(ianim)/ianimmax);
       displine_buf.draw();
       if (drawmesh == 1)
       {
@@ -25,6 +25,9 @@ protected:
 
    gl3::GlDrawable vector_buf;
    gl3::GlDrawable displine_buf;
+   // arrows of the vector field when UseArrowGlyphs() is true
+   gl3::ArrowBuffer vector_arrows;
+   bool vector_instanced;
    GridFunction *VecGridF;
 
    void Init();
@@ -34,10 +37,18 @@ protected:
    virtual int GetRefinedValuesAndNormals(int i, const IntegrationRule &ir,
                                           Vector &vals, DenseMatrix &tr,
                                           DenseMatrix &normals);
+   virtual bool ContinuousRefinedValues();
+   // The cache keys do not cover the vector field state (Vec2Scalar, the
+   // displacement, etc.)
+   virtual bool GetTessCacheKey(const char *name, TessCacheKey &key)
+   { return false; }
 
    double (*Vec2Scalar)(double, double);
 
    void DrawVector(double, double, double, double, double);
+   // Sets the glyph parameters of 'vector_arrows' for the current mode
+   void SetArrowGlyphs();
+   void DrawVectorField();
 
    double maxlen;
 
@@ -13,10 +13,12 @@
 #include <iostream>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 #include "mfem.hpp"
 using namespace mfem;
 #include "visual.hpp"
+#include "minmax.hpp"
 
 using namespace std;
 
@@ -40,6 +42,7 @@ static void VectorKeyHPressed()
         << "| h -  Displays help menu            |" << endl
         << "| i -  Toggle cutting plane          |" << endl
         << "| j -  Turn on/off perspective       |" << endl
+        << "| J -  Set the arrow decimation      |" << endl
         << "| k/K  Adjust the transparency level |" << endl
         << "| ,/<  Adjust color transparency     |" << endl
         << "| l -  Turns on/off the light        |" << endl
@@ -63,6 +66,7 @@ static void VectorKeyHPressed()
         << "| y/Y  Rotate clipping plane (theta) |" << endl
         << "| z/Z  Translate clipping plane      |" << endl
         << "| Ctrl+p - Print to a PDF file       |" << endl
+        << "| Ctrl+m - Level lines in the shader |" << endl
         << "+------------------------------------+" << endl
         << "| Function keys                      |" << endl
         << "+------------------------------------+" << endl
@@ -159,11 +163,8 @@ static void KeyRPressed()
 
 void VisualizationSceneVector3d::NPressed()
 {
-   if (drawdisp)
-   {
-      PrepareDisplacedMesh();
-   }
-   else
+   // with drawdisp only the displacement scale changes, see Draw()
+   if (!drawdisp)
    {
       Prepare();
       PrepareLines();
@@ -172,6 +173,13 @@ void VisualizationSceneVector3d::NPressed()
    SendExposeEvent();
 }
 
+static void VectorKeyJPressed()
+{
+   vsvector3d -> SetArrowDecimation();
+   vsvector3d -> PrepareVectorField();
+   SendExposeEvent();
+}
+
 static void KeyuPressed()
 {
    vsvector3d -> ToggleVectorFieldLevel(+1);
@@ -251,8 +259,15 @@ static void VectorKeyFPressed()
 
 void VisualizationSceneVector3d::ToggleVectorField(int i)
 {
+   int old_drawvector = drawvector;
    drawvector = (drawvector+i+6)%6;
-   PrepareVectorField();
+   // modes 1-3 place the arrows at the same points, so the instanced arrows
+   // only need new glyph parameters, set in Draw()
+   if (!vector_instanced || old_drawvector < 1 || old_drawvector > 3 ||
+       drawvector < 1 || drawvector > 3)
+   {
+      PrepareVectorField();
+   }
 }
 
 static const char *scal_func_name[] =
@@ -376,6 +391,7 @@ void VisualizationSceneVector3d::Init()
 
    ianim = ianimd = 0;
    ianimmax = 10;
+   vector_instanced = false;
 
    SetScalarFunction();
 
@@ -400,6 +416,8 @@ void VisualizationSceneVector3d::Init()
       wnd->setOnKeyDown('d', KeyDPressed);
       wnd->setOnKeyDown('D', KeyDPressed);
 
+      wnd->setOnKeyDown('J', VectorKeyJPressed);
+
       wnd->setOnKeyDown('n', KeyNPressed);
       wnd->setOnKeyDown('N', KeyNPressed);
 
@@ -439,6 +457,8 @@ VisualizationSceneVector3d::~VisualizationSceneVector3d()
 void VisualizationSceneVector3d::NewMeshAndSolution(
    Mesh *new_m, GridFunction *new_v)
 {
+   const bool same_mesh = (new_m == mesh);
+
    delete sol;
    if (VecGridF)
    {
@@ -472,7 +492,12 @@ void VisualizationSceneVector3d::NewMeshAndSolution(
 
    VecGridF = new_v;
    mesh = new_m;
-   FindNodePos();
+   if (!same_mesh)
+   {
+      ResetAttributeTables();
+      ClearRefinedFaces();
+      FindNodePos();
+   }
 
    sfes = new FiniteElementSpace(mesh, new_fes->FEColl(), 1,
                                  new_fes->GetOrdering());
@@ -490,7 +515,15 @@ void VisualizationSceneVector3d::NewMeshAndSolution(
 
    SetScalarFunction();
 
-   DoAutoscale(false);
+   if (!same_mesh)
+   {
+      DoAutoscale(false);
+   }
+   else if (autoscale == 1 || autoscale == 2)
+   {
+      // the bounding box depends only on the mesh
+      FindNewValueRange(false);
+   }
 
    Prepare();
    PrepareLines();
@@ -632,10 +665,10 @@ void VisualizationSceneVector3d::PrepareFlat2()
             GetFaceNormals(fn, di, RefG->RefPts, normals);
             have_normals = 1;
          }
-         ShrinkPoints(pointmat, i, fn, di);
       }
       else // dim == 2
       {
+         fn = 0;
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
                                             TimesToRefine);
          GridF->GetValues(i, RefG->RefPts, values, pointmat);
@@ -660,7 +693,15 @@ void VisualizationSceneVector3d::PrepareFlat2()
             have_normals = 1;
             di = 0;
          }
-         ShrinkPoints(pointmat, i, 0, 0);
+      }
+      // the shift of the faces is applied after shrinking them, on the CPU
+      if (sc != 0.0)
+      {
+         ShrinkPoints(pointmat, i, fn, di);
+      }
+      else
+      {
+         SetShrinkCenters(disp_buf, pointmat, i, fn, di);
       }
 
       vmin = fmin(vmin, values.Min());
@@ -736,71 +777,92 @@ void VisualizationSceneVector3d::Prepare()
    gl3::GlBuilder draw = disp_buf.createBuilder();
 
    int dim = mesh->Dimension();
-   int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
    int nv = mesh -> GetNV();
    DenseMatrix pointmat;
    Array<int> vertices;
-   double nor[3];
 
    Vector nx(nv);
    Vector ny(nv);
    Vector nz(nv);
+   nx = 0.;
+   ny = 0.;
+   nz = 0.;
+
+   // The unit normals of the displaced (boundary) elements, computed in
+   // parallel; degenerate elements get a zero normal.
+   const int ne = (dim == 3) ? mesh->GetNBE() : mesh->GetNE();
+   std::vector<double> el_nor(3*ne, 0.0);
+   ParallelFor(ne, NORMALS_GRAIN, [&](size_t begin, size_t end)
+   {
+      DenseMatrix pm;
+      Array<int> verts;
+      for (size_t e = begin; e < end; e++)
+      {
+         if (dim == 3)
+         {
+            mesh->GetBdrPointMatrix(e, pm);
+            mesh->GetBdrElementVertices(e, verts);
+         }
+         else
+         {
+            mesh->GetPointMatrix(e, pm);
+            mesh->GetElementVertices(e, verts);
+         }
+         for (int jj = 0; jj < pm.Width(); jj++)
+         {
+            pm(0, jj) += (*solx)(verts[jj])*(ianim)/ianimmax;
+            pm(1, jj) += (*soly)(verts[jj])*(ianim)/ianimmax;
+            pm(2, jj) += (*solz)(verts[jj])*(ianim)/ianimmax;
+         }
+         double *en = &el_nor[3*e];
+         const int err = (pm.Width() == 3) ?
+                         Compute3DUnitNormal(&pm(0,0), &pm(0,1), &pm(0,2), en) :
+                         Compute3DUnitNormal(&pm(0,0), &pm(0,1), &pm(0,2),
+                                             &pm(0,3), en);
+         if (err)
+         {
+            en[0] = en[1] = en[2] = 0.0;
+         }
+      }
+   });
+
+   // boundary_attribute--to--boundary_element
+   const Table &ba_to_be = GetAttributeElements(dim == 3);
 
    const Array<int> &attributes =
       ((dim == 3) ? mesh->bdr_attributes : mesh->attributes);
    for (int d = 0; d < attributes.Size(); d++)
    {
-      if (!bdr_attr_to_show[attributes[d]-1]) { continue; }
+      const int attr = attributes[d]-1;
 
-      nx=0.;
-      ny=0.;
-      nz=0.;
+      if (!bdr_attr_to_show[attr]) { continue; }
 
-      for (i = 0; i < ne; i++)
-      {
-         int attr =
-            (dim == 3) ? mesh->GetBdrAttribute(i) : mesh->GetAttribute(i);
-         if (attr != attributes[d]) { continue; }
+      const int nelem = ba_to_be.RowSize(attr);
+      const int *elem = ba_to_be.GetRow(attr);
 
+      for (int k = 0; k < nelem; k++)
+      {
+         i = elem[k];
          if (dim == 3)
          {
-            mesh->GetBdrPointMatrix (i, pointmat);
             mesh->GetBdrElementVertices (i, vertices);
          }
          else
          {
-            mesh->GetPointMatrix(i, pointmat);
             mesh->GetElementVertices(i, vertices);
          }
-
-         for (j = 0; j < pointmat.Size(); j++)
+         const double *en = &el_nor[3*i];
+         for (j = 0; j < vertices.Size(); j++)
          {
-            pointmat(0, j) += (*solx)(vertices[j])*(ianim)/ianimmax;
-            pointmat(1, j) += (*soly)(vertices[j])*(ianim)/ianimmax;
-            pointmat(2, j) += (*solz)(vertices[j])*(ianim)/ianimmax;
+            nx(vertices[j]) += en[0];
+            ny(vertices[j]) += en[1];
+            nz(vertices[j]) += en[2];
          }
-
-         if (pointmat.Width() == 3)
-            j = Compute3DUnitNormal(&pointmat(0,0), &pointmat(0,1),
-                                    &pointmat(0,2), nor);
-         else
-            j = Compute3DUnitNormal(&pointmat(0,0), &pointmat(0,1),
-                                    &pointmat(0,2), &pointmat(0,3), nor);
-         if (j == 0)
-            for (j = 0; j < pointmat.Size(); j++)
-            {
-               nx(vertices[j]) += nor[0];
-               ny(vertices[j]) += nor[1];
-               nz(vertices[j]) += nor[2];
-            }
       }
 
-      for (i = 0; i < ne; i++)
+      for (int k = 0; k < nelem; k++)
       {
-         int attr =
-            (dim == 3) ? mesh->GetBdrAttribute(i) : mesh->GetAttribute(i);
-         if (attr != attributes[d]) { continue; }
-
+         i = elem[k];
          int el_type =
             (dim == 3) ? mesh->GetBdrElementType(i) : mesh->GetElementType(i);
          switch (el_type)
@@ -837,6 +899,22 @@ void VisualizationSceneVector3d::Prepare()
          }
          draw.glEnd();
       }
+
+      for (int k = 0; k < nelem; k++)
+      {
+         if (dim == 3)
+         {
+            mesh->GetBdrElementVertices(elem[k], vertices);
+         }
+         else
+         {
+            mesh->GetElementVertices(elem[k], vertices);
+         }
+         for (j = 0; j < vertices.Size(); j++)
+         {
+            nx(vertices[j]) = ny(vertices[j]) = nz(vertices[j]) = 0.;
+         }
+      }
    }
    disp_buf.buffer();
 }
@@ -845,6 +923,15 @@ void VisualizationSceneVector3d::PrepareLines()
 {
    if (!drawmesh) { return; }
 
+   lines_shader = LevelCurvesInShader();
+   if (lines_shader)
+   {
+      // changing the levels only updates the isoline uniforms
+      line_buf.clear();
+      line_buf.buffer();
+      return;
+   }
+
    if (shading == 2)
    {
       PrepareLines2();
@@ -988,10 +1075,10 @@ void VisualizationSceneVector3d::PrepareLines2()
          {
             pointmat.Add (double(ianim)/ianimmax, vec_vals);
          }
-         ShrinkPoints(pointmat, i, fn, di);
       }
       else
       {
+         fn = 0;
          RefG = GLVisGeometryRefiner.Refine(mesh->GetElementBaseGeometry(i),
                                             TimesToRefine);
          GridF->GetValues(i, RefG->RefPts, values, pointmat);
@@ -1000,7 +1087,15 @@ void VisualizationSceneVector3d::PrepareLines2()
          {
             pointmat.Add(double(ianim)/ianimmax, vec_vals);
          }
-         ShrinkPoints(pointmat, i, 0, 0);
+      }
+      // the shift of the faces is applied after shrinking them, on the CPU
+      if (sc != 0.0)
+      {
+         ShrinkPoints(pointmat, i, fn, di);
+      }
+      else
+      {
+         SetShrinkCenters(line_buf, pointmat, i, fn, di);
       }
 
       int *RG = &(RefG->RefGeoms[0]);
@@ -1104,13 +1199,12 @@ void VisualizationSceneVector3d::PrepareDisplacedMesh()
    DenseMatrix pointmat;
    Array<int> vertices;
 
-   // prepare the displaced mesh
+   // prepare the displaced mesh; the displacement scale ianimd/ianimmax is
+   // applied by the vertex shader, see gl3::VertexDisp
    displine_buf.clear();
-   gl3::GlBuilder builder = displine_buf.createBuilder();
 
    for (i = 0; i < ne; i++)
    {
-      builder.glBegin(GL_LINE_LOOP);
       if (dim == 3)
       {
          mesh->GetBdrPointMatrix (i, pointmat);
@@ -1122,18 +1216,20 @@ void VisualizationSceneVector3d::PrepareDisplacedMesh()
          mesh->GetElementVertices(i, vertices);
       }
 
-      for (j = 0; j < pointmat.Size(); j++)
-      {
-         pointmat(0, j) += (*solx)(vertices[j])*(ianimd)/ianimmax;
-         pointmat(1, j) += (*soly)(vertices[j])*(ianimd)/ianimmax;
-         pointmat(2, j) += (*solz)(vertices[j])*(ianimd)/ianimmax;
-      }
-
-      for (j = 0; j < pointmat.Size(); j++)
+      int nv = pointmat.Width();
+      for (j = 0; j < nv; j++)
       {
-         builder.glVertex3d (pointmat(0, j), pointmat(1, j), pointmat(2, j) );
+         gl3::VertexDisp v[2];
+         for (int k = 0; k < 2; k++)
+         {
+            int p = (j + k) % nv, vi = vertices[p];
+            v[k] = {{(float) pointmat(0, p), (float) pointmat(1, p),
+                     (float) pointmat(2, p)},
+                    {(float) (*solx)(vi), (float) (*soly)(vi),
+                     (float) (*solz)(vi)}};
+         }
+         displine_buf.addLine(v[0], v[1]);
       }
-      builder.glEnd();
    }
    displine_buf.buffer();
 }
@@ -1250,12 +1346,87 @@ void VisualizationSceneVector3d::DrawVector(gl3::GlBuilder& builder,
    }
 }
 
+void VisualizationSceneVector3d::AddVector(gl3::GlBuilder& builder,
+                                           double v0, double v1, double v2,
+                                           double sx, double sy, double sz,
+                                           double s)
+{
+   if (vector_instanced)
+   {
+      vector_arrows.addArrow(v0, v1, v2, sx, sy, sz, s);
+   }
+   else
+   {
+      DrawVector(builder, drawvector, v0, v1, v2, sx, sy, sz, s);
+   }
+}
+
+void VisualizationSceneVector3d::SetArrowGlyphs()
+{
+   // same lengths and colors as in DrawVector()
+   double volume = (x[1]-x[0])*(y[1]-y[0])*(z[1]-z[0]);
+   double h = pow(volume/mesh->GetNV(), 0.333);
+   double hh = pow(volume, 0.333) / 10;
+
+   vector_arrows.setAxisScale(xscale, yscale, zscale);
+   switch (drawvector)
+   {
+      case 1:
+         vector_arrows.setShape(0.075, false);
+         vector_arrows.setLength(1.0, 0.0, 0.0);
+         vector_arrows.useStaticColor();
+         break;
+
+      case 2:
+      case 3:
+         vector_arrows.setShape(0.125, true);
+         if (drawvector == 2)
+         {
+            vector_arrows.setLength(0.0, 0.0, h);
+         }
+         else
+         {
+            vector_arrows.setLength(0.0, h/maxv, 0.0);
+         }
+         vector_arrows.setColorMap(minv, maxv, MySetColorLogscale);
+         break;
+
+      case 4:
+      case 5:
+         vector_arrows.setShape(0.125, true);
+         vector_arrows.setLength(0.0, hh/maxv, 0.0);
+         vector_arrows.setColor(0.3, 0.3, 0.3);
+         break;
+   }
+}
+
+void VisualizationSceneVector3d::DrawVectorField()
+{
+   // printing needs the arrows built on the CPU, and restoring the instanced
+   // arrows afterwards rebuilds them again
+   if (vector_instanced != UseArrowGlyphs())
+   {
+      PrepareVectorField();
+   }
+   if (vector_instanced)
+   {
+      SetArrowGlyphs();
+      vector_arrows.draw();
+   }
+   vector_buf.draw();
+}
+
 void VisualizationSceneVector3d::PrepareVectorField()
 {
    int i, nv = mesh -> GetNV();
    double *vertex;
+   // the points, vectors and values of the arrows in modes 1-3 and 5, which
+   // may be decimated
+   vector<ArrowSample> arrows;
 
    vector_buf.clear();
+   vector_arrows.clear();
+   vector_instanced = UseArrowGlyphs();
    gl3::GlBuilder builder = vector_buf.createBuilder();
 
    switch (drawvector)
@@ -1268,8 +1439,9 @@ void VisualizationSceneVector3d::PrepareVectorField()
             if (drawmesh != 2 || ArrowDrawOrNot((*sol)(i), nl, level))
             {
                vertex = mesh->GetVertex(i);
-               DrawVector(builder, drawvector, vertex[0], vertex[1], vertex[2],
-                          (*solx)(i), (*soly)(i), (*solz)(i), (*sol)(i));
+               arrows.push_back({ { vertex[0], vertex[1], vertex[2] },
+                                  { (*solx)(i), (*soly)(i), (*solz)(i) },
+                                  (*sol)(i) });
             }
          break;
 
@@ -1281,8 +1453,9 @@ void VisualizationSceneVector3d::PrepareVectorField()
             if (drawmesh != 2 || ArrowDrawOrNot((*sol)(i), nl, level))
             {
                vertex = mesh->GetVertex(i);
-               DrawVector(builder, drawvector, vertex[0], vertex[1], vertex[2],
-                          (*solx)(i), (*soly)(i), (*solz)(i), (*sol)(i));
+               arrows.push_back({ { vertex[0], vertex[1], vertex[2] },
+                                  { (*solx)(i), (*soly)(i), (*solz)(i) },
+                                  (*sol)(i) });
             }
       }
       break;
@@ -1296,8 +1469,9 @@ void VisualizationSceneVector3d::PrepareVectorField()
             if (drawmesh != 2 || ArrowDrawOrNot((*sol)(i), nl, level))
             {
                vertex = mesh->GetVertex(i);
-               DrawVector(builder, drawvector, vertex[0], vertex[1], vertex[2],
-                          (*solx)(i), (*soly)(i), (*solz)(i), (*sol)(i));
+               arrows.push_back({ { vertex[0], vertex[1], vertex[2] },
+                                  { (*solx)(i), (*soly)(i), (*solz)(i) },
+                                  (*sol)(i) });
             }
       }
       break;
@@ -1315,9 +1489,9 @@ void VisualizationSceneVector3d::PrepareVectorField()
             for (j = 0; j < l[i].Size(); j++)
             {
                vertex = mesh->GetVertex( l[i][j] );
-               DrawVector(builder, drawvector, vertex[0], vertex[1], vertex[2],
-                          (*solx)(l[i][j]), (*soly)(l[i][j]), (*solz)(l[i][j]),
-                          (*sol)(l[i][j]));
+               AddVector(builder, vertex[0], vertex[1], vertex[2],
+                         (*solx)(l[i][j]), (*soly)(l[i][j]), (*solz)(l[i][j]),
+                         (*sol)(l[i][j]));
             }
          }
 
@@ -1348,14 +1522,28 @@ void VisualizationSceneVector3d::PrepareVectorField()
                i = vertices[j];
                if (vert_marker[i]) { continue; }
                vertex = mesh->GetVertex(i);
-               DrawVector(builder, drawvector, vertex[0], vertex[1], vertex[2],
-                          (*solx)(i), (*soly)(i), (*solz)(i), (*sol)(i));
+               arrows.push_back({ { vertex[0], vertex[1], vertex[2] },
+                                  { (*solx)(i), (*soly)(i), (*solz)(i) },
+                                  (*sol)(i) });
                vert_marker[i] = true;
             }
          }
       }
       break;
    }
+
+   DecimateArrows(arrows, 3);
+   for (size_t k = 0; k < arrows.size(); k++)
+   {
+      const ArrowSample &a = arrows[k];
+      AddVector(builder, a.pos[0], a.pos[1], a.pos[2],
+                a.vec[0], a.vec[1], a.vec[2], a.val);
+   }
+
+   if (vector_instanced)
+   {
+      vector_arrows.buffer();
+   }
    vector_buf.buffer();
 }
 
@@ -1515,6 +1703,7 @@ void VisualizationSceneVector3d::Draw()
 
    // model transformation
    ModelView();
+   SetShrinkFactors();
 
    gl->disableClipPlane();
    // draw colorbar
@@ -1556,14 +1745,11 @@ void VisualizationSceneVector3d::Draw()
    // draw vector field
    if (drawvector == 2 || drawvector == 3)
    {
-       vector_buf.draw();
+       DrawVectorField();
    }
 
    // draw elements
-   if (drawelems)
-   {
-       disp_buf.draw();
-   }
+   DrawSurface();
 
    if (cplane && cp_drawelems)
    {
@@ -1584,14 +1770,14 @@ void VisualizationSceneVector3d::Draw()
 
    if (drawvector > 3)
    {
-      vector_buf.draw();
+      DrawVectorField();
    }
 
    Set_Black_Material();
 
    if (drawvector == 1)
    {
-      vector_buf.draw();
+      DrawVectorField();
    }
 
    // ruler may have mixture of polygons and lines
@@ -1611,15 +1797,13 @@ void VisualizationSceneVector3d::Draw()
    }
 
    // draw lines
-   if (drawmesh)
-   {
-      line_buf.draw();
-   }
+   DrawLines();
 
    // draw displacement
    if (drawdisp)
    {
       gl->setStaticColor(1.f, 0.f, 0.f);
+      gl->setDisplacementScale(float(ianimd)/ianimmax);
       displine_buf.draw();
       Set_Black_Material();
    }
@@ -24,12 +24,22 @@ protected:
    int drawvector, scal_func;
    gl3::GlDrawable vector_buf;
    gl3::GlDrawable displine_buf;
+   // arrows of the vector field when UseArrowGlyphs() is true
+   gl3::ArrowBuffer vector_arrows;
+   bool vector_instanced;
 
    GridFunction *VecGridF;
    FiniteElementSpace *sfes;
 
    void Init();
 
+   // Adds an arrow to 'vector_arrows' or draws it with DrawVector()
+   void AddVector(gl3::GlBuilder& builder, double v0, double v1, double v2,
+                  double sx, double sy, double sz, double s);
+   // Sets the glyph parameters of 'vector_arrows' for the current mode
+   void SetArrowGlyphs();
+   void DrawVectorField();
+
    Array<int> vflevel;
    Array<double> dvflevel;
 
@@ -47,6 +57,8 @@ public:
    virtual void PrepareFlat();
    virtual void Prepare();
    virtual void PrepareLines();
+   // the surface and lines of vector fields are not grouped by attribute
+   virtual void UpdateAttributeVisibility() { PrepareLines(); Prepare(); }
 
    void PrepareFlat2();
    void PrepareLines2();
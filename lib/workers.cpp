@@ -0,0 +1,210 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#include "workers.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Sockets passed per message, below the limit of the kernel (SCM_MAX_FD)
+static const int MAX_FDS_PER_MESSAGE = 200;
+
+// Data of each message from the server to a worker; the sockets are passed
+// as its ancillary data
+struct SessionMessage
+{
+   double start;
+   int num_fds;
+   int allow_shm;
+};
+
+WorkerPool::WorkerPool(int _size, WarmUp _warm_up, Serve _serve,
+                       CloseServer _close_server)
+   : size(_size), warm_up(_warm_up), serve(_serve),
+     close_server(_close_server)
+{ }
+
+void WorkerPool::Fill()
+{
+   while ((int) workers.size() < size)
+   {
+      int sv[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+      {
+         cout << "Server: socketpair(...) failed." << endl;
+         return;
+      }
+      pid_t pid = fork();
+      if (pid < 0)
+      {
+         cout << "Server: can not fork a worker." << endl;
+         close(sv[0]);
+         close(sv[1]);
+         return;
+      }
+      if (pid == 0)
+      {
+         close(sv[0]);
+         RunWorker(sv[1]);
+      }
+      close(sv[1]);
+      Worker w = { pid, sv[0], false };
+      workers.push_back(w);
+   }
+}
+
+bool WorkerPool::Dispatch(const vector<int> &fds, double start,
+                          bool allow_shm)
+{
+   Poll();
+   for (size_t i = 0; i < workers.size(); )
+   {
+      if (!workers[i].ready)
+      {
+         i++;
+         continue;
+      }
+      bool sent = true;
+      for (size_t first = 0; first < fds.size() && sent;
+           first += MAX_FDS_PER_MESSAGE)
+      {
+         const int n = std::min<int>(MAX_FDS_PER_MESSAGE, fds.size() - first);
+         SessionMessage sm = { start, (int) fds.size(), allow_shm };
+         iovec iov = { &sm, sizeof(sm) };
+         vector<char> control(CMSG_SPACE(n*sizeof(int)));
+         msghdr msg;
+         memset(&msg, 0, sizeof(msg));
+         msg.msg_iov = &iov;
+         msg.msg_iovlen = 1;
+         msg.msg_control = control.data();
+         msg.msg_controllen = control.size();
+         cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg->cmsg_level = SOL_SOCKET;
+         cmsg->cmsg_type = SCM_RIGHTS;
+         cmsg->cmsg_len = CMSG_LEN(n*sizeof(int));
+         memcpy(CMSG_DATA(cmsg), &fds[first], n*sizeof(int));
+         sent = (sendmsg(workers[i].fd, &msg, MSG_NOSIGNAL) ==
+                 (ssize_t) sizeof(sm));
+      }
+      // a worker that can not be reached has exited; try the next one
+      Drop(i);
+      if (sent)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+void WorkerPool::Close()
+{
+   for (size_t i = 0; i < workers.size(); i++)
+   {
+      close(workers[i].fd);
+   }
+   workers.clear();
+}
+
+void WorkerPool::Poll()
+{
+   for (size_t i = 0; i < workers.size(); )
+   {
+      char c;
+      ssize_t n = recv(workers[i].fd, &c, 1, MSG_DONTWAIT);
+      if (n == 1)
+      {
+         workers[i].ready = true;
+      }
+      else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+                          errno != EINTR))
+      {
+         if (!workers[i].ready)
+         {
+            // do not fork again what will fail again
+            cout << "Server: a warm worker failed to start, "
+                 << size - 1 << " left." << endl;
+            size--;
+         }
+         Drop(i);
+         continue;
+      }
+      i++;
+   }
+}
+
+void WorkerPool::Drop(size_t i)
+{
+   close(workers[i].fd);
+   workers.erase(workers.begin() + i);
+}
+
+void WorkerPool::RunWorker(int fd)
+{
+   Close();
+   close_server();
+   // like the forked sessions, keep the window when the server is stopped
+   signal(SIGINT, SIG_IGN);
+
+   if (!warm_up())
+   {
+      exit(1);
+   }
+   const char c = 1;
+   if (write(fd, &c, 1) != 1)
+   {
+      exit(0);
+   }
+
+   vector<int> fds;
+   SessionMessage sm = { 0.0, 1, 0 };
+   while ((int) fds.size() < sm.num_fds)
+   {
+      iovec iov = { &sm, sizeof(sm) };
+      vector<char> control(CMSG_SPACE(MAX_FDS_PER_MESSAGE*sizeof(int)));
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control.data();
+      msg.msg_controllen = control.size();
+      if (recvmsg(fd, &msg, MSG_WAITALL) != (ssize_t) sizeof(sm))
+      {
+         // the server has stopped
+         exit(0);
+      }
+      for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+           cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+         {
+            const int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *p = (const int *) CMSG_DATA(cmsg);
+            fds.insert(fds.end(), p, p + n);
+         }
+      }
+   }
+   close(fd);
+   serve(fds, sm.start, sm.allow_shm != 0);
+   exit(0);
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2010, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-443271. All Rights
+// reserved. See file COPYRIGHT for details.
+//
+// This file is part of the GLVis visualization tool and library. For more
+// information and source code availability see http://glvis.org.
+//
+// GLVis is free software; you can redistribute it and/or modify it under the
+// terms of the GNU Lesser General Public License (as published by the Free
+// Software Foundation) version 2.1 dated February 1999.
+
+#ifndef GLVIS_WORKERS
+#define GLVIS_WORKERS
+
+#include <functional>
+#include <vector>
+
+#include <sys/types.h>
+
+/** Pool of pre-forked worker processes of the server. Each worker prepares a
+    session in advance, e.g. opens its window, and then waits for the sockets
+    of a session, which the server passes to it over a Unix socket pair. A
+    worker serves one session and exits, and Fill() forks a new worker to
+    take its place. */
+class WorkerPool
+{
+public:
+   /// Prepares a session in a new worker; returns false on failure.
+   typedef std::function<bool()> WarmUp;
+   /** Serves the session with the given sockets, accepted by the server at
+       the time 'start' (see GetSteadyTime()), whose clients may send their
+       data in shared memory if 'allow_shm' is set. Does not return. */
+   typedef std::function<void(std::vector<int> &, double start,
+                              bool allow_shm)> Serve;
+   /** Closes, in a new worker, the sockets of the server that the worker
+       must not keep open. */
+   typedef std::function<void()> CloseServer;
+
+   WorkerPool(int size, WarmUp warm_up, Serve serve,
+              CloseServer close_server);
+   ~WorkerPool() { Close(); }
+
+   /** Fork workers until the pool has its size. Call it when the server
+       holds no sockets of sessions, which the workers would inherit. */
+   void Fill();
+
+   /** Pass the sockets 'fds' of a session, accepted at the time 'start', to
+       a worker that has finished warming up, with the 'allow_shm' flag of
+       Serve; the server then closes its copies. Returns false if no worker
+       is ready. */
+   bool Dispatch(const std::vector<int> &fds, double start, bool allow_shm);
+
+   /** Close the connections to the workers, e.g. in the processes forked by
+       the server for other sessions. */
+   void Close();
+
+private:
+   struct Worker
+   {
+      pid_t pid;
+      int fd;
+      bool ready;
+   };
+
+   int size;
+   WarmUp warm_up;
+   Serve serve;
+   CloseServer close_server;
+   std::vector<Worker> workers;
+
+   /// Check which workers are ready, and drop the ones that failed.
+   void Poll();
+   void Drop(size_t i);
+   void RunWorker(int fd);
+};
+
+#endif